@@ -0,0 +1,133 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/16/24.
+//
+
+// Compares the batch culling kernels of MathOp with the scalar per-object tests.
+// Build with -mavx2 (or -mavx) to benchmark the AVX path, otherwise SSE is used on x86.
+
+#include "core/core.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+static constexpr U32 OBJECT_COUNT = 100000;
+static constexpr U32 ITERATION_COUNT = 200;
+
+// Don't let the compiler drop the results.
+static volatile U32 s_sink = 0;
+
+template <typename Function>
+static F64 MeasureMilliseconds(Function&& function)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	for (U32 i = 0; i < ITERATION_COUNT; ++i)
+	{
+		s_sink = s_sink + function();
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<F64, std::milli>(end - start).count() / ITERATION_COUNT;
+}
+
+int main()
+{
+#if defined(MATH_SIMD_AVX)
+	const char* simdName = "AVX";
+#elif defined(MATH_SIMD_SSE)
+	const char* simdName = "SSE";
+#else
+	const char* simdName = "scalar";
+#endif
+
+	// Frustum of a camera at the origin looking down +z, like LveCamera::GetFrustumPlanes for a 90 degree fov.
+	const F32 inverseSqrt2 = 0.70710678f;
+	Vector4 planes[6] = {
+		{ inverseSqrt2, 0.0f, inverseSqrt2, 0.0f },	  // left
+		{ -inverseSqrt2, 0.0f, inverseSqrt2, 0.0f },  // right
+		{ 0.0f, inverseSqrt2, inverseSqrt2, 0.0f },	  // bottom
+		{ 0.0f, -inverseSqrt2, inverseSqrt2, 0.0f },  // top
+		{ 0.0f, 0.0f, 1.0f, -0.1f },				  // near
+		{ 0.0f, 0.0f, -1.0f, 100.0f },				  // far
+	};
+
+	// Objects scattered around the camera, so roughly a sixth of them are visible.
+	std::mt19937 random(42);
+	std::uniform_real_distribution<F32> position(-100.0f, 100.0f);
+	std::uniform_real_distribution<F32> size(0.1f, 2.0f);
+
+	std::vector<Vector4> spheres(OBJECT_COUNT);
+	std::vector<Vector3> boxMins(OBJECT_COUNT);
+	std::vector<Vector3> boxMaxs(OBJECT_COUNT);
+	BoundingSphereSoA sphereSoA{};
+	BoundingBoxSoA boxSoA{};
+
+	for (U32 i = 0; i < OBJECT_COUNT; ++i)
+	{
+		Vector3 center{ position(random), position(random), position(random) };
+		F32 extent = size(random);
+
+		spheres[i] = Vector4(center, extent * 1.7320508f);
+		boxMins[i] = center - Vector3(extent);
+		boxMaxs[i] = center + Vector3(extent);
+		sphereSoA.Add(center, spheres[i].w);
+		boxSoA.Add(boxMins[i], boxMaxs[i]);
+	}
+
+	std::vector<U32> scalarIndices(OBJECT_COUNT);
+	std::vector<U32> batchIndices(OBJECT_COUNT);
+
+	// Spheres
+	U32 scalarSphereCount = 0;
+	F64 scalarSphereTime = MeasureMilliseconds([&]() {
+		scalarSphereCount = 0;
+		for (U32 i = 0; i < OBJECT_COUNT; ++i)
+		{
+			if (MathOp::IsSphereInFrustum(planes, Vector3(spheres[i]), spheres[i].w))
+			{
+				scalarIndices[scalarSphereCount++] = i;
+			}
+		}
+		return scalarSphereCount;
+	});
+
+	U32 batchSphereCount = 0;
+	F64 batchSphereTime = MeasureMilliseconds([&]() {
+		batchSphereCount = MathOp::CullSpheres(planes, sphereSoA, batchIndices.data());
+		return batchSphereCount;
+	});
+
+	bool isSphereMatching = scalarSphereCount == batchSphereCount &&
+							std::equal(scalarIndices.begin(), scalarIndices.begin() + scalarSphereCount, batchIndices.begin());
+
+	// Boxes
+	U32 scalarBoxCount = 0;
+	F64 scalarBoxTime = MeasureMilliseconds([&]() {
+		scalarBoxCount = 0;
+		for (U32 i = 0; i < OBJECT_COUNT; ++i)
+		{
+			if (MathOp::IsAabbInFrustum(planes, boxMins[i], boxMaxs[i]))
+			{
+				scalarIndices[scalarBoxCount++] = i;
+			}
+		}
+		return scalarBoxCount;
+	});
+
+	U32 batchBoxCount = 0;
+	F64 batchBoxTime = MeasureMilliseconds([&]() {
+		batchBoxCount = MathOp::CullAabbs(planes, boxSoA, batchIndices.data());
+		return batchBoxCount;
+	});
+
+	bool isBoxMatching = scalarBoxCount == batchBoxCount &&
+						 std::equal(scalarIndices.begin(), scalarIndices.begin() + scalarBoxCount, batchIndices.begin());
+
+	PRINT("Culling %u objects, average of %u iterations, batch kernels use %s", OBJECT_COUNT, ITERATION_COUNT, simdName);
+	PRINT("  Spheres: scalar %.3f ms, batch %.3f ms (%.1fx), %u visible, %s", scalarSphereTime, batchSphereTime,
+		scalarSphereTime / batchSphereTime, batchSphereCount, isSphereMatching ? "matching" : "MISMATCH");
+	PRINT("  Boxes:   scalar %.3f ms, batch %.3f ms (%.1fx), %u visible, %s", scalarBoxTime, batchBoxTime,
+		scalarBoxTime / batchBoxTime, batchBoxCount, isBoxMatching ? "matching" : "MISMATCH");
+
+	return 0;
+}
@@ -0,0 +1,151 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/19/24.
+//
+
+// Stress test of the job system. Exits with a non-zero code if a check fails.
+// Configure with -DLVE_ENABLE_TSAN=ON to run it under ThreadSanitizer.
+
+#include "core/core.h"
+#include "core/job_system.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+static constexpr U32 ROUND_COUNT = 200;
+
+static U32 s_failureCount = 0;
+
+static void Check(bool condition, const char* name, U32 round)
+{
+	if (!condition)
+	{
+		PRINT("  FAILED: %s (round %u)", name, round);
+		++s_failureCount;
+	}
+}
+
+// Sum of [0, count) over batches that write disjoint slots.
+static void TestParallelSum(JobSystem& jobSystem, U32 round)
+{
+	const U32 count = 10000 + round;
+	std::vector<U64> values(count, 0);
+
+	jobSystem.ParallelFor(count, 64, [&](U32 begin, U32 end) {
+		for (U32 i = begin; i < end; ++i)
+		{
+			values[i] = i;
+		}
+	});
+
+	U64 sum = 0;
+	for (U64 value : values)
+	{
+		sum += value;
+	}
+
+	Check(sum == static_cast<U64>(count) * (count - 1) / 2, "parallel sum", round);
+}
+
+// ParallelFor inside ParallelFor, so workers wait on their own counters while other jobs are queued.
+static void TestNestedParallelFor(JobSystem& jobSystem, U32 round)
+{
+	const U32 outerCount = 32;
+	const U32 innerCount = 256;
+	std::atomic<U32> total{ 0 };
+
+	jobSystem.ParallelFor(outerCount, 1, [&](U32 outerBegin, U32 outerEnd) {
+		for (U32 outer = outerBegin; outer < outerEnd; ++outer)
+		{
+			jobSystem.ParallelFor(innerCount, 16, [&](U32 begin, U32 end) {
+				total.fetch_add(end - begin, std::memory_order_relaxed);
+			});
+		}
+	});
+
+	Check(total.load() == outerCount * innerCount, "nested parallel for", round);
+}
+
+// Jobs that depend on a counter must see everything the jobs of that counter wrote, without atomics.
+static void TestDependencies(JobSystem& jobSystem, U32 round)
+{
+	const U32 count = 64;
+	std::vector<U32> first(count, 0);
+	std::vector<U32> second(count, 0);
+
+	JobCounter firstCounter;
+	JobCounter secondCounter;
+
+	for (U32 i = 0; i < count; ++i)
+	{
+		jobSystem.Submit([&first, i]() { first[i] = i + 1; }, &firstCounter);
+	}
+
+	for (U32 i = 0; i < count; ++i)
+	{
+		jobSystem.Submit([&first, &second, i]() { second[i] = first[(i + 1) % count] * 2; }, &secondCounter, firstCounter);
+	}
+
+	jobSystem.Wait(secondCounter);
+
+	bool isOrdered = true;
+	for (U32 i = 0; i < count; ++i)
+	{
+		isOrdered = isOrdered && second[i] == ((i + 1) % count + 1) * 2;
+	}
+
+	Check(isOrdered, "dependency ordering", round);
+}
+
+// Threads outside the job system push to and wait on the owner's deque.
+static void TestForeignSubmits(JobSystem& jobSystem, U32 round)
+{
+	const U32 threadCount = 4;
+	const U32 jobCount = 100;
+	std::atomic<U32> total{ 0 };
+
+	std::vector<std::thread> threads;
+	for (U32 t = 0; t < threadCount; ++t)
+	{
+		threads.emplace_back([&]() {
+			JobCounter counter;
+			for (U32 i = 0; i < jobCount; ++i)
+			{
+				jobSystem.Submit([&total]() { total.fetch_add(1, std::memory_order_relaxed); }, &counter);
+			}
+
+			// A foreign thread runs jobs of deque 0 while it waits.
+			jobSystem.Wait(counter);
+		});
+	}
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	Check(total.load() == threadCount * jobCount, "foreign submits", round);
+}
+
+int main()
+{
+	for (U32 round = 0; round < ROUND_COUNT; ++round)
+	{
+		// A new job system every round, so startup and shutdown with queued work are covered too.
+		JobSystem jobSystem(round % 2 == 0 ? 0 : 3);
+
+		TestParallelSum(jobSystem, round);
+		TestNestedParallelFor(jobSystem, round);
+		TestDependencies(jobSystem, round);
+		TestForeignSubmits(jobSystem, round);
+
+		// Left in the queues for the destructor to drain.
+		for (U32 i = 0; i < 16; ++i)
+		{
+			jobSystem.Submit([]() { std::this_thread::yield(); });
+		}
+	}
+
+	PRINT("Job system stress test: %u rounds, %u failures", ROUND_COUNT, s_failureCount);
+	return s_failureCount == 0 ? 0 : 1;
+}
@@ -0,0 +1,87 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/10/24.
+//
+
+// Loads every OBJ file of lve/models with the parallel loader and checks the result against tinyobj, parsed by one
+// thread and by all threads. Exits with a non-zero code if a file differs.
+// Usage: obj-loader-parity [models directory]
+
+#include "core/core.h"
+#include "core/job_system.h"
+#include "lve/lve_obj_loader.h"
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#ifndef LVE_MODELS_DIR
+#define LVE_MODELS_DIR "lve/models"
+#endif
+
+// Returns the number of loads that differ.
+static U32 CheckFiles(const std::vector<std::string>& filepaths)
+{
+	JobSystem jobSystem;
+	const U32 threadCount = jobSystem.GetThreadCount();
+
+	// A single chunk is parsed by one thread. One chunk per thread uses them all, and an odd count moves the chunk
+	// boundaries to other lines.
+	const U32 chunkCounts[] = { 1, threadCount, threadCount * 2 + 1 };
+
+	U32 failureCount = 0;
+	for (const std::string& filepath : filepaths)
+	{
+		for (U32 chunkCount : chunkCounts)
+		{
+			tinyobj::attrib_t attrib;
+			std::vector<tinyobj::index_t> indices;
+
+			if (!lve::LveObjLoader::Load(filepath, attrib, indices, chunkCount))
+			{
+				// The app falls back to tinyobj for files the loader does not handle, so this is not a mismatch.
+				PRINT("  skipped: %s (not handled by the parallel loader)", filepath.c_str());
+				break;
+			}
+
+			if (!lve::LveObjLoader::MatchesTinyObj(filepath, attrib, indices))
+			{
+				PRINT("  FAILED: %s (%u threads, %u chunks)", filepath.c_str(), threadCount, chunkCount);
+				++failureCount;
+			}
+		}
+	}
+
+	return failureCount;
+}
+
+int main(int argc, char** argv)
+{
+	std::filesystem::path directory = argc > 1 ? argv[1] : LVE_MODELS_DIR;
+
+	std::error_code error;
+	std::vector<std::string> filepaths;
+	for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(directory, error))
+	{
+		if (entry.is_regular_file() && entry.path().extension() == ".obj")
+		{
+			filepaths.push_back(entry.path().string());
+		}
+	}
+
+	if (error || filepaths.empty())
+	{
+		PRINT("No OBJ files found in %s", directory.string().c_str());
+		return 1;
+	}
+
+	std::sort(filepaths.begin(), filepaths.end());
+
+	U32 failureCount = CheckFiles(filepaths);
+
+	PRINT("OBJ loader parity: %zu files, %u failures", filepaths.size(), failureCount);
+	return failureCount == 0 ? 0 : 1;
+}
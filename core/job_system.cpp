@@ -0,0 +1,237 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/19/24.
+//
+
+#include "job_system.h"
+
+#include "core/uassert.h"
+
+#include <algorithm>
+
+namespace
+{
+	thread_local const JobSystem* t_jobSystem = nullptr;
+	thread_local U32 t_queueIndex = 0;
+} // namespace
+
+JobSystem::JobSystem(U32 workerCount)
+{
+	ASSERT(s_instance == nullptr, "Only one job system can exist at a time!");
+	s_instance = this;
+
+	if (workerCount == 0)
+	{
+		workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1;
+	}
+
+	m_queues.resize(static_cast<USize>(workerCount) + 1);
+	for (UniqueRef<WorkerQueue>& queue : m_queues)
+	{
+		queue = MakeUniqueRef<WorkerQueue>();
+	}
+
+	t_jobSystem = this;
+	t_queueIndex = 0;
+
+	m_workers.reserve(workerCount);
+	for (U32 i = 0; i < workerCount; ++i)
+	{
+		m_workers.emplace_back(&JobSystem::WorkerLoop, this, i + 1);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_isShuttingDown = true;
+	}
+	m_wakeCondition.notify_all();
+
+	// Workers drain the queues before they exit.
+	for (std::thread& worker : m_workers)
+	{
+		worker.join();
+	}
+
+	t_jobSystem = nullptr;
+	s_instance = nullptr;
+}
+
+JobSystem& JobSystem::Get()
+{
+	ASSERT(s_instance != nullptr, "Job system has not been created!");
+	return *s_instance;
+}
+
+void JobSystem::Submit(Job job, JobCounter* counter)
+{
+	if (counter != nullptr)
+	{
+		counter->m_count.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	Push({ std::move(job), counter });
+}
+
+void JobSystem::Submit(Job job, JobCounter* counter, JobCounter& dependency)
+{
+	if (counter != nullptr)
+	{
+		counter->m_count.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	{
+		// The dependency reaches zero under its mutex, so the job is either parked before that or pushed here.
+		std::lock_guard<std::mutex> lock(dependency.m_mutex);
+		if (!dependency.IsDone())
+		{
+			dependency.m_waitingJobs.push_back({ std::move(job), counter });
+			return;
+		}
+	}
+
+	Push({ std::move(job), counter });
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+	U32 queueIndex = GetQueueIndex();
+
+	while (!counter.IsDone())
+	{
+		if (!TryRunTask(queueIndex))
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	// The last job may still hold the mutex after decrementing to zero. Wait for it before the caller can destroy the counter.
+	std::lock_guard<std::mutex> lock(counter.m_mutex);
+}
+
+void JobSystem::ParallelFor(U32 count, U32 batchSize, const std::function<void(U32, U32)>& func)
+{
+	batchSize = std::max(1u, batchSize);
+
+	JobCounter counter;
+	for (U32 begin = 0; begin < count; begin += batchSize)
+	{
+		U32 end = std::min(count, begin + batchSize);
+		Submit([&func, begin, end]() { func(begin, end); }, &counter);
+	}
+
+	Wait(counter);
+}
+
+void JobSystem::Push(Task task)
+{
+	// Count before pushing, so the count never drops below the number of queued tasks. Taking the sleep mutex orders
+	// it before a worker's check, so the wake-up cannot be lost.
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_queuedTaskCount.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	WorkerQueue& queue = *m_queues[GetQueueIndex()];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(std::move(task));
+	}
+
+	m_wakeCondition.notify_one();
+}
+
+bool JobSystem::TryRunTask(U32 queueIndex)
+{
+	Task task;
+	bool isFound = false;
+
+	// Own queue first, newest job.
+	{
+		WorkerQueue& queue = *m_queues[queueIndex];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty())
+		{
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+			isFound = true;
+		}
+	}
+
+	// Steal the oldest job of another queue.
+	U32 queueCount = static_cast<U32>(m_queues.size());
+	for (U32 offset = 1; !isFound && offset < queueCount; ++offset)
+	{
+		WorkerQueue& queue = *m_queues[(queueIndex + offset) % queueCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty())
+		{
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			isFound = true;
+		}
+	}
+
+	if (!isFound)
+	{
+		return false;
+	}
+
+	m_queuedTaskCount.fetch_sub(1, std::memory_order_relaxed);
+	Execute(task);
+	return true;
+}
+
+void JobSystem::Execute(Task& task)
+{
+	task.job();
+
+	JobCounter* counter = task.counter;
+	if (counter == nullptr)
+	{
+		return;
+	}
+
+	std::vector<JobCounter::WaitingJob> releasedJobs;
+	{
+		std::lock_guard<std::mutex> lock(counter->m_mutex);
+		if (counter->m_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			releasedJobs.swap(counter->m_waitingJobs);
+		}
+	}
+
+	// The counter must not be touched from here on, since a waiter may already have destroyed it.
+	for (JobCounter::WaitingJob& waitingJob : releasedJobs)
+	{
+		Push({ std::move(waitingJob.job), waitingJob.counter });
+	}
+}
+
+void JobSystem::WorkerLoop(U32 queueIndex)
+{
+	t_jobSystem = this;
+	t_queueIndex = queueIndex;
+
+	while (true)
+	{
+		if (TryRunTask(queueIndex))
+		{
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_wakeCondition.wait(lock, [this]() { return m_queuedTaskCount.load(std::memory_order_relaxed) > 0 || m_isShuttingDown; });
+
+		if (m_isShuttingDown && m_queuedTaskCount.load(std::memory_order_relaxed) == 0)
+		{
+			return;
+		}
+	}
+}
+
+U32 JobSystem::GetQueueIndex() const
+{
+	return t_jobSystem == this ? t_queueIndex : 0;
+}
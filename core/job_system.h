@@ -0,0 +1,108 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/19/24.
+//
+
+#pragma once
+
+#include "core/typedefs.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using Job = std::function<void()>;
+
+// Counts unfinished jobs. Submitting a job with a counter increments it, and it is decremented when the job finishes.
+// A job can also depend on a counter, in which case it only starts once the counter reaches zero.
+class JobCounter
+{
+public:
+	JobCounter() = default;
+
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	bool IsDone() const { return m_count.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+
+	struct WaitingJob
+	{
+		Job job;
+		JobCounter* counter;
+	};
+
+	std::atomic<U32> m_count{ 0 };
+	// Guards the decrement to zero and m_waitingJobs.
+	std::mutex m_mutex;
+	std::vector<WaitingJob> m_waitingJobs;
+};
+
+// Work-stealing job scheduler.
+//
+// Each thread has its own deque. A thread pushes and pops jobs at the back of its own deque (LIFO, which keeps data
+// hot in cache) and steals from the front of the others when it runs out. Idle workers sleep until a job is pushed.
+// The thread that creates the job system owns deque 0 and runs jobs while it waits, so it is never idle in Wait.
+// Threads outside the job system also push to deque 0.
+class JobSystem
+{
+public:
+	// workerCount = 0 starts one worker per hardware thread, minus the calling thread.
+	explicit JobSystem(U32 workerCount = 0);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// The job system that is alive. There can only be one at a time.
+	static JobSystem& Get();
+
+	// Workers plus the owner thread.
+	U32 GetThreadCount() const { return static_cast<U32>(m_workers.size()) + 1; }
+
+	void Submit(Job job, JobCounter* counter = nullptr);
+	// The job starts only after dependency reaches zero.
+	void Submit(Job job, JobCounter* counter, JobCounter& dependency);
+
+	// Runs jobs on the calling thread until the counter reaches zero. The counter can be destroyed afterwards.
+	void Wait(JobCounter& counter);
+
+	// Calls func(begin, end) for consecutive ranges of at most batchSize covering [0, count), and waits for all of them.
+	void ParallelFor(U32 count, U32 batchSize, const std::function<void(U32, U32)>& func);
+
+private:
+	struct Task
+	{
+		Job job;
+		JobCounter* counter;
+	};
+
+	struct WorkerQueue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	void Push(Task task);
+	bool TryRunTask(U32 queueIndex);
+	void Execute(Task& task);
+	void WorkerLoop(U32 queueIndex);
+	U32 GetQueueIndex() const;
+
+private:
+	// Index 0 belongs to the owner thread. Index i + 1 belongs to m_workers[i].
+	std::vector<UniqueRef<WorkerQueue>> m_queues;
+	std::vector<std::thread> m_workers;
+
+	std::atomic<U32> m_queuedTaskCount{ 0 };
+	std::atomic<bool> m_isShuttingDown{ false };
+	std::mutex m_sleepMutex;
+	std::condition_variable m_wakeCondition;
+
+	static inline JobSystem* s_instance = nullptr;
+};
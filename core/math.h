@@ -12,6 +12,17 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/hash.hpp>
 
+#include <vector>
+
+// The widest instruction set enabled by the compiler flags is used by the batch kernels (e.g. -mavx2).
+#if defined(__AVX__)
+	#include <immintrin.h>
+	#define MATH_SIMD_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64)
+	#include <emmintrin.h>
+	#define MATH_SIMD_SSE 1
+#endif
+
 // Type definitions
 
 using Vector1 = glm::vec1;
@@ -72,6 +83,12 @@ namespace MathOp
 		return glm::normalize(value);
 	}
 
+	template <typename T>
+	inline F32 Length(const T& value)
+	{
+		return glm::length(value);
+	}
+
 	template <typename T>
 	inline F32 Dot(const T& v1, const T& v2)
 	{
@@ -98,7 +115,412 @@ namespace MathOp
 	template <typename T>
 	inline T Min(T v1, T v2)
 	{
-		return glm::max(v1, v2);
+		return glm::min(v1, v2);
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	// Culling
+	/////////////////////////////////////////////////////////////////////////////////
+
+	// Planes are (normal, distance) with normalized normals pointing inside, e.g. from LveCamera::GetFrustumPlanes.
+	inline bool IsSphereInFrustum(const Vector4 planes[6], const Vector3& center, F32 radius)
+	{
+		for (int i = 0; i < 6; ++i)
+		{
+			if (Dot(Vector3(planes[i]), center) + planes[i].w < -radius)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Conservative: boxes outside near a frustum corner can pass.
+	inline bool IsAabbInFrustum(const Vector4 planes[6], const Vector3& boundsMin, const Vector3& boundsMax)
+	{
+		for (int i = 0; i < 6; ++i)
+		{
+			// The corner furthest along the plane normal.
+			Vector3 corner{
+				planes[i].x >= 0.0f ? boundsMax.x : boundsMin.x,
+				planes[i].y >= 0.0f ? boundsMax.y : boundsMin.y,
+				planes[i].z >= 0.0f ? boundsMax.z : boundsMin.z
+			};
+
+			if (Dot(Vector3(planes[i]), corner) + planes[i].w < 0.0f)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Bounds of the transformed box (Arvo, Graphics Gems 1990).
+	inline void TransformAabb(const Matrix4& matrix, const Vector3& boundsMin, const Vector3& boundsMax, Vector3& outMin, Vector3& outMax)
+	{
+		Vector3 center = (boundsMin + boundsMax) * 0.5f;
+		Vector3 extent = (boundsMax - boundsMin) * 0.5f;
+
+		Vector3 newCenter = Vector3(matrix * Vector4(center, 1.0f));
+		Vector3 newExtent{ 0.0f };
+
+		for (int column = 0; column < 3; ++column)
+		{
+			newExtent += Abs(Vector3(matrix[column])) * extent[column];
+		}
+
+		outMin = newCenter - newExtent;
+		outMax = newCenter + newExtent;
+	}
+
+} // namespace MathOp
+
+/////////////////////////////////////////////////////////////////////////////////
+// Batch culling
+/////////////////////////////////////////////////////////////////////////////////
+
+// Bounding spheres as structure of arrays, so the culling kernels can load several of them per instruction.
+struct BoundingSphereSoA
+{
+	std::vector<F32> centerX;
+	std::vector<F32> centerY;
+	std::vector<F32> centerZ;
+	std::vector<F32> radius;
+
+	USize Size() const { return radius.size(); }
+
+	void Clear()
+	{
+		centerX.clear();
+		centerY.clear();
+		centerZ.clear();
+		radius.clear();
+	}
+
+	void Reserve(USize capacity)
+	{
+		centerX.reserve(capacity);
+		centerY.reserve(capacity);
+		centerZ.reserve(capacity);
+		radius.reserve(capacity);
+	}
+
+	void Add(const Vector3& center, F32 sphereRadius)
+	{
+		centerX.push_back(center.x);
+		centerY.push_back(center.y);
+		centerZ.push_back(center.z);
+		radius.push_back(sphereRadius);
+	}
+};
+
+// Axis-aligned bounding boxes as structure of arrays.
+struct BoundingBoxSoA
+{
+	std::vector<F32> minX;
+	std::vector<F32> minY;
+	std::vector<F32> minZ;
+	std::vector<F32> maxX;
+	std::vector<F32> maxY;
+	std::vector<F32> maxZ;
+
+	USize Size() const { return minX.size(); }
+
+	void Clear()
+	{
+		minX.clear();
+		minY.clear();
+		minZ.clear();
+		maxX.clear();
+		maxY.clear();
+		maxZ.clear();
+	}
+
+	void Reserve(USize capacity)
+	{
+		minX.reserve(capacity);
+		minY.reserve(capacity);
+		minZ.reserve(capacity);
+		maxX.reserve(capacity);
+		maxY.reserve(capacity);
+		maxZ.reserve(capacity);
+	}
+
+	void Add(const Vector3& boundsMin, const Vector3& boundsMax)
+	{
+		minX.push_back(boundsMin.x);
+		minY.push_back(boundsMin.y);
+		minZ.push_back(boundsMin.z);
+		maxX.push_back(boundsMax.x);
+		maxY.push_back(boundsMax.y);
+		maxZ.push_back(boundsMax.z);
+	}
+};
+
+namespace MathOp
+{
+	// Tests spheres against six frustum planes (see IsSphereInFrustum) with AVX (8 per iteration), SSE (4) or scalar
+	// code. Writes indices of the visible spheres in ascending order and returns their count.
+	// outVisibleIndices must have room for spheres.Size() entries.
+	inline U32 CullSpheres(const Vector4 planes[6], const BoundingSphereSoA& spheres, U32* outVisibleIndices)
+	{
+		const U32 count = static_cast<U32>(spheres.Size());
+		const F32* centerX = spheres.centerX.data();
+		const F32* centerY = spheres.centerY.data();
+		const F32* centerZ = spheres.centerZ.data();
+		const F32* radius = spheres.radius.data();
+
+		U32 visibleCount = 0;
+		U32 i = 0;
+
+#if defined(MATH_SIMD_AVX)
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 x = _mm256_loadu_ps(centerX + i);
+			__m256 y = _mm256_loadu_ps(centerY + i);
+			__m256 z = _mm256_loadu_ps(centerZ + i);
+			__m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(radius + i));
+			__m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+			for (int p = 0; p < 6; ++p)
+			{
+				__m256 distance = _mm256_add_ps(
+					_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes[p].x), x), _mm256_mul_ps(_mm256_set1_ps(planes[p].y), y)),
+					_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes[p].z), z), _mm256_set1_ps(planes[p].w)));
+				visible = _mm256_and_ps(visible, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+			}
+
+			// Branchless compaction: always write, only advance for visible lanes.
+			int mask = _mm256_movemask_ps(visible);
+			for (U32 lane = 0; lane < 8; ++lane)
+			{
+				outVisibleIndices[visibleCount] = i + lane;
+				visibleCount += (mask >> lane) & 1;
+			}
+		}
+#elif defined(MATH_SIMD_SSE)
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(centerX + i);
+			__m128 y = _mm_loadu_ps(centerY + i);
+			__m128 z = _mm_loadu_ps(centerZ + i);
+			__m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+			__m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+			for (int p = 0; p < 6; ++p)
+			{
+				__m128 distance = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[p].x), x), _mm_mul_ps(_mm_set1_ps(planes[p].y), y)),
+					_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[p].z), z), _mm_set1_ps(planes[p].w)));
+				visible = _mm_and_ps(visible, _mm_cmpge_ps(distance, negativeRadius));
+			}
+
+			int mask = _mm_movemask_ps(visible);
+			for (U32 lane = 0; lane < 4; ++lane)
+			{
+				outVisibleIndices[visibleCount] = i + lane;
+				visibleCount += (mask >> lane) & 1;
+			}
+		}
+#endif
+
+		for (; i < count; ++i)
+		{
+			outVisibleIndices[visibleCount] = i;
+			visibleCount += IsSphereInFrustum(planes, Vector3(centerX[i], centerY[i], centerZ[i]), radius[i]) ? 1 : 0;
+		}
+
+		return visibleCount;
+	}
+
+	// Same as CullSpheres for boxes (see IsAabbInFrustum).
+	inline U32 CullAabbs(const Vector4 planes[6], const BoundingBoxSoA& boxes, U32* outVisibleIndices)
+	{
+		const U32 count = static_cast<U32>(boxes.Size());
+
+		// The corner furthest along each plane normal only depends on the plane, so pick its arrays up front.
+		const F32* cornerX[6];
+		const F32* cornerY[6];
+		const F32* cornerZ[6];
+
+		for (int p = 0; p < 6; ++p)
+		{
+			cornerX[p] = planes[p].x >= 0.0f ? boxes.maxX.data() : boxes.minX.data();
+			cornerY[p] = planes[p].y >= 0.0f ? boxes.maxY.data() : boxes.minY.data();
+			cornerZ[p] = planes[p].z >= 0.0f ? boxes.maxZ.data() : boxes.minZ.data();
+		}
+
+		U32 visibleCount = 0;
+		U32 i = 0;
+
+#if defined(MATH_SIMD_AVX)
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+			for (int p = 0; p < 6; ++p)
+			{
+				__m256 distance = _mm256_add_ps(
+					_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes[p].x), _mm256_loadu_ps(cornerX[p] + i)),
+						_mm256_mul_ps(_mm256_set1_ps(planes[p].y), _mm256_loadu_ps(cornerY[p] + i))),
+					_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes[p].z), _mm256_loadu_ps(cornerZ[p] + i)),
+						_mm256_set1_ps(planes[p].w)));
+				visible = _mm256_and_ps(visible, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+			}
+
+			int mask = _mm256_movemask_ps(visible);
+			for (U32 lane = 0; lane < 8; ++lane)
+			{
+				outVisibleIndices[visibleCount] = i + lane;
+				visibleCount += (mask >> lane) & 1;
+			}
+		}
+#elif defined(MATH_SIMD_SSE)
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+			for (int p = 0; p < 6; ++p)
+			{
+				__m128 distance = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[p].x), _mm_loadu_ps(cornerX[p] + i)),
+						_mm_mul_ps(_mm_set1_ps(planes[p].y), _mm_loadu_ps(cornerY[p] + i))),
+					_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[p].z), _mm_loadu_ps(cornerZ[p] + i)), _mm_set1_ps(planes[p].w)));
+				visible = _mm_and_ps(visible, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+			}
+
+			int mask = _mm_movemask_ps(visible);
+			for (U32 lane = 0; lane < 4; ++lane)
+			{
+				outVisibleIndices[visibleCount] = i + lane;
+				visibleCount += (mask >> lane) & 1;
+			}
+		}
+#endif
+
+		for (; i < count; ++i)
+		{
+			outVisibleIndices[visibleCount] = i;
+			visibleCount += IsAabbInFrustum(planes, Vector3(boxes.minX[i], boxes.minY[i], boxes.minZ[i]),
+								Vector3(boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i]))
+								? 1
+								: 0;
+		}
+
+		return visibleCount;
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	// Batch trigonometry
+	/////////////////////////////////////////////////////////////////////////////////
+
+	namespace SinCosDetail
+	{
+		// pi/2 split into three parts, so that subtracting multiples of it stays exact for large angles (Cody-Waite).
+		constexpr F32 TWO_OVER_PI = 0.636619772367581343f;
+		constexpr F32 HALF_PI_1 = 1.5703125f;
+		constexpr F32 HALF_PI_2 = 4.837512969970703125e-4f;
+		constexpr F32 HALF_PI_3 = 7.54978995489188216e-8f;
+
+		// Minimax polynomials on [-pi/4, pi/4] (Cephes sinf/cosf).
+		constexpr F32 SIN_1 = -1.6666654611e-1f;
+		constexpr F32 SIN_2 = 8.3321608736e-3f;
+		constexpr F32 SIN_3 = -1.9515295891e-4f;
+		constexpr F32 COS_1 = 4.166664568298827e-2f;
+		constexpr F32 COS_2 = -1.388731625493765e-3f;
+		constexpr F32 COS_3 = 2.443315711809948e-5f;
+	} // namespace SinCosDetail
+
+	// Computes sine and cosine of count angles with AVX (8 per iteration), SSE (4) or scalar code.
+	// The error is within a few ulp for angles up to a few thousand radians, which is plenty for rotations.
+	// The output arrays may not alias the input.
+	inline void SinCos(const F32* angles, USize count, F32* outSines, F32* outCosines)
+	{
+		using namespace SinCosDetail;
+
+		USize i = 0;
+
+#if defined(MATH_SIMD_AVX)
+		const __m256 signBit = _mm256_set1_ps(-0.0f);
+		const __m256 half = _mm256_set1_ps(0.5f);
+
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 x = _mm256_loadu_ps(angles + i);
+
+			// Reduce to r in [-pi/4, pi/4] with x = q * pi/2 + r.
+			__m256 q = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(TWO_OVER_PI)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+			__m256 r = _mm256_sub_ps(x, _mm256_mul_ps(q, _mm256_set1_ps(HALF_PI_1)));
+			r = _mm256_sub_ps(r, _mm256_mul_ps(q, _mm256_set1_ps(HALF_PI_2)));
+			r = _mm256_sub_ps(r, _mm256_mul_ps(q, _mm256_set1_ps(HALF_PI_3)));
+			__m256 r2 = _mm256_mul_ps(r, r);
+
+			__m256 s = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(SIN_3), r2), _mm256_set1_ps(SIN_2));
+			s = _mm256_add_ps(_mm256_mul_ps(s, r2), _mm256_set1_ps(SIN_1));
+			s = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(s, r2), r), r);
+
+			__m256 c = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(COS_3), r2), _mm256_set1_ps(COS_2));
+			c = _mm256_add_ps(_mm256_mul_ps(c, r2), _mm256_set1_ps(COS_1));
+			c = _mm256_mul_ps(_mm256_mul_ps(c, r2), r2);
+			c = _mm256_add_ps(_mm256_sub_ps(c, _mm256_mul_ps(half, r2)), _mm256_set1_ps(1.0f));
+
+			// The quadrant is q mod 4. Bit 0 swaps sine and cosine, bit 1 negates sine, bit 0 xor bit 1 negates cosine.
+			// AVX has no 256-bit integer ops, so the bits are extracted with floor instead.
+			__m256 halfQ = _mm256_floor_ps(_mm256_mul_ps(q, half));
+			__m256 bit0 = _mm256_sub_ps(q, _mm256_add_ps(halfQ, halfQ));
+			__m256 quarterQ = _mm256_floor_ps(_mm256_mul_ps(halfQ, half));
+			__m256 bit1 = _mm256_sub_ps(halfQ, _mm256_add_ps(quarterQ, quarterQ));
+			__m256 swapMask = _mm256_cmp_ps(bit0, half, _CMP_GT_OQ);
+			__m256 sinNegateMask = _mm256_cmp_ps(bit1, half, _CMP_GT_OQ);
+			__m256 cosNegateMask = _mm256_xor_ps(swapMask, sinNegateMask);
+
+			__m256 sine = _mm256_blendv_ps(s, c, swapMask);
+			__m256 cosine = _mm256_blendv_ps(c, s, swapMask);
+			_mm256_storeu_ps(outSines + i, _mm256_xor_ps(sine, _mm256_and_ps(sinNegateMask, signBit)));
+			_mm256_storeu_ps(outCosines + i, _mm256_xor_ps(cosine, _mm256_and_ps(cosNegateMask, signBit)));
+		}
+#elif defined(MATH_SIMD_SSE)
+		const __m128 signBit = _mm_set1_ps(-0.0f);
+		const __m128 half = _mm_set1_ps(0.5f);
+
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(angles + i);
+
+			// Reduce to r in [-pi/4, pi/4] with x = q * pi/2 + r.
+			__m128i qi = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(TWO_OVER_PI)));
+			__m128 q = _mm_cvtepi32_ps(qi);
+			__m128 r = _mm_sub_ps(x, _mm_mul_ps(q, _mm_set1_ps(HALF_PI_1)));
+			r = _mm_sub_ps(r, _mm_mul_ps(q, _mm_set1_ps(HALF_PI_2)));
+			r = _mm_sub_ps(r, _mm_mul_ps(q, _mm_set1_ps(HALF_PI_3)));
+			__m128 r2 = _mm_mul_ps(r, r);
+
+			__m128 s = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN_3), r2), _mm_set1_ps(SIN_2));
+			s = _mm_add_ps(_mm_mul_ps(s, r2), _mm_set1_ps(SIN_1));
+			s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, r2), r), r);
+
+			__m128 c = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(COS_3), r2), _mm_set1_ps(COS_2));
+			c = _mm_add_ps(_mm_mul_ps(c, r2), _mm_set1_ps(COS_1));
+			c = _mm_mul_ps(_mm_mul_ps(c, r2), r2);
+			c = _mm_add_ps(_mm_sub_ps(c, _mm_mul_ps(half, r2)), _mm_set1_ps(1.0f));
+
+			// The quadrant is q mod 4. Bit 0 swaps sine and cosine, bit 1 negates sine, bit 0 xor bit 1 negates cosine.
+			__m128 swapMask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(qi, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+			__m128 sinNegateMask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(qi, _mm_set1_epi32(2)), _mm_set1_epi32(2)));
+			__m128 cosNegateMask = _mm_xor_ps(swapMask, sinNegateMask);
+
+			__m128 sine = _mm_or_ps(_mm_and_ps(swapMask, c), _mm_andnot_ps(swapMask, s));
+			__m128 cosine = _mm_or_ps(_mm_and_ps(swapMask, s), _mm_andnot_ps(swapMask, c));
+			_mm_storeu_ps(outSines + i, _mm_xor_ps(sine, _mm_and_ps(sinNegateMask, signBit)));
+			_mm_storeu_ps(outCosines + i, _mm_xor_ps(cosine, _mm_and_ps(cosNegateMask, signBit)));
+		}
+#endif
+
+		for (; i < count; ++i)
+		{
+			outSines[i] = Sin(angles[i]);
+			outCosines[i] = Cos(angles[i]);
+		}
 	}
 
 } // namespace MathOp
@@ -7,6 +7,7 @@
 #include "lve/system/simple_render_system.h"
 #include "lve/system/point_light_system.h"
 #include "lve/system/rainbow_system.h"
+#include "lve/system/transform_system.h"
 #include "lve/keyboard_movement_controller.h"
 
 #include <chrono>
@@ -22,14 +23,15 @@ namespace lve
 		alignas(16) Vector4 lightColor{ 1.0f }; // w is intensity
 	};
 
-	FirstApp::FirstApp()
+	FirstApp::FirstApp(const Config& config)
+		: m_config(config)
 	{
 		m_globalDescriptorPool =
 			LveDescriptorPool::Builder(m_device)
 				// How many descriptor sets can be created from the pool.
-				.SetMaxSets(LveSwapchain::MAX_FRAMES_IN_FLIGHT)
+				.SetMaxSets(1)
 				// How many descriptors of this type are available in the pool.
-				.AddPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, LveSwapchain::MAX_FRAMES_IN_FLIGHT)
+				.AddPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1)
 				.Build();
 		LoadGameObjects();
 	}
@@ -40,64 +42,67 @@ namespace lve
 
 	void FirstApp::Run()
 	{
-		// Uniform buffers
-		std::vector<UniqueRef<LveBuffer>> uboBuffers(LveSwapchain::MAX_FRAMES_IN_FLIGHT);
-
-		for (int i = 0; i < uboBuffers.size(); ++i)
-		{
-			uboBuffers[i] = MakeUniqueRef<LveBuffer>(
-				m_device,
-				sizeof(GlobalUbo),
-				1,
-				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT); // or add VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-
-			uboBuffers[i]->Map();
-		}
-
 		// Descriptors
+		// The global UBO is allocated from the frame allocator every frame and selected with a dynamic offset,
+		// so one set serves all frames in flight.
 		UniqueRef<LveDescriptorSetLayout> globalSetLayout =
 			LveDescriptorSetLayout::Builder(m_device)
-				.AddBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS)
+				.AddBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_ALL_GRAPHICS)
 				.Build();
 
-		std::vector<VkDescriptorSet> globalDescriptorSets(LveSwapchain::MAX_FRAMES_IN_FLIGHT); // one set per frame
-		for (int i = 0; i < globalDescriptorSets.size(); ++i)
-		{
-			VkDescriptorBufferInfo bufferInfo = uboBuffers[i]->DescriptorInfo();
+		VkDescriptorSet globalDescriptorSet;
+		VkDescriptorBufferInfo bufferInfo = m_frameAllocator.DescriptorInfo(sizeof(GlobalUbo));
 
-			LveDescriptorWriter(*globalSetLayout, *m_globalDescriptorPool)
-				.WriteBuffer(0, &bufferInfo)
-				.Build(globalDescriptorSets[i]);
-		}
+		LveDescriptorWriter(*globalSetLayout, *m_globalDescriptorPool)
+			.WriteBuffer(0, &bufferInfo)
+			.Build(globalDescriptorSet);
 
 		// Render system, camera, and controller
 		SimpleRenderSystem simpleRenderSystem(
-			m_device, m_renderer.GetSwapchainRenderPass(), globalSetLayout->GetDescriptorSetLayout());
+			m_device, m_renderer.GetSwapchainRenderPass(), globalSetLayout->GetDescriptorSetLayout(), m_config.renderMode);
 		PointLightSystem pointLightSystem(
 			m_device, m_renderer.GetSwapchainRenderPass(), globalSetLayout->GetDescriptorSetLayout());
 		RainbowSystem rainbowSystem(0.4f);
+		TransformSystem transformSystem;
 
 		LveCamera camera;
 		camera.SetViewTarget(Vector3(-1.0f, -2.0f, 2.0f), Vector3(0.0f, 0.0f, 2.5f));
 
-		LveGameObject viewerObject = LveGameObject::CreateGameObject();
-		viewerObject.transform.translation.z = -2.5;
+		// The viewer is not part of the scene, so its transform lives outside the registry.
+		TransformComponent viewerTransform;
+		viewerTransform.SetTranslation({ 0.0f, 0.0f, -2.5f });
 		KeyboardMovementController cameraController{};
 
 		std::chrono::time_point currentTime = std::chrono::high_resolution_clock::now();
+		F32 latencyPrintTimer = 0.0f;
 
 		while (!m_window.ShouldClose())
 		{
 			glfwPollEvents();
+			m_renderer.MarkInputSampled();
 
 			// Update time after polling because polling might block.
 			std::chrono::time_point newTime = std::chrono::high_resolution_clock::now();
 			F32 frameTime = std::chrono::duration<F32, std::chrono::seconds::period>(newTime - currentTime).count();
 			currentTime = newTime;
 
-			cameraController.MoveInPlaneXZ(m_window.GetNativeWindow(), frameTime, viewerObject);
-			camera.SetViewYXZ(viewerObject.transform.translation, viewerObject.transform.rotation);
+			latencyPrintTimer += frameTime;
+			if (m_config.printLatency && latencyPrintTimer >= 1.0f)
+			{
+				latencyPrintTimer = 0.0f;
+
+				LveRenderer::LatencyStats latency = m_renderer.GetLatencyStats();
+				PRINT("Latency (ms): input to submit %.2f (avg %.2f) | submit to GPU complete %.2f (avg %.2f)",
+					latency.inputToSubmit, latency.averageInputToSubmit, latency.submitToGpuComplete, latency.averageSubmitToGpuComplete);
+
+				if (latency.hasPresentTiming)
+				{
+					PRINT("              submit to present %.2f (avg %.2f)", latency.submitToPresent, latency.averageSubmitToPresent);
+				}
+			}
+
+			cameraController.MoveInPlaneXZ(m_window.GetNativeWindow(), frameTime, viewerTransform);
+			camera.SetViewYXZ(viewerTransform.GetTranslation(), viewerTransform.GetRotation());
 
 			F32 aspect = m_renderer.GetAspectRatio();
 			camera.SetPerspectiveProjection(MathOp::Radians(50.f), aspect, 0.1f, 100.f);
@@ -105,23 +110,37 @@ namespace lve
 			// Could be nullptr if, for example, the swapchain needs to be recreated.
 			if (VkCommandBuffer commandBuffer = m_renderer.BeginFrame())
 			{
-				// Prepare frame info
+				// The swapchain was recreated with another format, so its new render pass needs new pipelines.
+				if (m_renderer.WasRenderPassChanged())
+				{
+					m_renderer.ResetRenderPassChangedFlag();
+					simpleRenderSystem.RecreatePipelines(m_renderer.GetSwapchainRenderPass());
+					pointLightSystem.RecreatePipeline(m_renderer.GetSwapchainRenderPass());
+				}
+
 				U32 frameIndex = m_renderer.GetCurrentFrameIndex();
+				m_frameAllocator.BeginFrame(frameIndex);
+
+				GlobalUbo ubo{};
+				ubo.projection = camera.GetProjection();
+				ubo.view = camera.GetView();
+				LveFrameAllocator::Allocation uboAllocation = m_frameAllocator.Push(ubo);
+
+				// Prepare frame info
 				FrameInfo frameInfo{
 					.frameIndex = frameIndex,
 					.frameTime = frameTime,
 					.commandBuffer = commandBuffer,
-					.globalDescriptorSet = globalDescriptorSets[frameIndex],
+					.globalDescriptorSet = globalDescriptorSet,
+					.globalUboOffset = uboAllocation.offset,
 					.camera = camera,
-					.gameObjects = m_gameObjects
+					.registry = m_registry,
+					.renderer = m_renderer,
+					.frameAllocator = m_frameAllocator
 				};
 
 				// Update
-				GlobalUbo ubo{};
-				ubo.projection = camera.GetProjection();
-				ubo.view = camera.GetView();
-				uboBuffers[frameInfo.frameIndex]->WriteToBuffer(&ubo);
-				uboBuffers[frameInfo.frameIndex]->Flush();
+				transformSystem.Update(m_registry);
 
 				// The reason why BeginFrame and BeginSwapchainRenderPass are separate functions is
 				// we want the app to control over this to enable us easily integrating multiple render passes.
@@ -134,7 +153,10 @@ namespace lve
 				// -   Render objects
 				// - End shading pass
 				// - Post processing...
-				m_renderer.BeginSwapchainRenderPass(commandBuffer);
+				simpleRenderSystem.PrepareGameObjects(frameInfo, transformSystem);
+
+				// Render systems record their draws into secondary command buffers, the CPU-driven one on worker threads.
+				m_renderer.BeginSwapchainRenderPass(commandBuffer, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
 				simpleRenderSystem.RenderGameObjects(frameInfo);
 				pointLightSystem.Render(frameInfo);
@@ -153,28 +175,28 @@ namespace lve
 		// UniqueRef<LveModel> model = LveModel::CreateCubeModel(m_device, { 0.f, 0.f, 0.f });
 
 		// Model
-		UniqueRef<LveModel> smoothModel = LveModel::CreateModelFromFile(m_device, "models/smooth_vase.obj");
-		UniqueRef<LveModel> flatModel = LveModel::CreateModelFromFile(m_device, "models/flat_vase.obj");
-		UniqueRef<LveModel> quadModel = LveModel::CreateModelFromFile(m_device, "models/quad.obj");
-
-		LveGameObject gameObject = LveGameObject::CreateGameObject();
-		gameObject.model = std::move(smoothModel);
-		gameObject.transform.translation = { -0.5f, 0.5f, 0.0f };
-		gameObject.transform.scale = Vector3(2.0f);
-
-		LveGameObject gameObject2 = LveGameObject::CreateGameObject();
-		gameObject2.model = std::move(flatModel);
-		gameObject2.transform.translation = { 0.5f, 0.5f, 0.0f };
-		gameObject2.transform.scale = Vector3(2.0f);
-
-		LveGameObject gameObjectQuad = LveGameObject::CreateGameObject();
-		gameObjectQuad.model = std::move(quadModel);
-		gameObjectQuad.transform.translation = { 0.0f, 0.5f, 0.0f };
-		gameObjectQuad.transform.scale = { 3.0f, 1.0f, 3.0f };
-
-		m_gameObjects.emplace(gameObject.GetId(), std::move(gameObject));
-		m_gameObjects.emplace(gameObject2.GetId(), std::move(gameObject2));
-		m_gameObjects.emplace(gameObjectQuad.GetId(), std::move(gameObjectQuad));
+		LveModel::VertexFormat vertexFormat = LveModel::VertexFormat::Compact;
+		UniqueRef<LveModel> smoothModel = LveModel::CreateModelFromFile(m_device, "models/smooth_vase.obj", vertexFormat);
+		UniqueRef<LveModel> flatModel = LveModel::CreateModelFromFile(m_device, "models/flat_vase.obj", vertexFormat);
+		UniqueRef<LveModel> quadModel = LveModel::CreateModelFromFile(m_device, "models/quad.obj", vertexFormat);
+
+		LveEntity smoothVase = m_registry.CreateEntity();
+		m_registry.AddComponent<ModelComponent>(smoothVase, std::move(smoothModel));
+		TransformComponent& smoothVaseTransform = m_registry.AddComponent<TransformComponent>(smoothVase);
+		smoothVaseTransform.SetTranslation({ -0.5f, 0.5f, 0.0f });
+		smoothVaseTransform.SetScale(Vector3(2.0f));
+
+		LveEntity flatVase = m_registry.CreateEntity();
+		m_registry.AddComponent<ModelComponent>(flatVase, std::move(flatModel));
+		TransformComponent& flatVaseTransform = m_registry.AddComponent<TransformComponent>(flatVase);
+		flatVaseTransform.SetTranslation({ 0.5f, 0.5f, 0.0f });
+		flatVaseTransform.SetScale(Vector3(2.0f));
+
+		LveEntity quad = m_registry.CreateEntity();
+		m_registry.AddComponent<ModelComponent>(quad, std::move(quadModel));
+		TransformComponent& quadTransform = m_registry.AddComponent<TransformComponent>(quad);
+		quadTransform.SetTranslation({ 0.0f, 0.5f, 0.0f });
+		quadTransform.SetScale({ 3.0f, 1.0f, 3.0f });
 	}
 
 } // namespace lve
@@ -5,14 +5,17 @@
 #pragma once
 
 #include "core/core.h"
+#include "core/job_system.h"
 
 #include "lve_window.h"
 #include "lve_device.h"
 #include "lve_renderer.h"
 #include "lve_buffer.h"
+#include "lve_frame_allocator.h"
 #include "lve_descriptors.h"
-#include "lve_game_object.h"
+#include "lve_registry.h"
 #include "lve_camera.h"
+#include "lve/system/simple_render_system.h"
 
 #include <vector>
 #include <memory>
@@ -22,7 +25,16 @@ namespace lve
 	class FirstApp
 	{
 	public:
-		FirstApp();
+		struct Config
+		{
+			LveSwapchainConfig swapchain{};
+			// GPU-driven mode culls on the GPU and draws with indirect draws instead of recording draws per model.
+			SimpleRenderSystem::RenderMode renderMode = SimpleRenderSystem::RenderMode::CpuDriven;
+			// Print the renderer's latency stats about once a second.
+			bool printLatency = false;
+		};
+
+		explicit FirstApp(const Config& config);
 		~FirstApp();
 
 		FirstApp(const FirstApp&) = delete;
@@ -33,19 +45,26 @@ namespace lve
 	public:
 		static constexpr U32 WIDTH = 800;
 		static constexpr U32 HEIGHT = 600;
+		static constexpr VkDeviceSize FRAME_ALLOCATOR_CAPACITY = 64 * 1024;
 
 	private:
 		void LoadGameObjects();
 
 	private:
+		// Created first, since loading the scene already uses it.
+		JobSystem m_jobSystem;
+		Config m_config;
+
 		LveWindow m_window{ WIDTH, HEIGHT, "Hello Vulkan!" };
 		LveDevice m_device{ m_window };
-		LveRenderer m_renderer{ m_window, m_device };
+		LveRenderer m_renderer{ m_window, m_device, m_config.swapchain };
+		// Uniform data of the frame, e.g. GlobalUbo.
+		LveFrameAllocator m_frameAllocator{ m_device, FRAME_ALLOCATOR_CAPACITY, m_renderer.GetFramesInFlight() };
 
 		// Note: Order of declarations matters.
 		UniqueRef<LveDescriptorPool> m_globalDescriptorPool{};
 
-		LveGameObject::Map m_gameObjects;
+		LveRegistry m_registry;
 	};
 
 } // namespace lve
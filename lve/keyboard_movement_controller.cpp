@@ -6,7 +6,7 @@
 
 namespace lve
 {
-	void KeyboardMovementController::MoveInPlaneXZ(GLFWwindow* window, F32 dt, LveGameObject& gameObject)
+	void KeyboardMovementController::MoveInPlaneXZ(GLFWwindow* window, F32 dt, TransformComponent& transform)
 	{
 		Vector3 rotate{ 0.0f };
 
@@ -19,16 +19,19 @@ namespace lve
 		if (glfwGetKey(window, keys.lookDown) == GLFW_PRESS)
 			rotate.x -= 1.0f;
 
+		Vector3 rotation = transform.GetRotation();
+
 		if (MathOp::Dot(rotate, rotate) > std::numeric_limits<F32>::epsilon())
 		{
-			gameObject.transform.rotation += lookSpeed * dt * MathOp::Normalize(rotate);
+			rotation += lookSpeed * dt * MathOp::Normalize(rotate);
 		}
 
 		// Limit pitch values between about +/- 85ish degrees.
-		gameObject.transform.rotation.x = MathOp::Clamp(gameObject.transform.rotation.x, -1.5f, 1.5f);
-		gameObject.transform.rotation.y = glm::mod(gameObject.transform.rotation.y, GLM_2_PI);
+		rotation.x = MathOp::Clamp(rotation.x, -1.5f, 1.5f);
+		rotation.y = glm::mod(rotation.y, GLM_2_PI);
+		transform.SetRotation(rotation);
 
-		float yaw = gameObject.transform.rotation.y;
+		float yaw = rotation.y;
 		const Vector3 forwardDir{ MathOp::Sin(yaw), 0.0f, MathOp::Cos(yaw) };
 		const Vector3 rightDir{ forwardDir.z, 0.0f, -forwardDir.x };
 		const Vector3 upDir{ 0.0f, -1.0f, 0.0f };
@@ -51,7 +54,7 @@ namespace lve
 
 		if (MathOp::Dot(moveDir, moveDir) > std::numeric_limits<F32>::epsilon())
 		{
-			gameObject.transform.translation += moveSpeed * dt * MathOp::Normalize(moveDir);
+			transform.SetTranslation(transform.GetTranslation() + moveSpeed * dt * MathOp::Normalize(moveDir));
 		}
 	}
 
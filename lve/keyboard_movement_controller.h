@@ -6,7 +6,7 @@
 
 #include "core/core.h"
 
-#include "lve_game_object.h"
+#include "lve_components.h"
 #include "lve_window.h"
 
 namespace lve
@@ -29,7 +29,7 @@ namespace lve
 			int lookDown = GLFW_KEY_DOWN;
 		};
 
-		void MoveInPlaneXZ(GLFWwindow* window, F32 dt, LveGameObject& gameObject);
+		void MoveInPlaneXZ(GLFWwindow* window, F32 dt, TransformComponent& transform);
 
 	public:
 		KeyMappings keys{};
@@ -4,6 +4,8 @@
 
 #include "lve_buffer.h"
 
+#include <algorithm>
+
 namespace lve
 {
 	LveBuffer::LveBuffer(
@@ -21,7 +23,7 @@ namespace lve
 	{
 		m_alignmentSize = GetAlignment(instanceSize, minOffsetAlignment);
 		m_bufferSize = m_alignmentSize * instanceCount;
-		m_device.CreateBuffer(m_bufferSize, m_usageFlags, m_memoryPropertyFlags, m_buffer, m_memory);
+		m_device.CreateBuffer(m_bufferSize, m_usageFlags, m_memoryPropertyFlags, m_buffer, m_allocation);
 
 		PRINT("New buffer of (%llu x %u) bytes (actual: %llu bytes), with min offset alignment: %llu",
 			instanceSize, instanceCount, m_bufferSize, minOffsetAlignment);
@@ -30,27 +32,25 @@ namespace lve
 	LveBuffer::~LveBuffer()
 	{
 		Unmap();
-		vkDestroyBuffer(m_device.GetDevice(), m_buffer, nullptr);
-		vkFreeMemory(m_device.GetDevice(), m_memory, nullptr);
+		// The GPU may still read the buffer in frames in flight.
+		m_device.DestroyBuffer(m_buffer, m_allocation);
 	}
 
 	VkResult LveBuffer::Map(VkDeviceSize size, VkDeviceSize offset)
 	{
-		ASSERT(m_buffer && m_memory, "Failed to map buffer since buffer resources are not created!");
+		ASSERT(m_buffer && m_allocation.memory, "Failed to map buffer since buffer resources are not created!");
+		ASSERT(m_allocation.mappedData, "Failed to map buffer since its memory is not host visible!");
 
-		// Map the host memory on CPU to the device memory on GPU.
-		// memcpy will copy the vertices data memory to the memory on CPU.
+		// The allocator maps host visible memory blocks once and keeps them mapped, since a memory object can only
+		// be mapped once and it is shared by many buffers. memcpy will copy the data to the memory on CPU.
 		// Since we use COHERENT flag, the CPU memory will automatically be flushed to update GPU memory.
-		return vkMapMemory(m_device.GetDevice(), m_memory, offset, size, 0, &m_mappedData);
+		m_mappedData = static_cast<char*>(m_allocation.mappedData) + offset;
+		return VK_SUCCESS;
 	}
 
 	void LveBuffer::Unmap()
 	{
-		if (m_mappedData)
-		{
-			vkUnmapMemory(m_device.GetDevice(), m_memory);
-			m_mappedData = nullptr;
-		}
+		m_mappedData = nullptr;
 	}
 
 	void LveBuffer::WriteToBuffer(void* data, VkDeviceSize size, VkDeviceSize offset)
@@ -70,11 +70,7 @@ namespace lve
 
 	VkResult LveBuffer::Flush(VkDeviceSize size, VkDeviceSize offset)
 	{
-		VkMappedMemoryRange mappedRange{};
-		mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-		mappedRange.memory = m_memory;
-		mappedRange.offset = offset;
-		mappedRange.size = size;
+		VkMappedMemoryRange mappedRange = GetMappedMemoryRange(size, offset);
 		return vkFlushMappedMemoryRanges(m_device.GetDevice(), 1, &mappedRange);
 	}
 
@@ -85,11 +81,7 @@ namespace lve
 
 	VkResult LveBuffer::Invalidate(VkDeviceSize size, VkDeviceSize offset)
 	{
-		VkMappedMemoryRange mappedRange{};
-		mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-		mappedRange.memory = m_memory;
-		mappedRange.offset = offset;
-		mappedRange.size = size;
+		VkMappedMemoryRange mappedRange = GetMappedMemoryRange(size, offset);
 		return vkInvalidateMappedMemoryRanges(m_device.GetDevice(), 1, &mappedRange);
 	}
 
@@ -125,4 +117,33 @@ namespace lve
 		}
 	}
 
+	VkMappedMemoryRange LveBuffer::GetMappedMemoryRange(VkDeviceSize size, VkDeviceSize offset)
+	{
+		// The buffer only owns part of the memory object, so offsets are relative to the allocation and
+		// VK_WHOLE_SIZE means the whole allocation. Allocations start at a multiple of nonCoherentAtomSize.
+		VkDeviceSize atomSize = m_device.GetMemoryAllocator().GetNonCoherentAtomSize();
+
+		if (size == VK_WHOLE_SIZE)
+		{
+			size = m_allocation.size - offset;
+		}
+
+		VkDeviceSize begin = offset / atomSize * atomSize;
+		VkDeviceSize end = std::min((offset + size + atomSize - 1) / atomSize * atomSize, m_allocation.size);
+
+		VkMappedMemoryRange mappedRange{};
+		mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		mappedRange.memory = m_allocation.memory;
+		mappedRange.offset = m_allocation.offset + begin;
+		mappedRange.size = end - begin;
+
+		// A dedicated allocation may not end on an atom boundary, where only VK_WHOLE_SIZE is valid.
+		if (m_allocation.dedicated && end == m_allocation.size)
+		{
+			mappedRange.size = VK_WHOLE_SIZE;
+		}
+
+		return mappedRange;
+	}
+
 } // namespace lve
@@ -26,8 +26,9 @@ namespace lve
 		LveBuffer& operator=(const LveBuffer&) = delete;
 
 		// Map a memory range of this buffer. If successful, mapped points to the specified buffer range.
+		// Host visible memory is persistently mapped by the allocator, so this only computes the pointer.
 		VkResult Map(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
-		// Unmap a mapped memory range.
+		// Unmap a mapped memory range. The underlying memory block stays mapped.
 		void Unmap();
 
 		// Copy the specified data to the mapped buffer. Default value writes the whole buffer range.
@@ -64,11 +65,14 @@ namespace lve
 		// - GetAlignment(9, 16) returns 16
 		static VkDeviceSize GetAlignment(VkDeviceSize instanceSize, VkDeviceSize minOffsetAlignment);
 
+		// Returns a range of the allocation that is aligned to nonCoherentAtomSize, as required for flush and invalidate.
+		VkMappedMemoryRange GetMappedMemoryRange(VkDeviceSize size, VkDeviceSize offset);
+
 	private:
 		LveDevice& m_device;
 		void* m_mappedData = nullptr;
 		VkBuffer m_buffer = VK_NULL_HANDLE;
-		VkDeviceMemory m_memory = VK_NULL_HANDLE;
+		LveAllocation m_allocation{};
 
 		VkDeviceSize m_bufferSize;
 		U32 m_instanceCount;
@@ -91,4 +91,28 @@ namespace lve
 		m_viewMatrix[3][2] = -MathOp::Dot(w, position);
 	}
 
+	void LveCamera::GetFrustumPlanes(Vector4 planes[6]) const
+	{
+		// Gribb-Hartmann: planes are sums and differences of the rows of the view projection matrix. Depth is in [0, 1].
+		Matrix4 viewProjection = m_projectionMatrix * m_viewMatrix;
+
+		Vector4 rows[4];
+		for (U32 i = 0; i < 4; ++i)
+		{
+			rows[i] = Vector4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+		}
+
+		planes[0] = rows[3] + rows[0]; // left
+		planes[1] = rows[3] - rows[0]; // right
+		planes[2] = rows[3] + rows[1]; // bottom
+		planes[3] = rows[3] - rows[1]; // top
+		planes[4] = rows[2];		   // near
+		planes[5] = rows[3] - rows[2]; // far
+
+		for (U32 i = 0; i < 6; ++i)
+		{
+			planes[i] /= MathOp::Length(Vector3(planes[i]));
+		}
+	}
+
 } // namespace lve
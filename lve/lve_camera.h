@@ -21,6 +21,10 @@ namespace lve
 		const Matrix4& GetProjection() const { return m_projectionMatrix; }
 		const Matrix4& GetView() const { return m_viewMatrix; }
 
+		// World space frustum planes (left, right, bottom, top, near, far) as (normal, distance). Normals point inward
+		// and are normalized, so Dot(plane.xyz, point) + plane.w is the signed distance to the plane.
+		void GetFrustumPlanes(Vector4 planes[6]) const;
+
 	private:
 		Matrix4 m_projectionMatrix{ 1.0f };
 		Matrix4 m_viewMatrix{ 1.0f };
@@ -0,0 +1,152 @@
+//
+// Created by Junhao Wang (@forkercat) on 4/14/24.
+//
+
+#include "lve_components.h"
+
+namespace lve
+{
+	// Matrix corresponds to Translate * Ry * Rx * Rz * Scale
+	// Rotations correspond to Tait-bryan angles of Y(1), X(2), Z(3)
+	// https://en.wikipedia.org/wiki/Euler_angles#Rotation_matrix
+	Matrix4 TransformComponent::GetTransform() const
+	{
+		const float c3 = MathOp::Cos(m_rotation.z);
+		const float s3 = MathOp::Sin(m_rotation.z);
+		const float c2 = MathOp::Cos(m_rotation.x);
+		const float s2 = MathOp::Sin(m_rotation.x);
+		const float c1 = MathOp::Cos(m_rotation.y);
+		const float s1 = MathOp::Sin(m_rotation.y);
+		return Matrix4{
+			{
+				m_scale.x * (c1 * c3 + s1 * s2 * s3),
+				m_scale.x * (c2 * s3),
+				m_scale.x * (c1 * s2 * s3 - c3 * s1),
+				0.0f,
+			},
+			{
+				m_scale.y * (c3 * s1 * s2 - c1 * s3),
+				m_scale.y * (c2 * c3),
+				m_scale.y * (c1 * c3 * s2 + s1 * s3),
+				0.0f,
+			},
+			{
+				m_scale.z * (c2 * s1),
+				m_scale.z * (-s2),
+				m_scale.z * (c1 * c2),
+				0.0f,
+			},
+			{ m_translation.x, m_translation.y, m_translation.z, 1.0f }
+		};
+	}
+
+	Matrix3 TransformComponent::GetNormalMatrix() const
+	{
+		const float c3 = MathOp::Cos(m_rotation.z);
+		const float s3 = MathOp::Sin(m_rotation.z);
+		const float c2 = MathOp::Cos(m_rotation.x);
+		const float s2 = MathOp::Sin(m_rotation.x);
+		const float c1 = MathOp::Cos(m_rotation.y);
+		const float s1 = MathOp::Sin(m_rotation.y);
+		const Vector3 invScale = 1.0f / m_scale;
+
+		return Matrix3{
+			{
+				invScale.x * (c1 * c3 + s1 * s2 * s3),
+				invScale.x * (c2 * s3),
+				invScale.x * (c1 * s2 * s3 - c3 * s1),
+			},
+			{
+				invScale.y * (c3 * s1 * s2 - c1 * s3),
+				invScale.y * (c2 * c3),
+				invScale.y * (c1 * c3 * s2 + s1 * s3),
+			},
+			{
+				invScale.z * (c2 * s1),
+				invScale.z * (-s2),
+				invScale.z * (c1 * c2),
+			},
+		};
+	}
+
+	void TransformBatch::Clear()
+	{
+		m_translations.clear();
+		m_rotations.clear();
+		m_scales.clear();
+	}
+
+	void TransformBatch::Reserve(USize capacity)
+	{
+		m_translations.reserve(capacity);
+		m_rotations.reserve(capacity);
+		m_scales.reserve(capacity);
+	}
+
+	void TransformBatch::Add(const TransformComponent& transform)
+	{
+		m_translations.push_back(transform.GetTranslation());
+		m_rotations.push_back(transform.GetRotation());
+		m_scales.push_back(transform.GetScale());
+	}
+
+	void TransformBatch::ComputeMatrices(Matrix4* outModelMatrices, Matrix4* outNormalMatrices, USize outStride)
+	{
+		const USize count = Size();
+		const USize angleCount = count * 3;
+
+		if (count == 0)
+		{
+			return;
+		}
+
+		if (m_sines.size() < angleCount)
+		{
+			m_sines.resize(angleCount);
+			m_cosines.resize(angleCount);
+		}
+
+		// Vector3 is tightly packed, so the rotations are one array of x, y, z angles.
+		static_assert(sizeof(Vector3) == sizeof(F32) * 3);
+		MathOp::SinCos(&m_rotations.data()->x, angleCount, m_sines.data(), m_cosines.data());
+
+		U8* modelOutput = reinterpret_cast<U8*>(outModelMatrices);
+		U8* normalOutput = reinterpret_cast<U8*>(outNormalMatrices);
+
+		for (USize i = 0; i < count; ++i)
+		{
+			// Same terms as GetTransform.
+			const F32 s2 = m_sines[i * 3 + 0];
+			const F32 c2 = m_cosines[i * 3 + 0];
+			const F32 s1 = m_sines[i * 3 + 1];
+			const F32 c1 = m_cosines[i * 3 + 1];
+			const F32 s3 = m_sines[i * 3 + 2];
+			const F32 c3 = m_cosines[i * 3 + 2];
+
+			const Vector3 axisX{ c1 * c3 + s1 * s2 * s3, c2 * s3, c1 * s2 * s3 - c3 * s1 };
+			const Vector3 axisY{ c3 * s1 * s2 - c1 * s3, c2 * c3, c1 * c3 * s2 + s1 * s3 };
+			const Vector3 axisZ{ c2 * s1, -s2, c1 * c2 };
+
+			const Vector3& scale = m_scales[i];
+
+			if (outModelMatrices != nullptr)
+			{
+				Matrix4& modelMatrix = *reinterpret_cast<Matrix4*>(modelOutput + i * outStride);
+				modelMatrix[0] = Vector4(scale.x * axisX, 0.0f);
+				modelMatrix[1] = Vector4(scale.y * axisY, 0.0f);
+				modelMatrix[2] = Vector4(scale.z * axisZ, 0.0f);
+				modelMatrix[3] = Vector4(m_translations[i], 1.0f);
+			}
+
+			if (outNormalMatrices != nullptr)
+			{
+				Matrix4& normalMatrix = *reinterpret_cast<Matrix4*>(normalOutput + i * outStride);
+				normalMatrix[0] = Vector4(axisX / scale.x, 0.0f);
+				normalMatrix[1] = Vector4(axisY / scale.y, 0.0f);
+				normalMatrix[2] = Vector4(axisZ / scale.z, 0.0f);
+				normalMatrix[3] = Vector4(0.0f, 0.0f, 0.0f, 1.0f);
+			}
+		}
+	}
+
+} // namespace lve
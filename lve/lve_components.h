@@ -0,0 +1,169 @@
+//
+// Created by Junhao Wang (@forkercat) on 4/14/24.
+//
+
+#pragma once
+
+#include "core/core.h"
+
+#include "lve_model.h"
+#include "lve_registry.h"
+
+#include <mutex>
+#include <vector>
+
+namespace lve
+{
+	/////////////////////////////////////////////////////////////////////////////////
+	// Components
+	/////////////////////////////////////////////////////////////////////////////////
+
+	// Entities whose transform became dirty since the last TransformSystem::Update. Transforms may be changed from
+	// several threads at once, so adding is guarded by a mutex.
+	class TransformDirtyList
+	{
+	public:
+		void Add(LveEntity entity)
+		{
+			std::lock_guard lock(m_mutex);
+			m_entities.push_back(entity);
+		}
+
+		// Moves the entities to outEntities and empties the list.
+		void Take(std::vector<LveEntity>& outEntities)
+		{
+			outEntities.clear();
+
+			std::lock_guard lock(m_mutex);
+			m_entities.swap(outEntities);
+		}
+
+		void Clear()
+		{
+			std::lock_guard lock(m_mutex);
+			m_entities.clear();
+		}
+
+	private:
+		std::mutex m_mutex;
+		std::vector<LveEntity> m_entities;
+	};
+
+	// Translation, rotation and scale relative to the parent entity, or to the world for root entities.
+	// World matrices are cached. TransformSystem only recomputes them when this transform or a parent's changed.
+	// Different transforms can be changed from different threads at the same time.
+	class TransformComponent
+	{
+	public:
+		const Vector3& GetTranslation() const { return m_translation; }
+		const Vector3& GetRotation() const { return m_rotation; }
+		const Vector3& GetScale() const { return m_scale; }
+
+		void SetTranslation(const Vector3& translation)
+		{
+			m_translation = translation;
+			MarkDirty();
+		}
+
+		void SetRotation(const Vector3& rotation)
+		{
+			m_rotation = rotation;
+			MarkDirty();
+		}
+
+		void SetScale(const Vector3& scale)
+		{
+			m_scale = scale;
+			MarkDirty();
+		}
+
+		void MarkDirty()
+		{
+			if (!m_isDirty)
+			{
+				m_isDirty = true;
+
+				if (m_dirtyList != nullptr)
+				{
+					m_dirtyList->Add(m_entity);
+				}
+			}
+		}
+
+		bool IsDirty() const { return m_isDirty; }
+
+		// Local matrices
+		Matrix4 GetTransform() const;
+
+		Matrix3 GetNormalMatrix() const;
+
+		// World matrices as of the last TransformSystem::Update. The normal matrix is widened to Matrix4.
+		const Matrix4& GetWorldMatrix() const { return m_worldMatrix; }
+		const Matrix4& GetWorldNormalMatrix() const { return m_worldNormalMatrix; }
+
+	private:
+		friend class TransformSystem;
+
+		Vector3 m_translation{};
+		Vector3 m_rotation{};
+		Vector3 m_scale{ 1.0f, 1.0f, 1.0f };
+
+		Matrix4 m_worldMatrix{ 1.0f };
+		Matrix4 m_worldNormalMatrix{ 1.0f };
+
+		// New transforms start dirty. They are picked up by the hierarchy rebuild, which also sets the dirty list.
+		bool m_isDirty = true;
+
+		// Set by the TransformSystem that updates the transform. Transforms outside a registry have none.
+		TransformDirtyList* m_dirtyList = nullptr;
+		LveEntity m_entity = INVALID_ENTITY;
+	};
+
+	// Transforms as arrays, for computing the matrices of many objects at once.
+	class TransformBatch
+	{
+	public:
+		USize Size() const { return m_rotations.size(); }
+
+		void Clear();
+		void Reserve(USize capacity);
+		void Add(const TransformComponent& transform);
+
+		const Vector3& GetScale(USize index) const { return m_scales[index]; }
+
+		// Writes the model matrix (same as GetTransform) and the normal matrix (GetNormalMatrix widened to Matrix4) of
+		// every transform. Sines and cosines are computed once per object with SIMD. The matrices of transform i are
+		// written at byte offset i * outStride, so they can go straight into interleaved per-object data.
+		// Either output may be null.
+		void ComputeMatrices(Matrix4* outModelMatrices, Matrix4* outNormalMatrices, USize outStride = sizeof(Matrix4));
+
+	private:
+		std::vector<Vector3> m_translations;
+		std::vector<Vector3> m_rotations;
+		std::vector<Vector3> m_scales;
+
+		// Reused across calls.
+		std::vector<F32> m_sines;
+		std::vector<F32> m_cosines;
+	};
+
+	struct ModelComponent
+	{
+		Ref<LveModel> model{};
+	};
+
+	struct ColorComponent
+	{
+		Vector3 color{};
+	};
+
+	// Parent and children as an intrusive linked list, so the component has no allocations of its own.
+	// Entities without it are roots. Edit it with the functions of TransformSystem.
+	struct HierarchyComponent
+	{
+		LveEntity parent = INVALID_ENTITY;
+		LveEntity firstChild = INVALID_ENTITY;
+		LveEntity nextSibling = INVALID_ENTITY;
+	};
+
+} // namespace lve
@@ -0,0 +1,59 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/20/24.
+//
+
+#include "lve_deletion_queue.h"
+
+#include <vector>
+
+namespace lve
+{
+	LveDeletionQueue::~LveDeletionQueue()
+	{
+		ASSERT(m_entries.empty(), "Deletion queue was not flushed before destruction!");
+	}
+
+	void LveDeletionQueue::Push(U64 frameNumber, Deleter deleter)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		ASSERT(m_entries.empty() || m_entries.back().frameNumber <= frameNumber, "Frame numbers must not decrease!");
+		m_entries.push_back({ frameNumber, std::move(deleter) });
+	}
+
+	void LveDeletionQueue::Collect(U64 completedFrameCount)
+	{
+		// Deleters may push new entries, e.g. a pool freeing its buffers, so run them outside the lock.
+		std::vector<Deleter> deleters;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			while (!m_entries.empty() && m_entries.front().frameNumber < completedFrameCount)
+			{
+				deleters.push_back(std::move(m_entries.front().deleter));
+				m_entries.pop_front();
+			}
+		}
+
+		for (Deleter& deleter : deleters)
+		{
+			deleter();
+		}
+	}
+
+	void LveDeletionQueue::Flush()
+	{
+		// Repeat until deleters stop pushing new entries.
+		while (GetSize() > 0)
+		{
+			Collect(UINT64_MAX);
+		}
+	}
+
+	USize LveDeletionQueue::GetSize()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_entries.size();
+	}
+
+} // namespace lve
@@ -0,0 +1,51 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/20/24.
+//
+
+#pragma once
+
+#include "core/core.h"
+
+#include <deque>
+#include <functional>
+#include <mutex>
+
+namespace lve
+{
+	// Destroys resources once the GPU has finished the frames that may use them, so replacing a resource at runtime
+	// never needs to wait for the device to be idle.
+	//
+	// Each deleter is tagged with the number of the frame being recorded when it was pushed. The frame and every
+	// earlier one may still reference the resource. Deleters run in push order.
+	class LveDeletionQueue
+	{
+	public:
+		using Deleter = std::function<void()>;
+
+		LveDeletionQueue() = default;
+		~LveDeletionQueue();
+
+		LveDeletionQueue(const LveDeletionQueue&) = delete;
+		LveDeletionQueue& operator=(const LveDeletionQueue&) = delete;
+
+		// Safe to call from several threads.
+		void Push(U64 frameNumber, Deleter deleter);
+		// Run the deleters of frames before completedFrameCount, i.e. frames whose fences have signaled.
+		void Collect(U64 completedFrameCount);
+		// Run all deleters. The device must be idle.
+		void Flush();
+
+		USize GetSize();
+
+	private:
+		struct Entry
+		{
+			U64 frameNumber;
+			Deleter deleter;
+		};
+
+		std::deque<Entry> m_entries;
+		std::mutex m_mutex;
+	};
+
+} // namespace lve
@@ -107,7 +107,10 @@ namespace lve
 
 	LveDescriptorPool::~LveDescriptorPool()
 	{
-		vkDestroyDescriptorPool(m_device.GetDevice(), m_descriptorPool, nullptr);
+		// Deferred as well, so it outlives sets queued by FreeDescriptorSets and sets bound by frames in flight.
+		m_device.DeferDestruction([device = m_device.GetDevice(), descriptorPool = m_descriptorPool]() {
+			vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+		});
 	}
 
 	bool LveDescriptorPool::AllocateDescriptorSet(const VkDescriptorSetLayout descriptorSetLayout, VkDescriptorSet& descriptorSet) const
@@ -125,7 +128,10 @@ namespace lve
 
 	void LveDescriptorPool::FreeDescriptorSets(std::vector<VkDescriptorSet>& descriptorSets) const
 	{
-		vkFreeDescriptorSets(m_device.GetDevice(), m_descriptorPool, static_cast<U32>(descriptorSets.size()), descriptorSets.data());
+		// Sets are freed once the frames that may have bound them are done.
+		m_device.DeferDestruction([device = m_device.GetDevice(), descriptorPool = m_descriptorPool, descriptorSets]() {
+			vkFreeDescriptorSets(device, descriptorPool, static_cast<U32>(descriptorSets.size()), descriptorSets.data());
+		});
 	}
 
 	void LveDescriptorPool::ResetPool()
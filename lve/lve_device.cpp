@@ -3,9 +3,14 @@
 //
 
 #include "lve_device.h"
+#include "lve_upload_manager.h"
+#include "lve_geometry_pool.h"
 
 #include <unordered_set>
 #include <set>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
 
 namespace lve
 {
@@ -57,6 +62,20 @@ namespace lve
 		}
 	}
 
+	// Written in front of the pipeline cache data. Vulkan's own header identifies the device but not the driver
+	// version, and some drivers do not reject data from older versions, so we check both.
+	struct PipelineCacheFileHeader
+	{
+		static constexpr U32 MAGIC = 0x4C564350; // "LVCP"
+
+		U32 magic;
+		U32 vendorId;
+		U32 deviceId;
+		U32 driverVersion;
+		U8 pipelineCacheUuid[VK_UUID_SIZE];
+		U64 dataSize;
+	};
+
 	/////////////////////////////////////////////////////////////////////////////////
 	// Class member functions
 	/////////////////////////////////////////////////////////////////////////////////
@@ -70,10 +89,32 @@ namespace lve
 		PickPhysicalDevice();
 		CreateLogicalDevice();
 		CreateCommandPool();
+		CreateMemoryAllocator();
+		CreateUploadManager();
+		CreateGeometryPool();
+		CreatePipelineCache();
 	}
 
 	LveDevice::~LveDevice()
 	{
+		// Nothing is in flight anymore, so all deferred deletions can run. Some of them return ranges to the
+		// geometry pool, so run them while it is still alive.
+		vkDeviceWaitIdle(m_device);
+		m_deletionQueue.Flush();
+
+		// The upload manager waits for pending uploads and releases its staging buffer.
+		m_uploadManager.reset();
+
+		// Buffers of the geometry pool can be released once no upload writes to them anymore.
+		m_geometryPool.reset();
+		m_deletionQueue.Flush();
+
+		// All resources must have released their memory by now.
+		m_memoryAllocator.reset();
+
+		SavePipelineCache();
+		vkDestroyPipelineCache(m_device, m_pipelineCache, nullptr);
+
 		vkDestroyCommandPool(m_device, m_commandPool, nullptr);
 		vkDestroyDevice(m_device, nullptr);
 
@@ -91,6 +132,13 @@ namespace lve
 	/////////////////////////////////////////////////////////////////////////////////
 
 	U32 LveDevice::FindMemoryType(U32 typeFilter, VkMemoryPropertyFlags propertyFlags)
+	{
+		std::optional<U32> memoryTypeIndex = TryFindMemoryType(typeFilter, propertyFlags);
+		ASSERT(memoryTypeIndex.has_value(), "Failed to find suitable memory type!");
+		return memoryTypeIndex.value_or(-1);
+	}
+
+	std::optional<U32> LveDevice::TryFindMemoryType(U32 typeFilter, VkMemoryPropertyFlags propertyFlags)
 	{
 		// If typeFilter is 0000 1100, the function will return an index of 2.
 		// Memory heaps are distinct memory resources like dedicated VRAM and swap space in RAM for when VRAM runs out.
@@ -116,8 +164,7 @@ namespace lve
 			}
 		}
 
-		ASSERT(false, "Failed to find suitable memory type!");
-		return -1;
+		return std::nullopt;
 	}
 
 	VkFormat LveDevice::FindSupportedFormat(const std::vector<VkFormat>& formatCandidates, VkImageTiling tiling,
@@ -147,7 +194,7 @@ namespace lve
 	/////////////////////////////////////////////////////////////////////////////////
 
 	void LveDevice::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags propertyFlags,
-		VkBuffer& buffer, VkDeviceMemory& bufferMemory)
+		VkBuffer& buffer, LveAllocation& bufferAllocation)
 	{
 		// Buffer creation
 		VkBufferCreateInfo bufferInfo{};
@@ -163,17 +210,13 @@ namespace lve
 		VkMemoryRequirements memoryRequirements;
 		vkGetBufferMemoryRequirements(m_device, buffer, &memoryRequirements);
 
-		VkMemoryAllocateInfo allocateInfo{};
-		allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocateInfo.allocationSize = memoryRequirements.size;
-		// To be able to write to it from CPU.
-		allocateInfo.memoryTypeIndex = FindMemoryType(memoryRequirements.memoryTypeBits, propertyFlags);
-
-		VkResult allocateResult = vkAllocateMemory(m_device, &allocateInfo, nullptr, &bufferMemory);
-		ASSERT_EQ(allocateResult, VK_SUCCESS, "Failed to allocate vertex buffer memory!");
+		// Sub-allocate from a large memory block instead of allocating device memory per buffer.
+		U32 memoryTypeIndex = FindMemoryType(memoryRequirements.memoryTypeBits, propertyFlags);
+		bufferAllocation = m_memoryAllocator->Allocate(memoryRequirements, memoryTypeIndex, true);
 
 		// Bind buffer and allocation.
-		vkBindBufferMemory(m_device, buffer, bufferMemory, 0);
+		VkResult bindMemoryResult = vkBindBufferMemory(m_device, buffer, bufferAllocation.memory, bufferAllocation.offset);
+		ASSERT_EQ(bindMemoryResult, VK_SUCCESS, "Failed to bind buffer memory!");
 	}
 
 	void LveDevice::CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
@@ -211,6 +254,104 @@ namespace lve
 		EndSingleTimeCommands(commandBuffer);
 	}
 
+	void LveDevice::SavePipelineCache()
+	{
+		size_t dataSize = 0;
+		VkResult result = vkGetPipelineCacheData(m_device, m_pipelineCache, &dataSize, nullptr);
+		ASSERT_EQ(result, VK_SUCCESS, "Failed to get pipeline cache size!");
+
+		std::vector<char> data(dataSize);
+		result = vkGetPipelineCacheData(m_device, m_pipelineCache, &dataSize, data.data());
+		ASSERT_EQ(result, VK_SUCCESS, "Failed to get pipeline cache data!");
+
+		PipelineCacheFileHeader header{};
+		header.magic = PipelineCacheFileHeader::MAGIC;
+		header.vendorId = properties.vendorID;
+		header.deviceId = properties.deviceID;
+		header.driverVersion = properties.driverVersion;
+		std::memcpy(header.pipelineCacheUuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+		header.dataSize = dataSize;
+
+		// Write to a temporary file first, so an interrupted write never leaves a truncated cache behind.
+		std::string tempFilepath = std::string(PIPELINE_CACHE_FILEPATH) + ".tmp";
+		{
+			std::ofstream file(tempFilepath, std::ios::binary | std::ios::trunc);
+			if (!file.is_open())
+			{
+				PRINT("Failed to open pipeline cache file for writing: %s", tempFilepath.c_str());
+				return;
+			}
+
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			file.write(data.data(), static_cast<std::streamsize>(dataSize));
+
+			if (!file.good())
+			{
+				PRINT("Failed to write pipeline cache file: %s", tempFilepath.c_str());
+				return;
+			}
+		}
+
+		// On POSIX, rename replaces an existing file atomically. Only platforms where it fails because the target exists
+		// (e.g. Windows) remove the old file first, which leaves a short window without a cache file.
+		if (std::rename(tempFilepath.c_str(), PIPELINE_CACHE_FILEPATH) != 0)
+		{
+			std::remove(PIPELINE_CACHE_FILEPATH);
+			if (std::rename(tempFilepath.c_str(), PIPELINE_CACHE_FILEPATH) != 0)
+			{
+				PRINT("Failed to replace pipeline cache file: %s", PIPELINE_CACHE_FILEPATH);
+				std::remove(tempFilepath.c_str());
+				return;
+			}
+		}
+
+		PRINT("Saved pipeline cache (%zu bytes)", dataSize);
+	}
+
+	void LveDevice::GetPastPresentationTimings(VkSwapchainKHR swapchain, std::vector<VkPastPresentationTimingGOOGLE>& timings)
+	{
+		ASSERT(IsDisplayTimingEnabled(), "VK_GOOGLE_display_timing is not enabled!");
+
+		U32 timingCount = 0;
+		VkResult result = m_vkGetPastPresentationTimingGOOGLE(m_device, swapchain, &timingCount, nullptr);
+		if (result != VK_SUCCESS || timingCount == 0)
+		{
+			return;
+		}
+
+		USize offset = timings.size();
+		timings.resize(offset + timingCount);
+
+		// VK_INCOMPLETE only means that more timings arrived in between. They are returned by the next call.
+		m_vkGetPastPresentationTimingGOOGLE(m_device, swapchain, &timingCount, timings.data() + offset);
+		timings.resize(offset + timingCount);
+	}
+
+	void LveDevice::DeferDestruction(LveDeletionQueue::Deleter destroy)
+	{
+		m_deletionQueue.Push(m_currentFrameNumber.load(std::memory_order_relaxed), std::move(destroy));
+	}
+
+	void LveDevice::DestroyBuffer(VkBuffer buffer, LveAllocation& allocation)
+	{
+		DeferDestruction([this, buffer, allocation]() mutable {
+			vkDestroyBuffer(m_device, buffer, nullptr);
+			FreeAllocation(allocation);
+		});
+
+		allocation = {};
+	}
+
+	void LveDevice::DestroyImage(VkImage image, LveAllocation& allocation)
+	{
+		DeferDestruction([this, image, allocation]() mutable {
+			vkDestroyImage(m_device, image, nullptr);
+			FreeAllocation(allocation);
+		});
+
+		allocation = {};
+	}
+
 	VkCommandBuffer LveDevice::BeginSingleTimeCommands()
 	{
 		VkCommandBufferAllocateInfo allocateInfo{};
@@ -240,9 +381,21 @@ namespace lve
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &commandBuffer;
 
-		vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-		vkQueueWaitIdle(m_graphicsQueue);
+		// Only wait for this submission instead of draining the whole queue.
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+		VkFence fence;
+		VkResult fenceResult = vkCreateFence(m_device, &fenceInfo, nullptr, &fence);
+		ASSERT_EQ(fenceResult, VK_SUCCESS, "Failed to create fence!");
+
+		{
+			std::lock_guard<std::mutex> lock(m_queueMutex);
+			vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, fence);
+		}
+		vkWaitForFences(m_device, 1, &fence, VK_TRUE, UINT64_MAX);
 
+		vkDestroyFence(m_device, fence, nullptr);
 		vkFreeCommandBuffers(m_device, m_commandPool, 1, &commandBuffer);
 	}
 
@@ -251,7 +404,7 @@ namespace lve
 	/////////////////////////////////////////////////////////////////////////////////
 
 	void LveDevice::CreateImageWithInfo(const VkImageCreateInfo& imageInfo, VkMemoryPropertyFlags propertyFlags,
-		VkImage& image, VkDeviceMemory& imageMemory)
+		VkImage& image, LveAllocation& imageAllocation, VkMemoryPropertyFlags preferredPropertyFlags)
 	{
 		VkResult result = vkCreateImage(m_device, &imageInfo, nullptr, &image);
 		ASSERT_EQ(result, VK_SUCCESS, "Failed to create image!");
@@ -260,15 +413,16 @@ namespace lve
 		VkMemoryRequirements memoryRequirements;
 		vkGetImageMemoryRequirements(m_device, image, &memoryRequirements);
 
-		VkMemoryAllocateInfo allocateInfo{};
-		allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocateInfo.allocationSize = memoryRequirements.size;
-		allocateInfo.memoryTypeIndex = FindMemoryType(memoryRequirements.memoryTypeBits, propertyFlags);
+		std::optional<U32> memoryTypeIndex = TryFindMemoryType(memoryRequirements.memoryTypeBits, propertyFlags | preferredPropertyFlags);
+		if (!memoryTypeIndex.has_value())
+		{
+			memoryTypeIndex = FindMemoryType(memoryRequirements.memoryTypeBits, propertyFlags);
+		}
 
-		VkResult allocateResult = vkAllocateMemory(m_device, &allocateInfo, nullptr, &imageMemory);
-		ASSERT_EQ(allocateResult, VK_SUCCESS, "Failed to allocate image memory!");
+		bool linear = imageInfo.tiling == VK_IMAGE_TILING_LINEAR;
+		imageAllocation = m_memoryAllocator->Allocate(memoryRequirements, memoryTypeIndex.value(), linear);
 
-		VkResult bindMemoryResult = vkBindImageMemory(m_device, image, imageMemory, 0);
+		VkResult bindMemoryResult = vkBindImageMemory(m_device, image, imageAllocation.memory, imageAllocation.offset);
 		ASSERT_EQ(bindMemoryResult, VK_SUCCESS, "Failed to bind image memory!");
 	}
 
@@ -393,8 +547,15 @@ namespace lve
 		}
 
 		// Device features
+		// Indirect draw features are optional. Users check GetEnabledFeatures and fall back when missing.
+		VkPhysicalDeviceFeatures supportedFeatures{};
+		vkGetPhysicalDeviceFeatures(m_physicalDevice, &supportedFeatures);
+
 		VkPhysicalDeviceFeatures deviceFeatures{};
 		deviceFeatures.samplerAnisotropy = VK_TRUE;
+		deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+		deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+		m_enabledFeatures = deviceFeatures;
 
 		VkDeviceCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -402,8 +563,16 @@ namespace lve
 		createInfo.pQueueCreateInfos = queueCreateInfos.data();
 		createInfo.pEnabledFeatures = &deviceFeatures;
 
-		createInfo.enabledExtensionCount = static_cast<U32>(m_deviceExtensions.size());
-		createInfo.ppEnabledExtensionNames = m_deviceExtensions.data(); // e.g. swap chain
+		// Optional extensions are enabled when the device has them.
+		std::vector<const char*> enabledExtensions = m_deviceExtensions;
+		bool isDisplayTimingAvailable = IsDeviceExtensionAvailable(m_physicalDevice, VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME);
+		if (isDisplayTimingAvailable)
+		{
+			enabledExtensions.push_back(VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME);
+		}
+
+		createInfo.enabledExtensionCount = static_cast<U32>(enabledExtensions.size());
+		createInfo.ppEnabledExtensionNames = enabledExtensions.data(); // e.g. swap chain
 
 		// Might not really be necessary anymore because device specific validation layers
 		// have been deprecated.
@@ -423,6 +592,12 @@ namespace lve
 		// Fetch queue handle.
 		vkGetDeviceQueue(m_device, queueFamilyData.graphicsFamily.value(), 0, &m_graphicsQueue);
 		vkGetDeviceQueue(m_device, queueFamilyData.presentFamily.value(), 0, &m_presentQueue);
+
+		if (isDisplayTimingAvailable)
+		{
+			m_vkGetPastPresentationTimingGOOGLE =
+				(PFN_vkGetPastPresentationTimingGOOGLE)vkGetDeviceProcAddr(m_device, "vkGetPastPresentationTimingGOOGLE");
+		}
 	}
 
 	void LveDevice::CreateCommandPool()
@@ -441,10 +616,102 @@ namespace lve
 		ASSERT_EQ(result, VK_SUCCESS, "Failed to create command pool!");
 	}
 
+	void LveDevice::CreateMemoryAllocator()
+	{
+		m_memoryAllocator = MakeUniqueRef<LveMemoryAllocator>(m_physicalDevice, m_device);
+	}
+
+	void LveDevice::CreateUploadManager()
+	{
+		m_uploadManager = MakeUniqueRef<LveUploadManager>(*this);
+	}
+
+	void LveDevice::CreateGeometryPool()
+	{
+		m_geometryPool = MakeUniqueRef<LveGeometryPool>(*this);
+	}
+
+	void LveDevice::CreatePipelineCache()
+	{
+		std::vector<char> data = LoadPipelineCacheData();
+
+		VkPipelineCacheCreateInfo cacheInfo{};
+		cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		cacheInfo.initialDataSize = data.size();
+		cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+		VkResult result = vkCreatePipelineCache(m_device, &cacheInfo, nullptr, &m_pipelineCache);
+
+		if (result != VK_SUCCESS && !data.empty())
+		{
+			// The driver may still refuse the data. Start over with an empty cache.
+			PRINT("Pipeline cache data was rejected by the driver");
+			cacheInfo.initialDataSize = 0;
+			cacheInfo.pInitialData = nullptr;
+			result = vkCreatePipelineCache(m_device, &cacheInfo, nullptr, &m_pipelineCache);
+		}
+
+		ASSERT_EQ(result, VK_SUCCESS, "Failed to create pipeline cache!");
+	}
+
 	/////////////////////////////////////////////////////////////////////////////////
 	// Private helper functions
 	/////////////////////////////////////////////////////////////////////////////////
 
+	std::vector<char> LveDevice::LoadPipelineCacheData()
+	{
+		std::ifstream file(PIPELINE_CACHE_FILEPATH, std::ios::ate | std::ios::binary);
+
+		if (!file.is_open())
+		{
+			return {};
+		}
+
+		USize fileSize = static_cast<USize>(file.tellg());
+		file.seekg(0);
+
+		PipelineCacheFileHeader header{};
+		if (fileSize < sizeof(header) || !file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+			header.magic != PipelineCacheFileHeader::MAGIC || header.dataSize != fileSize - sizeof(header))
+		{
+			PRINT("Ignoring pipeline cache file with a bad header");
+			return {};
+		}
+
+		if (header.vendorId != properties.vendorID || header.deviceId != properties.deviceID ||
+			header.driverVersion != properties.driverVersion ||
+			std::memcmp(header.pipelineCacheUuid, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+		{
+			PRINT("Ignoring pipeline cache file of another device or driver version");
+			return {};
+		}
+
+		std::vector<char> data(header.dataSize);
+		if (!file.read(data.data(), static_cast<std::streamsize>(data.size())))
+		{
+			return {};
+		}
+
+		// The data starts with Vulkan's own header, which must match the device too.
+		VkPipelineCacheHeaderVersionOne cacheHeader{};
+		if (data.size() < sizeof(cacheHeader))
+		{
+			return {};
+		}
+
+		std::memcpy(&cacheHeader, data.data(), sizeof(cacheHeader));
+		if (cacheHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE || cacheHeader.vendorID != properties.vendorID ||
+			cacheHeader.deviceID != properties.deviceID ||
+			std::memcmp(cacheHeader.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+		{
+			PRINT("Ignoring pipeline cache data of another device");
+			return {};
+		}
+
+		PRINT("Loaded pipeline cache (%zu bytes)", data.size());
+		return data;
+	}
+
 	bool LveDevice::IsDeviceSuitable(VkPhysicalDevice physicalDevice)
 	{
 		QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(physicalDevice);
@@ -615,6 +882,25 @@ namespace lve
 		return requiredExtensions.empty();
 	}
 
+	bool LveDevice::IsDeviceExtensionAvailable(VkPhysicalDevice physicalDevice, const char* extensionName)
+	{
+		U32 extensionCount = 0;
+		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+
+		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+		for (const auto& extension : availableExtensions)
+		{
+			if (std::strcmp(extension.extensionName, extensionName) == 0)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
 	SwapchainSupportDetails LveDevice::QuerySwapchainSupport(VkPhysicalDevice physicalDevice)
 	{
 		SwapchainSupportDetails details{};
@@ -5,12 +5,19 @@
 #pragma once
 
 #include "lve_window.h"
+#include "lve_memory_allocator.h"
+#include "lve_deletion_queue.h"
 
 #include <vector>
+#include <atomic>
+#include <mutex>
 #include <optional>
 
 namespace lve
 {
+	class LveUploadManager;
+	class LveGeometryPool;
+
 	struct SwapchainSupportDetails
 	{
 		VkSurfaceCapabilitiesKHR capabilities;
@@ -46,17 +53,37 @@ namespace lve
 		VkSurfaceKHR GetSurface() { return m_surface; }
 		VkQueue GetGraphicsQueue() { return m_graphicsQueue; }
 		VkQueue GetPresentQueue() { return m_presentQueue; }
+		// Vulkan requires access to a queue to be externally synchronized, and the graphics and present queues may be
+		// the same queue. Lock it around every vkQueueSubmit and vkQueuePresentKHR.
+		std::mutex& GetQueueMutex() { return m_queueMutex; }
+		LveMemoryAllocator& GetMemoryAllocator() { return *m_memoryAllocator; }
+		LveUploadManager& GetUploadManager() { return *m_uploadManager; }
+		LveGeometryPool& GetGeometryPool() { return *m_geometryPool; }
+		const VkPhysicalDeviceFeatures& GetEnabledFeatures() const { return m_enabledFeatures; }
+		// Shared by all pipelines. Loaded from PIPELINE_CACHE_FILEPATH and written back when the device is destroyed.
+		VkPipelineCache GetPipelineCache() { return m_pipelineCache; }
+
+		// Write the pipeline cache to disk now, e.g. after the pipelines of a level are built.
+		void SavePipelineCache();
+
+		// VK_GOOGLE_display_timing is enabled if the device supports it. It reports when presented images were displayed.
+		bool IsDisplayTimingEnabled() const { return m_vkGetPastPresentationTimingGOOGLE != nullptr; }
+		// Appends the timings of presents on the swapchain that completed since the last call. Needs display timing.
+		void GetPastPresentationTimings(VkSwapchainKHR swapchain, std::vector<VkPastPresentationTimingGOOGLE>& timings);
 
 		// Public helper functions
 		SwapchainSupportDetails GetSwapchainSupport() { return QuerySwapchainSupport(m_physicalDevice); };
 		QueueFamilyIndices FindPhysicalQueueFamilies() { return FindQueueFamilies(m_physicalDevice); }
 
 		U32 FindMemoryType(U32 typeFilter, VkMemoryPropertyFlags propertyFlags);
+		std::optional<U32> TryFindMemoryType(U32 typeFilter, VkMemoryPropertyFlags propertyFlags);
 		VkFormat FindSupportedFormat(const std::vector<VkFormat>& formatCandidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 
 		// Buffer helper functions
+		// Memory is sub-allocated from the device's memory allocator. Free it with FreeAllocation after destroying the buffer.
 		void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags propertyFlags, VkBuffer& buffer,
-			VkDeviceMemory& bufferMemory);
+			LveAllocation& bufferAllocation);
+		// Blocking copy. Prefer the upload manager for uploading data, which does not wait for the copy to finish.
 		void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
 		void CopyBufferToImage(VkBuffer buffer, VkImage image, U32 width, U32 height, U32 layerCount);
 
@@ -64,8 +91,26 @@ namespace lve
 		void EndSingleTimeCommands(VkCommandBuffer commandBuffer);
 
 		// Image helper functions
+		// preferredPropertyFlags are added to propertyFlags if the device has such a memory type for the image,
+		// e.g. VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT for transient attachments.
 		void CreateImageWithInfo(const VkImageCreateInfo& imageInfo, VkMemoryPropertyFlags propertyFlags, VkImage& image,
-			VkDeviceMemory& imageMemory);
+			LveAllocation& imageAllocation, VkMemoryPropertyFlags preferredPropertyFlags = 0);
+
+		// Memory helper functions
+		void FreeAllocation(LveAllocation& allocation) { m_memoryAllocator->Free(allocation); }
+
+		// Deferred destruction
+		// Runs destroy once the GPU has finished the frame being recorded and all earlier ones. Use it for anything
+		// that command buffers may still reference, so it can be replaced without waiting for the device to be idle.
+		void DeferDestruction(LveDeletionQueue::Deleter destroy);
+		// Destroy the buffer or image and free its memory once the GPU is done with it.
+		void DestroyBuffer(VkBuffer buffer, LveAllocation& allocation);
+		void DestroyImage(VkImage image, LveAllocation& allocation);
+
+		// Called by the renderer. Resources queued for deletion from now on are tagged with this frame.
+		void SetCurrentFrameNumber(U64 frameNumber) { m_currentFrameNumber.store(frameNumber, std::memory_order_relaxed); }
+		// Destroy resources queued in frames before completedFrameCount, whose fences have signaled.
+		void CollectDeletions(U64 completedFrameCount) { m_deletionQueue.Collect(completedFrameCount); }
 
 	private:
 		// Functions to create Vulkan resources
@@ -75,6 +120,10 @@ namespace lve
 		void PickPhysicalDevice();
 		void CreateLogicalDevice();
 		void CreateCommandPool();
+		void CreateMemoryAllocator();
+		void CreateUploadManager();
+		void CreateGeometryPool();
+		void CreatePipelineCache();
 
 		// Private help functions
 		bool IsDeviceSuitable(VkPhysicalDevice physicalDevice);
@@ -84,7 +133,10 @@ namespace lve
 		void PopulateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo);
 		void HasGlfwRequiredInstanceExtensions();
 		bool CheckDeviceExtensionSupport(VkPhysicalDevice physicalDevice);
+		bool IsDeviceExtensionAvailable(VkPhysicalDevice physicalDevice, const char* extensionName);
 		SwapchainSupportDetails QuerySwapchainSupport(VkPhysicalDevice physicalDevice);
+		// Returns the cache data of the file, or nothing if it is missing or was written by another device or driver.
+		std::vector<char> LoadPipelineCacheData();
 
 	public:
 		VkPhysicalDeviceProperties properties;
@@ -100,6 +152,17 @@ namespace lve
 		VkSurfaceKHR m_surface;
 		VkQueue m_graphicsQueue;
 		VkQueue m_presentQueue;
+		std::mutex m_queueMutex;
+		VkPhysicalDeviceFeatures m_enabledFeatures{};
+		VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
+		PFN_vkGetPastPresentationTimingGOOGLE m_vkGetPastPresentationTimingGOOGLE = nullptr;
+
+		UniqueRef<LveMemoryAllocator> m_memoryAllocator;
+		UniqueRef<LveUploadManager> m_uploadManager;
+		UniqueRef<LveGeometryPool> m_geometryPool;
+
+		LveDeletionQueue m_deletionQueue;
+		std::atomic<U64> m_currentFrameNumber{ 0 };
 
 #ifdef NDBUG
 		const bool m_enableValidationLayers = false;
@@ -107,6 +170,8 @@ namespace lve
 		const bool m_enableValidationLayers = true;
 #endif
 
+		static constexpr const char* PIPELINE_CACHE_FILEPATH = "pipeline_cache.bin";
+
 		const std::vector<const char*> m_validationLayers{ "VK_LAYER_KHRONOS_validation" };
 		const std::vector<const char*> m_deviceExtensions{ VK_KHR_SWAPCHAIN_EXTENSION_NAME, "VK_KHR_portability_subset" };
 	};
@@ -0,0 +1,53 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/20/24.
+//
+
+#include "lve_frame_allocator.h"
+
+#include <algorithm>
+
+namespace lve
+{
+	LveFrameAllocator::LveFrameAllocator(LveDevice& device, VkDeviceSize frameCapacity, U32 frameCount, VkBufferUsageFlags usageFlags)
+		: m_alignment(std::max<VkDeviceSize>(device.properties.limits.minUniformBufferOffsetAlignment, 1))
+	{
+		m_frameCapacity = (frameCapacity + m_alignment - 1) / m_alignment * m_alignment;
+
+		// Coherent memory, so writes need no flush.
+		m_buffer = MakeUniqueRef<LveBuffer>(
+			device,
+			m_frameCapacity,
+			frameCount,
+			usageFlags,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			m_alignment);
+
+		m_buffer->Map();
+		m_mappedData = static_cast<char*>(m_buffer->GetMappedMemory());
+
+		ASSERT(m_buffer->GetBufferSize() <= UINT32_MAX, "Frame allocator is too large for dynamic offsets!");
+	}
+
+	void LveFrameAllocator::BeginFrame(U32 frameIndex)
+	{
+		ASSERT(frameIndex < m_buffer->GetInstanceCount(), "Frame index out of range!");
+
+		m_frameOffset = m_buffer->GetAlignmentSize() * frameIndex;
+		m_usedSize.store(0, std::memory_order_relaxed);
+	}
+
+	LveFrameAllocator::Allocation LveFrameAllocator::Allocate(VkDeviceSize size)
+	{
+		VkDeviceSize alignedSize = (size + m_alignment - 1) / m_alignment * m_alignment;
+		VkDeviceSize offset = m_usedSize.fetch_add(alignedSize, std::memory_order_relaxed);
+
+		ASSERT(offset + alignedSize <= m_frameCapacity, "Frame allocator is out of memory!");
+
+		Allocation allocation{};
+		allocation.data = m_mappedData + m_frameOffset + offset;
+		allocation.offset = static_cast<U32>(m_frameOffset + offset);
+		allocation.size = size;
+		return allocation;
+	}
+
+} // namespace lve
@@ -0,0 +1,69 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/20/24.
+//
+
+#pragma once
+
+#include "lve_device.h"
+#include "lve_buffer.h"
+
+#include <atomic>
+#include <cstring>
+
+namespace lve
+{
+	// Linear allocator for data that is written every frame, e.g. uniforms of passes and objects.
+	//
+	// One persistently mapped buffer is split into a region per frame in flight. Allocating bumps an offset in the
+	// region of the current frame, and BeginFrame rewinds it once the GPU is done with that frame. The data is read
+	// through a VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC descriptor with the allocation offset as dynamic offset,
+	// so a single descriptor set covers all frames and allocations.
+	class LveFrameAllocator
+	{
+	public:
+		struct Allocation
+		{
+			void* data = nullptr;
+			// Offset in the buffer. Pass it as dynamic offset when binding the descriptor set.
+			U32 offset = 0;
+			VkDeviceSize size = 0;
+		};
+
+		// frameCapacity is the number of bytes that can be allocated per frame. frameCount is the number of frames in flight.
+		LveFrameAllocator(LveDevice& device, VkDeviceSize frameCapacity, U32 frameCount,
+			VkBufferUsageFlags usageFlags = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+
+		LveFrameAllocator(const LveFrameAllocator&) = delete;
+		LveFrameAllocator& operator=(const LveFrameAllocator&) = delete;
+
+		// Rewind the region of the frame. Call after its fence was waited on.
+		void BeginFrame(U32 frameIndex);
+
+		// Safe to call from several threads. Offsets are aligned to minUniformBufferOffsetAlignment.
+		Allocation Allocate(VkDeviceSize size);
+
+		template <typename T>
+		Allocation Push(const T& value)
+		{
+			Allocation allocation = Allocate(sizeof(T));
+			std::memcpy(allocation.data, &value, sizeof(T));
+			return allocation;
+		}
+
+		// Descriptor info for a dynamic descriptor. range is the number of bytes the shader reads at each offset.
+		VkDescriptorBufferInfo DescriptorInfo(VkDeviceSize range) { return m_buffer->DescriptorInfo(range, 0); }
+
+		VkDeviceSize GetFrameCapacity() const { return m_frameCapacity; }
+		VkDeviceSize GetUsedSize() const { return m_usedSize.load(std::memory_order_relaxed); }
+
+	private:
+		UniqueRef<LveBuffer> m_buffer;
+		char* m_mappedData = nullptr;
+		VkDeviceSize m_alignment;
+		VkDeviceSize m_frameCapacity;
+
+		VkDeviceSize m_frameOffset = 0;
+		std::atomic<VkDeviceSize> m_usedSize{ 0 };
+	};
+
+} // namespace lve
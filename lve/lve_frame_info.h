@@ -5,7 +5,9 @@
 #pragma once
 
 #include "lve_camera.h"
-#include "lve_game_object.h"
+#include "lve_registry.h"
+#include "lve_renderer.h"
+#include "lve_frame_allocator.h"
 
 #include <vulkan/vulkan.h>
 
@@ -16,9 +18,13 @@ namespace lve
 		U32 frameIndex;
 		F32 frameTime;
 		VkCommandBuffer commandBuffer;
+		// Its uniform buffer is dynamic. Bind it with globalUboOffset as dynamic offset.
 		VkDescriptorSet globalDescriptorSet;
+		U32 globalUboOffset;
 		LveCamera& camera;
-		LveGameObject::Map& gameObjects;
+		LveRegistry& registry;
+		LveRenderer& renderer;
+		LveFrameAllocator& frameAllocator;
 	};
 
 } // namespace lve
@@ -0,0 +1,144 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/14/24.
+//
+
+#include "lve_geometry_pool.h"
+
+#include "lve_device.h"
+
+namespace lve
+{
+	LveGeometryPool::LveGeometryPool(LveDevice& device, VkDeviceSize vertexPageSize, VkDeviceSize indexPageSize)
+		: m_device(device), m_vertexPageSize(vertexPageSize), m_indexPageSize(indexPageSize)
+	{
+	}
+
+	LveGeometryRange LveGeometryPool::AllocateVertices(U32 vertexSize, U32 vertexCount)
+	{
+		return Allocate(vertexSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, m_vertexPageSize, vertexCount);
+	}
+
+	LveGeometryRange LveGeometryPool::AllocateIndices(U32 indexSize, U32 indexCount)
+	{
+		return Allocate(indexSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, m_indexPageSize, indexCount);
+	}
+
+	LveGeometryRange LveGeometryPool::Allocate(U32 elementSize, VkBufferUsageFlags usageFlags, VkDeviceSize pageSize, U32 count)
+	{
+		ASSERT(count > 0, "Failed to allocate geometry. Count must be greater than 0!");
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		U32 arenaIndex = 0;
+		while (arenaIndex < m_arenas.size() &&
+			   (m_arenas[arenaIndex].elementSize != elementSize || m_arenas[arenaIndex].usageFlags != usageFlags))
+		{
+			++arenaIndex;
+		}
+
+		if (arenaIndex == m_arenas.size())
+		{
+			m_arenas.push_back({ elementSize, usageFlags, pageSize, {} });
+		}
+
+		Arena& arena = m_arenas[arenaIndex];
+
+		// First fit over all pages. Add a page if none has a block that is large enough.
+		for (U32 pageIndex = 0; pageIndex <= arena.pages.size(); ++pageIndex)
+		{
+			if (pageIndex == arena.pages.size())
+			{
+				AddPage(arena, count);
+			}
+
+			Page& page = arena.pages[pageIndex];
+
+			for (auto it = page.freeBlocks.begin(); it != page.freeBlocks.end(); ++it)
+			{
+				if (it->second < count)
+				{
+					continue;
+				}
+
+				U32 offset = it->first;
+				U32 remaining = it->second - count;
+				page.freeBlocks.erase(it);
+
+				if (remaining > 0)
+				{
+					page.freeBlocks[offset + count] = remaining;
+				}
+
+				LveGeometryRange range{};
+				range.buffer = page.buffer->GetBuffer();
+				range.offset = offset;
+				range.count = count;
+				range.arenaIndex = arenaIndex;
+				range.pageIndex = pageIndex;
+				return range;
+			}
+		}
+
+		ASSERT(false, "Failed to allocate geometry!");
+		return {};
+	}
+
+	void LveGeometryPool::Free(LveGeometryRange& range)
+	{
+		if (!range.IsValid())
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		std::map<U32, U32>& freeBlocks = m_arenas[range.arenaIndex].pages[range.pageIndex].freeBlocks;
+
+		U32 offset = range.offset;
+		U32 count = range.count;
+
+		// Merge with the next block.
+		auto next = freeBlocks.find(offset + count);
+		if (next != freeBlocks.end())
+		{
+			count += next->second;
+			freeBlocks.erase(next);
+		}
+
+		// Merge with the previous block.
+		auto it = freeBlocks.lower_bound(offset);
+		if (it != freeBlocks.begin())
+		{
+			auto previous = std::prev(it);
+			if (previous->first + previous->second == offset)
+			{
+				offset = previous->first;
+				count += previous->second;
+				freeBlocks.erase(previous);
+			}
+		}
+
+		freeBlocks[offset] = count;
+		range = {};
+	}
+
+	void LveGeometryPool::AddPage(Arena& arena, U32 minCapacity)
+	{
+		// Meshes larger than a page get a page of their own.
+		U32 capacity = static_cast<U32>(arena.pageSize / arena.elementSize);
+		capacity = MathOp::Max(capacity, minCapacity);
+
+		Page page{};
+		page.buffer = MakeUniqueRef<LveBuffer>(
+			m_device,
+			arena.elementSize,
+			capacity,
+			arena.usageFlags | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		page.capacity = capacity;
+		page.freeBlocks[0] = capacity;
+
+		arena.pages.push_back(std::move(page));
+	}
+
+} // namespace lve
@@ -0,0 +1,84 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/14/24.
+//
+
+#pragma once
+
+#include "core/core.h"
+
+#include "lve_buffer.h"
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace lve
+{
+	class LveDevice;
+
+	// A range of elements (vertices or indices) sub-allocated from one of the pool's buffers.
+	struct LveGeometryRange
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		// In elements, e.g. vertexOffset or firstIndex of a draw call.
+		U32 offset = 0;
+		U32 count = 0;
+
+		// Internal
+		U32 arenaIndex = 0;
+		U32 pageIndex = 0;
+
+		bool IsValid() const { return buffer != VK_NULL_HANDLE; }
+	};
+
+	// Sub-allocates the vertices and indices of all models from a few large device local buffers, so models drawn
+	// one after another do not need to rebind their buffers.
+	//
+	// There is one arena per element size and usage (e.g. standard vertices, compact vertices, 16-bit indices),
+	// because draws address vertices and indices in elements rather than bytes. Each arena is a list of buffers
+	// (pages) with a first-fit free list. A new page is added when no page has room.
+	class LveGeometryPool
+	{
+	public:
+		LveGeometryPool(LveDevice& device, VkDeviceSize vertexPageSize = 64ull * 1024 * 1024,
+			VkDeviceSize indexPageSize = 16ull * 1024 * 1024);
+		~LveGeometryPool() = default;
+
+		LveGeometryPool(const LveGeometryPool&) = delete;
+		LveGeometryPool& operator=(const LveGeometryPool&) = delete;
+
+		LveGeometryRange AllocateVertices(U32 vertexSize, U32 vertexCount);
+		LveGeometryRange AllocateIndices(U32 indexSize, U32 indexCount);
+		// The caller makes sure the GPU is done with the range.
+		void Free(LveGeometryRange& range);
+
+	private:
+		struct Page
+		{
+			UniqueRef<LveBuffer> buffer;
+			U32 capacity;
+			// Free blocks as [offset: count], in elements. Adjacent blocks are merged on free.
+			std::map<U32, U32> freeBlocks;
+		};
+
+		struct Arena
+		{
+			U32 elementSize;
+			VkBufferUsageFlags usageFlags;
+			VkDeviceSize pageSize;
+			std::vector<Page> pages;
+		};
+
+		LveGeometryRange Allocate(U32 elementSize, VkBufferUsageFlags usageFlags, VkDeviceSize pageSize, U32 count);
+		void AddPage(Arena& arena, U32 minCapacity);
+
+	private:
+		LveDevice& m_device;
+		VkDeviceSize m_vertexPageSize;
+		VkDeviceSize m_indexPageSize;
+
+		std::vector<Arena> m_arenas;
+		std::mutex m_mutex;
+	};
+
+} // namespace lve
@@ -0,0 +1,305 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/2/24.
+//
+
+#include "lve_memory_allocator.h"
+
+#include <algorithm>
+
+namespace lve
+{
+	static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+	static constexpr VkDeviceSize MIN_ALLOCATION_SIZE = 256;
+
+	static VkDeviceSize NextPowerOfTwo(VkDeviceSize value)
+	{
+		VkDeviceSize result = 1;
+		while (result < value)
+		{
+			result <<= 1;
+		}
+		return result;
+	}
+
+	static VkDeviceSize PreviousPowerOfTwo(VkDeviceSize value)
+	{
+		VkDeviceSize result = 1;
+		while ((result << 1) <= value)
+		{
+			result <<= 1;
+		}
+		return result;
+	}
+
+	LveMemoryAllocator::LveMemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device)
+		: m_device(device)
+	{
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &m_memoryProperties);
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+		// Every block offset is a multiple of the minimum allocation size, so keeping it a multiple of
+		// nonCoherentAtomSize makes flushing and invalidating any allocation legal.
+		m_nonCoherentAtomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+		m_minAllocationSize = NextPowerOfTwo(std::max(MIN_ALLOCATION_SIZE, m_nonCoherentAtomSize));
+		m_maxDeviceAllocationCount = properties.limits.maxMemoryAllocationCount;
+
+		// Two pools per memory type: one for linear resources and one for optimal images.
+		m_pools.resize(m_memoryProperties.memoryTypeCount * 2);
+
+		for (U32 typeIndex = 0; typeIndex < m_memoryProperties.memoryTypeCount; typeIndex++)
+		{
+			// Small heaps (e.g. 256MB device local host visible memory) get smaller blocks.
+			U32 heapIndex = m_memoryProperties.memoryTypes[typeIndex].heapIndex;
+			VkDeviceSize heapSize = m_memoryProperties.memoryHeaps[heapIndex].size;
+			VkDeviceSize blockSize = PreviousPowerOfTwo(std::min(DEFAULT_BLOCK_SIZE, heapSize / 8));
+			blockSize = std::max(blockSize, m_minAllocationSize);
+
+			for (U32 linear = 0; linear < 2; linear++)
+			{
+				Pool& pool = m_pools[typeIndex * 2 + linear];
+				pool.memoryTypeIndex = typeIndex;
+				pool.blockSize = blockSize;
+				pool.maxOrder = GetOrder(blockSize);
+			}
+		}
+	}
+
+	LveMemoryAllocator::~LveMemoryAllocator()
+	{
+		for (Pool& pool : m_pools)
+		{
+			for (Block& block : pool.blocks)
+			{
+				if (block.memory == VK_NULL_HANDLE)
+				{
+					continue;
+				}
+
+				if (block.usedSize > 0)
+				{
+					WARN("Memory block of type %u is destroyed with %llu bytes still in use!", pool.memoryTypeIndex, block.usedSize);
+				}
+
+				FreeDeviceMemory(block.memory, block.mappedData);
+			}
+		}
+
+		if (m_deviceAllocationCount > 0)
+		{
+			WARN("%u dedicated allocations were not freed!", m_deviceAllocationCount);
+		}
+	}
+
+	LveAllocation LveMemoryAllocator::Allocate(const VkMemoryRequirements& requirements, U32 memoryTypeIndex, bool linear)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		U32 poolIndex = memoryTypeIndex * 2 + (linear ? 1 : 0);
+		Pool& pool = m_pools[poolIndex];
+
+		// Buddy ranges are aligned to their own size, so rounding up to a power of two also satisfies the alignment.
+		VkDeviceSize size = NextPowerOfTwo(std::max({ requirements.size, requirements.alignment, m_minAllocationSize }));
+
+		LveAllocation allocation{};
+		allocation.poolIndex = poolIndex;
+
+		// Resources larger than a block get their own device memory.
+		if (size > pool.blockSize)
+		{
+			allocation.memory = AllocateDeviceMemory(requirements.size, memoryTypeIndex, &allocation.mappedData);
+			allocation.offset = 0;
+			allocation.size = requirements.size;
+			allocation.dedicated = true;
+			return allocation;
+		}
+
+		U32 order = GetOrder(size);
+		VkDeviceSize offset;
+
+		// Try existing blocks first, and create a new block (or reuse a released slot) only when all of them are full.
+		U32 blockIndex = 0;
+		while (blockIndex < pool.blocks.size())
+		{
+			Block& block = pool.blocks[blockIndex];
+			if (block.memory != VK_NULL_HANDLE && AllocateFromBlock(pool, block, order, offset))
+			{
+				break;
+			}
+			blockIndex++;
+		}
+
+		if (blockIndex == pool.blocks.size())
+		{
+			blockIndex = CreateBlock(pool);
+			bool allocated = AllocateFromBlock(pool, pool.blocks[blockIndex], order, offset);
+			ASSERT(allocated, "Failed to sub-allocate %llu bytes of memory type %u!", size, memoryTypeIndex);
+		}
+
+		Block& block = pool.blocks[blockIndex];
+		allocation.memory = block.memory;
+		allocation.offset = offset;
+		allocation.size = size;
+		allocation.mappedData = block.mappedData ? static_cast<char*>(block.mappedData) + offset : nullptr;
+		allocation.blockIndex = blockIndex;
+		return allocation;
+	}
+
+	void LveMemoryAllocator::Free(LveAllocation& allocation)
+	{
+		if (allocation.memory == VK_NULL_HANDLE)
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (allocation.dedicated)
+		{
+			FreeDeviceMemory(allocation.memory, allocation.mappedData);
+		}
+		else
+		{
+			Pool& pool = m_pools[allocation.poolIndex];
+			Block& block = pool.blocks[allocation.blockIndex];
+			ASSERT_EQ(block.memory, allocation.memory, "Allocation does not belong to this memory block!");
+
+			FreeToBlock(pool, block, allocation.offset, GetOrder(allocation.size));
+
+			// Release empty blocks, but keep the first one around to avoid reallocating it over and over.
+			if (block.usedSize == 0 && allocation.blockIndex > 0)
+			{
+				FreeDeviceMemory(block.memory, block.mappedData);
+				block = Block{};
+			}
+		}
+
+		allocation = LveAllocation{};
+	}
+
+	VkDeviceMemory LveMemoryAllocator::AllocateDeviceMemory(VkDeviceSize size, U32 memoryTypeIndex, void** mappedData)
+	{
+		ASSERT(m_deviceAllocationCount < m_maxDeviceAllocationCount, "Exceeded max memory allocation count (%u)!",
+			m_maxDeviceAllocationCount);
+
+		VkMemoryAllocateInfo allocateInfo{};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocateInfo.allocationSize = size;
+		allocateInfo.memoryTypeIndex = memoryTypeIndex;
+
+		VkDeviceMemory memory;
+		VkResult result = vkAllocateMemory(m_device, &allocateInfo, nullptr, &memory);
+		ASSERT_EQ(result, VK_SUCCESS, "Failed to allocate device memory!");
+
+		m_deviceAllocationCount++;
+
+		// A VkDeviceMemory can only be mapped once, so host visible memory is mapped as a whole and kept mapped.
+		*mappedData = nullptr;
+		if (m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		{
+			VkResult mapResult = vkMapMemory(m_device, memory, 0, VK_WHOLE_SIZE, 0, mappedData);
+			ASSERT_EQ(mapResult, VK_SUCCESS, "Failed to map device memory!");
+		}
+
+		return memory;
+	}
+
+	void LveMemoryAllocator::FreeDeviceMemory(VkDeviceMemory memory, void* mappedData)
+	{
+		if (mappedData)
+		{
+			vkUnmapMemory(m_device, memory);
+		}
+
+		vkFreeMemory(m_device, memory, nullptr);
+		m_deviceAllocationCount--;
+	}
+
+	U32 LveMemoryAllocator::CreateBlock(Pool& pool)
+	{
+		Block block{};
+		block.memory = AllocateDeviceMemory(pool.blockSize, pool.memoryTypeIndex, &block.mappedData);
+
+		// The whole block starts as a single free range of the highest order.
+		block.freeLists.resize(pool.maxOrder + 1);
+		block.freeLists[pool.maxOrder].insert(0);
+
+		PRINT("New memory block of %llu bytes for memory type %u (device allocations: %u)", pool.blockSize,
+			pool.memoryTypeIndex, m_deviceAllocationCount);
+
+		for (U32 blockIndex = 0; blockIndex < pool.blocks.size(); blockIndex++)
+		{
+			if (pool.blocks[blockIndex].memory == VK_NULL_HANDLE)
+			{
+				pool.blocks[blockIndex] = std::move(block);
+				return blockIndex;
+			}
+		}
+
+		pool.blocks.push_back(std::move(block));
+		return static_cast<U32>(pool.blocks.size() - 1);
+	}
+
+	bool LveMemoryAllocator::AllocateFromBlock(Pool& pool, Block& block, U32 order, VkDeviceSize& offset)
+	{
+		// Find the smallest free range that fits.
+		U32 freeOrder = order;
+		while (freeOrder <= pool.maxOrder && block.freeLists[freeOrder].empty())
+		{
+			freeOrder++;
+		}
+
+		if (freeOrder > pool.maxOrder)
+		{
+			return false;
+		}
+
+		offset = *block.freeLists[freeOrder].begin();
+		block.freeLists[freeOrder].erase(block.freeLists[freeOrder].begin());
+
+		// Split it down to the requested order. The upper halves become free buddies.
+		while (freeOrder > order)
+		{
+			freeOrder--;
+			block.freeLists[freeOrder].insert(offset + (m_minAllocationSize << freeOrder));
+		}
+
+		block.usedSize += m_minAllocationSize << order;
+		return true;
+	}
+
+	void LveMemoryAllocator::FreeToBlock(Pool& pool, Block& block, VkDeviceSize offset, U32 order)
+	{
+		block.usedSize -= m_minAllocationSize << order;
+
+		// Merge with the buddy as long as it is free too.
+		while (order < pool.maxOrder)
+		{
+			VkDeviceSize buddyOffset = offset ^ (m_minAllocationSize << order);
+			auto it = block.freeLists[order].find(buddyOffset);
+
+			if (it == block.freeLists[order].end())
+			{
+				break;
+			}
+
+			block.freeLists[order].erase(it);
+			offset = std::min(offset, buddyOffset);
+			order++;
+		}
+
+		block.freeLists[order].insert(offset);
+	}
+
+	U32 LveMemoryAllocator::GetOrder(VkDeviceSize size) const
+	{
+		U32 order = 0;
+		while ((m_minAllocationSize << order) < size)
+		{
+			order++;
+		}
+		return order;
+	}
+
+} // namespace lve
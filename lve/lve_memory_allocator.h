@@ -0,0 +1,96 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/2/24.
+//
+
+#pragma once
+
+#include "core/core.h"
+
+#include <vulkan/vulkan.h>
+
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace lve
+{
+	// A range of device memory handed out by LveMemoryAllocator. Resources are bound to memory at the offset.
+	struct LveAllocation
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+
+		// Points to the start of the range if the memory is host visible, otherwise nullptr.
+		// The memory stays mapped for the lifetime of the allocation.
+		void* mappedData = nullptr;
+
+		// Used by the allocator to give the range back.
+		U32 poolIndex = 0;
+		U32 blockIndex = 0;
+		bool dedicated = false;
+	};
+
+	// Sub-allocates resources from large memory blocks instead of calling vkAllocateMemory per resource,
+	// so the number of device allocations stays far below maxMemoryAllocationCount.
+	//
+	// There is one pool per (memory type, linear/optimal) pair. Keeping buffers and optimal images in separate pools
+	// means bufferImageGranularity never has to be taken into account. Each block is managed by a buddy allocator.
+	class LveMemoryAllocator
+	{
+	public:
+		LveMemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device);
+		~LveMemoryAllocator();
+
+		LveMemoryAllocator(const LveMemoryAllocator&) = delete;
+		LveMemoryAllocator& operator=(const LveMemoryAllocator&) = delete;
+
+		// Linear is true for buffers and linear images, false for optimal images.
+		LveAllocation Allocate(const VkMemoryRequirements& requirements, U32 memoryTypeIndex, bool linear);
+		void Free(LveAllocation& allocation);
+
+		VkDeviceSize GetNonCoherentAtomSize() const { return m_nonCoherentAtomSize; }
+		U32 GetDeviceAllocationCount() const { return m_deviceAllocationCount; }
+
+	private:
+		struct Block
+		{
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			void* mappedData = nullptr;
+			VkDeviceSize usedSize = 0;
+
+			// Free offsets of each order. Order k holds ranges of (m_minAllocationSize << k) bytes.
+			std::vector<std::set<VkDeviceSize>> freeLists;
+		};
+
+		struct Pool
+		{
+			U32 memoryTypeIndex = 0;
+			VkDeviceSize blockSize = 0;
+			U32 maxOrder = 0;
+			std::vector<Block> blocks;
+		};
+
+		VkDeviceMemory AllocateDeviceMemory(VkDeviceSize size, U32 memoryTypeIndex, void** mappedData);
+		void FreeDeviceMemory(VkDeviceMemory memory, void* mappedData);
+
+		U32 CreateBlock(Pool& pool);
+		bool AllocateFromBlock(Pool& pool, Block& block, U32 order, VkDeviceSize& offset);
+		void FreeToBlock(Pool& pool, Block& block, VkDeviceSize offset, U32 order);
+
+		U32 GetOrder(VkDeviceSize size) const;
+
+	private:
+		VkDevice m_device;
+		VkPhysicalDeviceMemoryProperties m_memoryProperties;
+
+		VkDeviceSize m_nonCoherentAtomSize;
+		VkDeviceSize m_minAllocationSize;
+		U32 m_maxDeviceAllocationCount;
+		U32 m_deviceAllocationCount = 0;
+
+		std::vector<Pool> m_pools;
+		std::mutex m_mutex;
+	};
+
+} // namespace lve
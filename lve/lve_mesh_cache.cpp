@@ -0,0 +1,168 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/8/24.
+//
+
+#include "lve_mesh_cache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+
+namespace lve
+{
+	LveMeshCache::~LveMeshCache()
+	{
+		Close();
+	}
+
+	bool LveMeshCache::Open(const std::string& sourceFilepath)
+	{
+		Close();
+
+		U64 sourceSize;
+		I64 sourceModifiedTime;
+		if (!GetSourceStamp(sourceFilepath, sourceSize, sourceModifiedTime))
+		{
+			return false;
+		}
+
+		std::string cacheFilepath = GetCacheFilepath(sourceFilepath);
+
+		int file = open(cacheFilepath.c_str(), O_RDONLY);
+		if (file < 0)
+		{
+			return false;
+		}
+
+		struct stat fileStat;
+		if (fstat(file, &fileStat) != 0 || static_cast<USize>(fileStat.st_size) < sizeof(LveMeshCacheHeader))
+		{
+			close(file);
+			return false;
+		}
+
+		m_mappedSize = static_cast<USize>(fileStat.st_size);
+		m_mappedData = mmap(nullptr, m_mappedSize, PROT_READ, MAP_PRIVATE, file, 0);
+		close(file); // The mapping stays valid after closing the file.
+
+		if (m_mappedData == MAP_FAILED)
+		{
+			m_mappedData = nullptr;
+			m_mappedSize = 0;
+			return false;
+		}
+
+		m_header = static_cast<const LveMeshCacheHeader*>(m_mappedData);
+
+		const LveMeshCacheHeader& header = *m_header;
+		bool isValid = header.magic == MAGIC && header.version == VERSION && header.vertexStride == sizeof(LveModel::Vertex) &&
+					   header.indexStride == sizeof(U32) && header.sourceSize == sourceSize &&
+					   header.sourceModifiedTime == sourceModifiedTime &&
+					   header.vertexOffset + static_cast<U64>(header.vertexCount) * header.vertexStride <= m_mappedSize &&
+					   header.indexOffset + static_cast<U64>(header.indexCount) * header.indexStride <= m_mappedSize;
+
+		if (!isValid)
+		{
+			PRINT("Mesh cache %s is stale and will be rebuilt", cacheFilepath.c_str());
+			Close();
+			return false;
+		}
+
+		PRINT("Loaded mesh cache %s (%zu bytes)", cacheFilepath.c_str(), m_mappedSize);
+		return true;
+	}
+
+	void LveMeshCache::Close()
+	{
+		if (m_mappedData)
+		{
+			munmap(m_mappedData, m_mappedSize);
+		}
+
+		m_mappedData = nullptr;
+		m_mappedSize = 0;
+		m_header = nullptr;
+	}
+
+	void LveMeshCache::Write(const std::string& sourceFilepath, const LveModel::Builder& builder)
+	{
+		LveMeshCacheHeader header{};
+		header.magic = MAGIC;
+		header.version = VERSION;
+		header.vertexStride = sizeof(LveModel::Vertex);
+		header.indexStride = sizeof(U32);
+
+		if (!GetSourceStamp(sourceFilepath, header.sourceSize, header.sourceModifiedTime))
+		{
+			return;
+		}
+
+		header.vertexCount = static_cast<U32>(builder.vertices.size());
+		header.indexCount = static_cast<U32>(builder.indices.size());
+		header.vertexOffset = sizeof(LveMeshCacheHeader);
+		header.indexOffset = header.vertexOffset + static_cast<U64>(header.vertexCount) * header.vertexStride;
+
+		for (int i = 0; i < 3; ++i)
+		{
+			header.boundsMin[i] = builder.boundsMin[i];
+			header.boundsMax[i] = builder.boundsMax[i];
+		}
+
+		for (int i = 0; i < 4; ++i)
+		{
+			header.boundingSphere[i] = builder.boundingSphere[i];
+		}
+
+		// Write to a temporary file first, so a crash never leaves a truncated cache behind.
+		std::string cacheFilepath = GetCacheFilepath(sourceFilepath);
+		std::string tempFilepath = cacheFilepath + ".tmp";
+
+		FILE* file = fopen(tempFilepath.c_str(), "wb");
+		if (!file)
+		{
+			WARN("Failed to write mesh cache: %s", cacheFilepath.c_str());
+			return;
+		}
+
+		bool succeeded = fwrite(&header, sizeof(header), 1, file) == 1;
+		succeeded = succeeded && fwrite(builder.vertices.data(), header.vertexStride, header.vertexCount, file) == header.vertexCount;
+		succeeded = succeeded && fwrite(builder.indices.data(), header.indexStride, header.indexCount, file) == header.indexCount;
+		succeeded = (fclose(file) == 0) && succeeded;
+
+		if (!succeeded || rename(tempFilepath.c_str(), cacheFilepath.c_str()) != 0)
+		{
+			WARN("Failed to write mesh cache: %s", cacheFilepath.c_str());
+			remove(tempFilepath.c_str());
+			return;
+		}
+
+		PRINT("Wrote mesh cache %s", cacheFilepath.c_str());
+	}
+
+	const LveModel::Vertex* LveMeshCache::GetVertices() const
+	{
+		return reinterpret_cast<const LveModel::Vertex*>(static_cast<const char*>(m_mappedData) + m_header->vertexOffset);
+	}
+
+	const U32* LveMeshCache::GetIndices() const
+	{
+		return reinterpret_cast<const U32*>(static_cast<const char*>(m_mappedData) + m_header->indexOffset);
+	}
+
+	bool LveMeshCache::GetSourceStamp(const std::string& sourceFilepath, U64& size, I64& modifiedTime)
+	{
+		struct stat fileStat;
+		if (stat(sourceFilepath.c_str(), &fileStat) != 0)
+		{
+			return false;
+		}
+
+		size = static_cast<U64>(fileStat.st_size);
+		modifiedTime = static_cast<I64>(fileStat.st_mtime);
+		return true;
+	}
+
+} // namespace lve
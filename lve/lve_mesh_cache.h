@@ -0,0 +1,84 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/8/24.
+//
+
+#pragma once
+
+#include "core/core.h"
+
+#include "lve_model.h"
+
+#include <string>
+
+namespace lve
+{
+	// Header of a .lvemesh file. The vertex and index blobs follow at the given offsets.
+	struct LveMeshCacheHeader
+	{
+		U32 magic;
+		U32 version;
+		U32 vertexStride;
+		U32 indexStride;
+
+		// The cache is valid as long as the source file keeps the same size and modification time.
+		U64 sourceSize;
+		I64 sourceModifiedTime;
+
+		U32 vertexCount;
+		U32 indexCount;
+		U64 vertexOffset;
+		U64 indexOffset;
+
+		F32 boundsMin[3];
+		F32 boundsMax[3];
+		F32 boundingSphere[4];
+	};
+
+	// Binary mesh cache written next to the source model (e.g. models/smooth_vase.obj.lvemesh) after the first parse.
+	// Later loads memory-map the file and upload vertices and indices straight from the mapping.
+	class LveMeshCache
+	{
+	public:
+		static constexpr U32 MAGIC = 0x4D45564C; // "LVEM"
+		static constexpr U32 VERSION = 3; // 2: optimized index order, 3: bounding sphere
+
+		LveMeshCache() = default;
+		~LveMeshCache();
+
+		LveMeshCache(const LveMeshCache&) = delete;
+		LveMeshCache& operator=(const LveMeshCache&) = delete;
+
+		// Map the cache of the source model. Returns false if it is missing, stale or written by another version.
+		bool Open(const std::string& sourceFilepath);
+		void Close();
+
+		// Write the cache of the source model. Failing to write is not an error, the model is just parsed again next time.
+		static void Write(const std::string& sourceFilepath, const LveModel::Builder& builder);
+
+		static std::string GetCacheFilepath(const std::string& sourceFilepath) { return sourceFilepath + ".lvemesh"; }
+
+		// Getters
+		const LveMeshCacheHeader& GetHeader() const { return *m_header; }
+		const LveModel::Vertex* GetVertices() const;
+		const U32* GetIndices() const;
+		U32 GetVertexCount() const { return m_header->vertexCount; }
+		U32 GetIndexCount() const { return m_header->indexCount; }
+		Vector3 GetBoundsMin() const { return Vector3(m_header->boundsMin[0], m_header->boundsMin[1], m_header->boundsMin[2]); }
+		Vector3 GetBoundsMax() const { return Vector3(m_header->boundsMax[0], m_header->boundsMax[1], m_header->boundsMax[2]); }
+		Vector4 GetBoundingSphere() const
+		{
+			const F32* sphere = m_header->boundingSphere;
+			return Vector4(sphere[0], sphere[1], sphere[2], sphere[3]);
+		}
+
+	private:
+		// Returns false if the source file does not exist.
+		static bool GetSourceStamp(const std::string& sourceFilepath, U64& size, I64& modifiedTime);
+
+	private:
+		void* m_mappedData = nullptr;
+		USize m_mappedSize = 0;
+		const LveMeshCacheHeader* m_header = nullptr;
+	};
+
+} // namespace lve
@@ -0,0 +1,391 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/13/24.
+//
+
+#include "lve_mesh_optimizer.h"
+
+#include <algorithm>
+
+namespace lve
+{
+	static constexpr U32 INVALID_VERTEX = ~0u;
+
+	// Returns the number of cache misses of each triangle when the index list is run through a FIFO cache.
+	static std::vector<U32> SimulateFifoCache(const std::vector<U32>& indices, U32 vertexCount, U32 cacheSize)
+	{
+		USize triangleCount = indices.size() / 3;
+		std::vector<U32> triangleMisses(triangleCount, 0);
+
+		// A vertex is in the cache if it was inserted within the last cacheSize insertions.
+		std::vector<U32> insertTimestamps(vertexCount, 0);
+		U32 timestamp = cacheSize + 1;
+
+		for (USize triangle = 0; triangle < triangleCount; ++triangle)
+		{
+			for (USize corner = 0; corner < 3; ++corner)
+			{
+				U32 vertex = indices[triangle * 3 + corner];
+
+				if (timestamp - insertTimestamps[vertex] > cacheSize)
+				{
+					insertTimestamps[vertex] = timestamp++;
+					++triangleMisses[triangle];
+				}
+			}
+		}
+
+		return triangleMisses;
+	}
+
+	F32 LveMeshOptimizer::ComputeAcmr(const std::vector<U32>& indices, U32 vertexCount, U32 cacheSize)
+	{
+		USize triangleCount = indices.size() / 3;
+		if (triangleCount == 0)
+		{
+			return 0.0f;
+		}
+
+		std::vector<U32> triangleMisses = SimulateFifoCache(indices, vertexCount, cacheSize);
+
+		U64 misses = 0;
+		for (U32 triangleMiss : triangleMisses)
+		{
+			misses += triangleMiss;
+		}
+
+		return static_cast<F32>(misses) / static_cast<F32>(triangleCount);
+	}
+
+	void LveMeshOptimizer::OptimizeVertexCache(std::vector<U32>& indices, U32 vertexCount, U32 cacheSize)
+	{
+		ASSERT(indices.size() % 3 == 0, "Failed to optimize mesh. Index count must be a multiple of 3!");
+
+		U32 triangleCount = static_cast<U32>(indices.size() / 3);
+		if (triangleCount == 0)
+		{
+			return;
+		}
+
+		// Triangles adjacent to each vertex in a flat list. Vertex v owns [adjacencyOffsets[v], adjacencyOffsets[v + 1]).
+		std::vector<U32> liveTriangleCounts(vertexCount, 0);
+		for (U32 index : indices)
+		{
+			++liveTriangleCounts[index];
+		}
+
+		std::vector<U32> adjacencyOffsets(vertexCount + 1, 0);
+		for (U32 vertex = 0; vertex < vertexCount; ++vertex)
+		{
+			adjacencyOffsets[vertex + 1] = adjacencyOffsets[vertex] + liveTriangleCounts[vertex];
+		}
+
+		std::vector<U32> adjacency(indices.size());
+		std::vector<U32> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (U32 triangle = 0; triangle < triangleCount; ++triangle)
+		{
+			for (U32 corner = 0; corner < 3; ++corner)
+			{
+				U32 vertex = indices[triangle * 3 + corner];
+				adjacency[adjacencyFill[vertex]++] = triangle;
+			}
+		}
+
+		std::vector<U32> cacheTimestamps(vertexCount, 0);
+		std::vector<bool> isEmitted(triangleCount, false);
+		std::vector<U32> deadEndStack{};
+		std::vector<U32> candidates{};
+
+		std::vector<U32> output{};
+		output.reserve(indices.size());
+
+		U32 timestamp = cacheSize + 1;
+		U32 cursor = 0;
+		U32 fanningVertex = 0;
+
+		// Skip vertices without triangles, which Tipsify would otherwise start from.
+		while (fanningVertex < vertexCount && liveTriangleCounts[fanningVertex] == 0)
+		{
+			++fanningVertex;
+		}
+
+		while (fanningVertex != INVALID_VERTEX && fanningVertex < vertexCount)
+		{
+			candidates.clear();
+
+			// Emit all remaining triangles around the fanning vertex.
+			for (U32 i = adjacencyOffsets[fanningVertex]; i < adjacencyOffsets[fanningVertex + 1]; ++i)
+			{
+				U32 triangle = adjacency[i];
+				if (isEmitted[triangle])
+				{
+					continue;
+				}
+
+				for (U32 corner = 0; corner < 3; ++corner)
+				{
+					U32 vertex = indices[triangle * 3 + corner];
+					output.push_back(vertex);
+					deadEndStack.push_back(vertex);
+					candidates.push_back(vertex);
+					--liveTriangleCounts[vertex];
+
+					if (timestamp - cacheTimestamps[vertex] > cacheSize)
+					{
+						cacheTimestamps[vertex] = timestamp++;
+					}
+				}
+
+				isEmitted[triangle] = true;
+			}
+
+			// Pick the candidate that stays in the cache the longest while its remaining triangles are emitted.
+			fanningVertex = INVALID_VERTEX;
+			I64 bestPriority = -1;
+
+			for (U32 vertex : candidates)
+			{
+				if (liveTriangleCounts[vertex] == 0)
+				{
+					continue;
+				}
+
+				I64 priority = 0;
+				if (timestamp - cacheTimestamps[vertex] + 2 * liveTriangleCounts[vertex] <= cacheSize)
+				{
+					priority = timestamp - cacheTimestamps[vertex];
+				}
+
+				if (priority > bestPriority)
+				{
+					bestPriority = priority;
+					fanningVertex = vertex;
+				}
+			}
+
+			if (fanningVertex != INVALID_VERTEX)
+			{
+				continue;
+			}
+
+			// Dead end. Go back to the most recently used vertex with live triangles, then to the next one in order.
+			while (!deadEndStack.empty())
+			{
+				U32 vertex = deadEndStack.back();
+				deadEndStack.pop_back();
+
+				if (liveTriangleCounts[vertex] > 0)
+				{
+					fanningVertex = vertex;
+					break;
+				}
+			}
+
+			while (fanningVertex == INVALID_VERTEX && cursor < vertexCount)
+			{
+				if (liveTriangleCounts[cursor] > 0)
+				{
+					fanningVertex = cursor;
+				}
+
+				++cursor;
+			}
+		}
+
+		ASSERT(output.size() == indices.size(), "Failed to optimize mesh. Not all triangles were emitted!");
+		indices.swap(output);
+	}
+
+	void LveMeshOptimizer::OptimizeOverdraw(std::vector<U32>& indices, const std::vector<LveModel::Vertex>& vertices,
+		F32 threshold, U32 cacheSize)
+	{
+		U32 triangleCount = static_cast<U32>(indices.size() / 3);
+		U32 vertexCount = static_cast<U32>(vertices.size());
+		if (triangleCount == 0)
+		{
+			return;
+		}
+
+		std::vector<U32> triangleMisses = SimulateFifoCache(indices, vertexCount, cacheSize);
+
+		// Hard boundaries are triangles that miss on all three vertices. Reordering clusters there costs nothing.
+		std::vector<U32> hardBoundaries{};
+		for (U32 triangle = 0; triangle < triangleCount; ++triangle)
+		{
+			if (triangle == 0 || triangleMisses[triangle] == 3)
+			{
+				hardBoundaries.push_back(triangle);
+			}
+		}
+		hardBoundaries.push_back(triangleCount);
+
+		// Soft boundaries split hard clusters further as long as each piece stays within the ACMR threshold. Each piece
+		// starts with an empty cache, since it may be drawn after any other piece once clusters are sorted.
+		std::vector<U32> clusterStarts{};
+		std::vector<U32> cacheTimestamps(vertexCount, 0);
+		U32 timestamp = cacheSize + 1;
+
+		for (USize i = 0; i + 1 < hardBoundaries.size(); ++i)
+		{
+			U32 begin = hardBoundaries[i];
+			U32 end = hardBoundaries[i + 1];
+
+			U32 hardMisses = 0;
+			for (U32 triangle = begin; triangle < end; ++triangle)
+			{
+				hardMisses += triangleMisses[triangle];
+			}
+
+			F32 targetAcmr = threshold * static_cast<F32>(hardMisses) / static_cast<F32>(end - begin);
+
+			clusterStarts.push_back(begin);
+			timestamp += cacheSize + 1;
+
+			U32 clusterMisses = 0;
+			U32 clusterBegin = begin;
+
+			for (U32 triangle = begin; triangle < end; ++triangle)
+			{
+				for (U32 corner = 0; corner < 3; ++corner)
+				{
+					U32 vertex = indices[triangle * 3 + corner];
+
+					if (timestamp - cacheTimestamps[vertex] > cacheSize)
+					{
+						cacheTimestamps[vertex] = timestamp++;
+						++clusterMisses;
+					}
+				}
+
+				U32 clusterTriangleCount = triangle - clusterBegin + 1;
+				bool isWithinTarget = static_cast<F32>(clusterMisses) <= targetAcmr * static_cast<F32>(clusterTriangleCount);
+
+				if (triangle + 1 < end)
+				{
+					if (isWithinTarget)
+					{
+						clusterStarts.push_back(triangle + 1);
+						clusterBegin = triangle + 1;
+						clusterMisses = 0;
+						timestamp += cacheSize + 1;
+					}
+				}
+				else if (!isWithinTarget && clusterBegin > begin)
+				{
+					// The remaining triangles never got within the target on their own, so they stay with the previous piece.
+					clusterStarts.pop_back();
+				}
+			}
+		}
+		clusterStarts.push_back(triangleCount);
+
+		// Mesh centroid weighted by triangle area.
+		Vector3 meshCentroid{ 0.0f };
+		F32 meshArea = 0.0f;
+
+		for (U32 triangle = 0; triangle < triangleCount; ++triangle)
+		{
+			const Vector3& p0 = vertices[indices[triangle * 3 + 0]].position;
+			const Vector3& p1 = vertices[indices[triangle * 3 + 1]].position;
+			const Vector3& p2 = vertices[indices[triangle * 3 + 2]].position;
+
+			F32 area = MathOp::Length(MathOp::Cross(p1 - p0, p2 - p0));
+			meshCentroid += (p0 + p1 + p2) * (area / 3.0f);
+			meshArea += area;
+		}
+
+		if (meshArea > 0.0f)
+		{
+			meshCentroid /= meshArea;
+		}
+
+		// Clusters that face away from the centroid are likely to occlude others, so they are drawn first.
+		struct Cluster
+		{
+			U32 begin;
+			U32 end;
+			F32 sortKey;
+		};
+
+		std::vector<Cluster> clusters{};
+		clusters.reserve(clusterStarts.size() - 1);
+
+		for (USize i = 0; i + 1 < clusterStarts.size(); ++i)
+		{
+			Cluster cluster{ clusterStarts[i], clusterStarts[i + 1], 0.0f };
+
+			Vector3 centroid{ 0.0f };
+			Vector3 normal{ 0.0f };
+			F32 area = 0.0f;
+
+			for (U32 triangle = cluster.begin; triangle < cluster.end; ++triangle)
+			{
+				const Vector3& p0 = vertices[indices[triangle * 3 + 0]].position;
+				const Vector3& p1 = vertices[indices[triangle * 3 + 1]].position;
+				const Vector3& p2 = vertices[indices[triangle * 3 + 2]].position;
+
+				// The cross product is area-weighted already.
+				Vector3 triangleNormal = MathOp::Cross(p1 - p0, p2 - p0);
+				F32 triangleArea = MathOp::Length(triangleNormal);
+
+				centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+				normal += triangleNormal;
+				area += triangleArea;
+			}
+
+			if (area > 0.0f)
+			{
+				centroid /= area;
+			}
+
+			cluster.sortKey = MathOp::Dot(centroid - meshCentroid, normal);
+			clusters.push_back(cluster);
+		}
+
+		std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+		std::vector<U32> output{};
+		output.reserve(indices.size());
+
+		for (const Cluster& cluster : clusters)
+		{
+			output.insert(output.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+		}
+
+		// Pieces only meet the target on their own. Once sorted, each starts with whatever the previous one left in the
+		// cache, so check the whole order and keep the vertex cache order if it got too expensive.
+		U64 originalMisses = 0;
+		for (U32 triangleMiss : triangleMisses)
+		{
+			originalMisses += triangleMiss;
+		}
+
+		F32 originalAcmr = static_cast<F32>(originalMisses) / static_cast<F32>(triangleCount);
+		if (ComputeAcmr(output, vertexCount, cacheSize) > threshold * originalAcmr)
+		{
+			return;
+		}
+
+		indices.swap(output);
+	}
+
+	void LveMeshOptimizer::OptimizeVertexFetch(std::vector<LveModel::Vertex>& vertices, std::vector<U32>& indices)
+	{
+		std::vector<U32> remap(vertices.size(), INVALID_VERTEX);
+		std::vector<LveModel::Vertex> output{};
+		output.reserve(vertices.size());
+
+		for (U32& index : indices)
+		{
+			if (remap[index] == INVALID_VERTEX)
+			{
+				remap[index] = static_cast<U32>(output.size());
+				output.push_back(vertices[index]);
+			}
+
+			index = remap[index];
+		}
+
+		vertices.swap(output);
+	}
+
+} // namespace lve
@@ -0,0 +1,38 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/13/24.
+//
+
+#pragma once
+
+#include "core/core.h"
+
+#include "lve_model.h"
+
+#include <vector>
+
+namespace lve
+{
+	// Reorders triangle lists for the GPU. Run in this order: vertex cache, overdraw, vertex fetch.
+	class LveMeshOptimizer
+	{
+	public:
+		// Number of entries of the simulated post-transform vertex cache.
+		static constexpr U32 DEFAULT_CACHE_SIZE = 16;
+
+		// Reorders triangles so recently transformed vertices are reused (Tipsify, Sander et al. 2007).
+		static void OptimizeVertexCache(std::vector<U32>& indices, U32 vertexCount, U32 cacheSize = DEFAULT_CACHE_SIZE);
+
+		// Reorders clusters of triangles so outward-facing ones are drawn first. Keeps the ACMR of the vertex cache
+		// optimized order within threshold times its original value, and leaves the order as it is if the sorted one
+		// would exceed that. Expects an order from OptimizeVertexCache.
+		static void OptimizeOverdraw(std::vector<U32>& indices, const std::vector<LveModel::Vertex>& vertices,
+			F32 threshold = 1.05f, U32 cacheSize = DEFAULT_CACHE_SIZE);
+
+		// Reorders vertices by their first use in the index list and remaps indices. Unused vertices are removed.
+		static void OptimizeVertexFetch(std::vector<LveModel::Vertex>& vertices, std::vector<U32>& indices);
+
+		// Average cache miss ratio: transformed vertices per triangle for a FIFO cache of cacheSize entries.
+		static F32 ComputeAcmr(const std::vector<U32>& indices, U32 vertexCount, U32 cacheSize = DEFAULT_CACHE_SIZE);
+	};
+
+} // namespace lve
@@ -4,28 +4,57 @@
 
 #include "lve_model.h"
 
-#include "lve_utils.h"
+#include "lve_mesh_cache.h"
+#include "lve_mesh_optimizer.h"
+#include "lve_obj_loader.h"
+#include "lve_vertex_welder.h"
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 
-namespace std
+#include <glm/gtc/packing.hpp>
+
+#include <cmath>
+#include <fstream>
+
+namespace lve
 {
-	template <>
-	struct hash<lve::LveModel::Vertex>
+	// Largest vertex count that can still be addressed by 16-bit indices.
+	static constexpr U32 MAX_UINT16_INDEXED_VERTEX_COUNT = 65536;
+
+	static inline I16 QuantizeSnorm16(F32 value)
 	{
-		size_t operator()(const lve::LveModel::Vertex& vertex) const
+		return static_cast<I16>(std::lround(MathOp::Clamp(value, -1.0f, 1.0f) * 32767.0f));
+	}
+
+	static inline U8 QuantizeUnorm8(F32 value)
+	{
+		return static_cast<U8>(std::lround(MathOp::Clamp(value, 0.0f, 1.0f) * 255.0f));
+	}
+
+	// Maps a unit vector onto the octahedron and unfolds it to [-1, 1]^2. Decoded in simple_shader_compact.vert.
+	static Vector2 EncodeOctahedral(Vector3 normal)
+	{
+		F32 length = MathOp::Abs(normal.x) + MathOp::Abs(normal.y) + MathOp::Abs(normal.z);
+		if (length == 0.0f)
 		{
-			size_t seed = 0;
-			lve::HashCombine(seed, vertex.position, vertex.color, vertex.normal, vertex.uv);
-			return seed;
+			return Vector2{ 0.0f };
 		}
-	};
 
-} // namespace std
+		normal /= length;
+
+		if (normal.z >= 0.0f)
+		{
+			return Vector2{ normal.x, normal.y };
+		}
+
+		// Fold the lower hemisphere over the diagonals.
+		return Vector2{
+			(1.0f - MathOp::Abs(normal.y)) * (normal.x >= 0.0f ? 1.0f : -1.0f),
+			(1.0f - MathOp::Abs(normal.x)) * (normal.y >= 0.0f ? 1.0f : -1.0f)
+		};
+	}
 
-namespace lve
-{
 	std::vector<VkVertexInputBindingDescription> LveModel::Vertex::GetBindingDescriptions()
 	{
 		std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
@@ -45,77 +74,164 @@ namespace lve
 		return attributeDescriptions;
 	}
 
-	LveModel::LveModel(LveDevice& device, const Builder& builder)
-		: m_device(device)
+	std::vector<VkVertexInputBindingDescription> LveModel::CompactVertex::GetBindingDescriptions()
+	{
+		std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
+		bindingDescriptions[0].binding = 0;
+		bindingDescriptions[0].stride = sizeof(CompactVertex);
+		bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		return bindingDescriptions;
+	}
+
+	std::vector<VkVertexInputAttributeDescription> LveModel::CompactVertex::GetAttributeDescriptions()
 	{
-		CreateVertexBuffers(builder.vertices);
-		CreateIndexBuffers(builder.indices);
+		// Same locations as Vertex. The normalized formats are converted to floats by the input assembler.
+		std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
+		attributeDescriptions.push_back({ 0, 0, VK_FORMAT_R16G16B16A16_SNORM, offsetof(CompactVertex, position) });
+		attributeDescriptions.push_back({ 1, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(CompactVertex, color) });
+		attributeDescriptions.push_back({ 2, 0, VK_FORMAT_R16G16_SNORM, offsetof(CompactVertex, normal) });
+		attributeDescriptions.push_back({ 3, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(CompactVertex, uv) });
+		return attributeDescriptions;
+	}
+
+	LveModel::LveModel(LveDevice& device, const Builder& builder, VertexFormat vertexFormat)
+		: m_device(device), m_vertexFormat(vertexFormat), m_boundsMin(builder.boundsMin), m_boundsMax(builder.boundsMax),
+		  m_boundingSphere(builder.boundingSphere)
+	{
+		CreateVertexBuffers(builder.vertices.data(), static_cast<U32>(builder.vertices.size()));
+		CreateIndexBuffers(builder.indices.data(), static_cast<U32>(builder.indices.size()));
+	}
+
+	LveModel::LveModel(LveDevice& device, const LveMeshCache& meshCache, VertexFormat vertexFormat)
+		: m_device(device), m_vertexFormat(vertexFormat), m_boundsMin(meshCache.GetBoundsMin()), m_boundsMax(meshCache.GetBoundsMax()),
+		  m_boundingSphere(meshCache.GetBoundingSphere())
+	{
+		// Standard vertices and 32-bit indices are copied from the memory-mapped file straight into the staging buffer.
+		CreateVertexBuffers(meshCache.GetVertices(), meshCache.GetVertexCount());
+		CreateIndexBuffers(meshCache.GetIndices(), meshCache.GetIndexCount());
 	}
 
 	LveModel::~LveModel()
 	{
+		// Usually returns immediately since uploads finish long before a model is destroyed.
+		m_device.GetUploadManager().Wait(m_uploadTicket);
+
+		// Frames in flight may still draw the model, so its ranges must not be reused before they are done.
+		m_device.DeferDestruction([&device = m_device, vertexRange = m_vertexRange, indexRange = m_indexRange]() mutable {
+			device.GetGeometryPool().Free(vertexRange);
+			device.GetGeometryPool().Free(indexRange);
+		});
 	}
 
 	void LveModel::Bind(VkCommandBuffer commandBuffer)
 	{
-		VkBuffer buffers[] = { m_vertexBuffer->GetBuffer() };
+		// Buffers are bound at offset 0. Draw selects the model's range with vertexOffset and firstIndex.
+		VkBuffer buffers[] = { m_vertexRange.buffer };
 		VkDeviceSize offsets[] = { 0 };
-		// TODO: Consider adding a Bind() function in the buffer class.
 		vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
 
 		if (m_hasIndexBuffer)
 		{
-			vkCmdBindIndexBuffer(commandBuffer, m_indexBuffer->GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
+			vkCmdBindIndexBuffer(commandBuffer, m_indexRange.buffer, 0, m_indexType);
 		}
 	}
 
-	void LveModel::Draw(VkCommandBuffer commandBuffer)
+	void LveModel::Draw(VkCommandBuffer commandBuffer, U32 instanceCount, U32 firstInstance)
 	{
 		if (m_hasIndexBuffer)
 		{
-			vkCmdDrawIndexed(commandBuffer, m_indexCount, 1, 0, 0, 0);
+			vkCmdDrawIndexed(commandBuffer, m_indexCount, instanceCount, m_indexRange.offset,
+				static_cast<I32>(m_vertexRange.offset), firstInstance);
 		}
 		else
 		{
-			vkCmdDraw(commandBuffer, m_vertexCount, 1, 0, 0);
+			vkCmdDraw(commandBuffer, m_vertexCount, instanceCount, m_vertexRange.offset, firstInstance);
+		}
+	}
+
+	Matrix4 LveModel::GetDequantizeMatrix() const
+	{
+		Matrix4 dequantizeMatrix{ 1.0f };
+
+		if (m_vertexFormat == VertexFormat::Compact)
+		{
+			Vector3 center = (m_boundsMin + m_boundsMax) * 0.5f;
+			Vector3 halfExtent = (m_boundsMax - m_boundsMin) * 0.5f;
+
+			dequantizeMatrix[0][0] = halfExtent.x;
+			dequantizeMatrix[1][1] = halfExtent.y;
+			dequantizeMatrix[2][2] = halfExtent.z;
+			dequantizeMatrix[3] = Vector4(center, 1.0f);
 		}
+
+		return dequantizeMatrix;
 	}
 
-	void LveModel::CreateVertexBuffers(const std::vector<Vertex>& vertices)
+	void LveModel::CreateVertexBuffers(const Vertex* vertices, U32 vertexCount)
 	{
-		m_vertexCount = static_cast<U32>(vertices.size());
+		m_vertexCount = vertexCount;
 		ASSERT(m_vertexCount >= 3, "Failed to create vertex buffer. Vertex count must be at least 3!");
 
-		U32 vertexSize = sizeof(vertices[0]);
-		VkDeviceSize bufferSize = vertexSize * m_vertexCount;
+		std::vector<CompactVertex> compactVertices{};
+		const void* vertexData = vertices;
+		U32 vertexSize = sizeof(Vertex);
 
-		// Create staging buffer and it will be auto deleted.
-		LveBuffer stagingBuffer{
-			m_device,
-			vertexSize,
-			m_vertexCount,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-		};
+		if (m_vertexFormat == VertexFormat::Compact)
+		{
+			Vector3 center = (m_boundsMin + m_boundsMax) * 0.5f;
+			Vector3 halfExtent = (m_boundsMax - m_boundsMin) * 0.5f;
 
-		stagingBuffer.Map();
-		stagingBuffer.WriteToBuffer((void*)vertices.data());
+			// Flat axes have a zero extent. Every position is at the center on those axes.
+			Vector3 inverseHalfExtent{
+				halfExtent.x > 0.0f ? 1.0f / halfExtent.x : 0.0f,
+				halfExtent.y > 0.0f ? 1.0f / halfExtent.y : 0.0f,
+				halfExtent.z > 0.0f ? 1.0f / halfExtent.z : 0.0f
+			};
 
-		// Create vertex buffer.
-		m_vertexBuffer = MakeUniqueRef<LveBuffer>(
-			m_device,
-			vertexSize,
-			m_vertexCount,
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			compactVertices.resize(m_vertexCount);
 
-		// Copy staging to vertex buffer.
-		m_device.CopyBuffer(stagingBuffer.GetBuffer(), m_vertexBuffer->GetBuffer(), bufferSize);
+			for (U32 i = 0; i < m_vertexCount; ++i)
+			{
+				const Vertex& vertex = vertices[i];
+				CompactVertex& compactVertex = compactVertices[i];
+
+				Vector3 position = (vertex.position - center) * inverseHalfExtent;
+				compactVertex.position[0] = QuantizeSnorm16(position.x);
+				compactVertex.position[1] = QuantizeSnorm16(position.y);
+				compactVertex.position[2] = QuantizeSnorm16(position.z);
+				compactVertex.position[3] = 0;
+
+				Vector2 normal = EncodeOctahedral(vertex.normal);
+				compactVertex.normal[0] = QuantizeSnorm16(normal.x);
+				compactVertex.normal[1] = QuantizeSnorm16(normal.y);
+
+				compactVertex.color[0] = QuantizeUnorm8(vertex.color.r);
+				compactVertex.color[1] = QuantizeUnorm8(vertex.color.g);
+				compactVertex.color[2] = QuantizeUnorm8(vertex.color.b);
+				compactVertex.color[3] = 255;
+
+				compactVertex.uv[0] = glm::packHalf1x16(vertex.uv.x);
+				compactVertex.uv[1] = glm::packHalf1x16(vertex.uv.y);
+			}
+
+			vertexData = compactVertices.data();
+			vertexSize = sizeof(CompactVertex);
+		}
+
+		VkDeviceSize bufferSize = static_cast<VkDeviceSize>(vertexSize) * m_vertexCount;
+
+		// Sub-allocate the vertices from the geometry pool.
+		m_vertexRange = m_device.GetGeometryPool().AllocateVertices(vertexSize, m_vertexCount);
+		VkDeviceSize dstOffset = static_cast<VkDeviceSize>(vertexSize) * m_vertexRange.offset;
+
+		// Data goes through the upload manager's staging buffer and the copy is submitted with other uploads.
+		// The staging copy is made right away, so converted vertices do not need to outlive this call.
+		m_uploadTicket = m_device.GetUploadManager().UploadToBuffer(m_vertexRange.buffer, vertexData, bufferSize, dstOffset);
 	}
 
-	void LveModel::CreateIndexBuffers(const std::vector<U32>& indices)
+	void LveModel::CreateIndexBuffers(const U32* indices, U32 indexCount)
 	{
-		m_indexCount = static_cast<U32>(indices.size());
+		m_indexCount = indexCount;
 		m_hasIndexBuffer = m_indexCount > 0;
 
 		if (!m_hasIndexBuffer)
@@ -123,31 +239,27 @@ namespace lve
 			return;
 		}
 
-		U32 indexSize = sizeof(indices[0]);
-		VkDeviceSize bufferSize = indexSize * m_indexCount;
+		// Vertex buffers are created first, so the vertex count is known here.
+		std::vector<U16> shortIndices{};
+		const void* indexData = indices;
+		U32 indexSize = sizeof(U32);
+		m_indexType = VK_INDEX_TYPE_UINT32;
 
-		// Create staging buffer and it will be auto deleted.
-		LveBuffer stagingBuffer{
-			m_device,
-			indexSize,
-			m_indexCount,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		};
+		if (m_vertexCount <= MAX_UINT16_INDEXED_VERTEX_COUNT)
+		{
+			shortIndices.assign(indices, indices + m_indexCount);
+			indexData = shortIndices.data();
+			indexSize = sizeof(U16);
+			m_indexType = VK_INDEX_TYPE_UINT16;
+		}
 
-		stagingBuffer.Map();
-		stagingBuffer.WriteToBuffer((void*)indices.data());
+		VkDeviceSize bufferSize = static_cast<VkDeviceSize>(indexSize) * m_indexCount;
 
-		// Create index buffer.
-		m_indexBuffer = MakeUniqueRef<LveBuffer>(
-			m_device,
-			indexSize,
-			m_indexCount,
-			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		// 16-bit and 32-bit indices live in different pool buffers.
+		m_indexRange = m_device.GetGeometryPool().AllocateIndices(indexSize, m_indexCount);
+		VkDeviceSize dstOffset = static_cast<VkDeviceSize>(indexSize) * m_indexRange.offset;
 
-		// Copy staging to vertex buffer.
-		m_device.CopyBuffer(stagingBuffer.GetBuffer(), m_indexBuffer->GetBuffer(), bufferSize);
+		m_uploadTicket = m_device.GetUploadManager().UploadToBuffer(m_indexRange.buffer, indexData, bufferSize, dstOffset);
 	}
 
 	UniqueRef<LveModel> LveModel::CreateCubeModel(LveDevice& device, Vector3 offset)
@@ -203,15 +315,28 @@ namespace lve
 			14, 12, 15, 13, 16, 17, 18, 16, 19, 17, 20, 21, 22, 20, 23, 21
 		};
 
+		modelBuilder.ComputeBounds();
+
 		return MakeUniqueRef<LveModel>(device, modelBuilder);
 	}
 
-	UniqueRef<LveModel> LveModel::CreateModelFromFile(LveDevice& device, const std::string& filepath)
+	UniqueRef<LveModel> LveModel::CreateModelFromFile(LveDevice& device, const std::string& filepath, VertexFormat vertexFormat)
 	{
+		LveMeshCache meshCache{};
+		if (meshCache.Open(filepath))
+		{
+			PRINT("Vertex count: %u", meshCache.GetVertexCount());
+			return MakeUniqueRef<LveModel>(device, meshCache, vertexFormat);
+		}
+
+		// Optimizing is part of the import, so its result is cached along with the mesh.
 		Builder builder{};
 		builder.LoadModel(filepath);
+		builder.Optimize();
 		PRINT("Vertex count: %zu", builder.vertices.size());
-		return MakeUniqueRef<LveModel>(device, builder);
+
+		LveMeshCache::Write(filepath, builder);
+		return MakeUniqueRef<LveModel>(device, builder, vertexFormat);
 	}
 
 	void LveModel::Builder::LoadModel(const std::string& filepath)
@@ -222,70 +347,159 @@ namespace lve
 		using tinyobj::shape_t;
 
 		attrib_t attrib;
-		std::vector<shape_t> shapes;
-		std::vector<material_t> materials;
-		std::string warn, error;
+		std::vector<index_t> objIndices;
 
-		if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &error, filepath.c_str()))
+		// Large triangle meshes are parsed on multiple threads. Anything the parallel loader does not handle goes
+		// through tinyobj, which produces the same attributes and indices.
+		bool isLoaded = false;
+		std::ifstream file(filepath, std::ios::ate | std::ios::binary);
+		if (file.is_open() && static_cast<USize>(file.tellg()) >= LveObjLoader::PARALLEL_MIN_FILE_SIZE)
 		{
-			ASSERT(false, "Failed to load model: %s", filepath.c_str());
+			file.close();
+			isLoaded = LveObjLoader::Load(filepath, attrib, objIndices);
+
+			if (isLoaded && LveObjLoader::VALIDATE_WITH_TINYOBJ && !LveObjLoader::MatchesTinyObj(filepath, attrib, objIndices))
+			{
+				PRINT("Parallel OBJ loader output differs from tinyobj, using tinyobj: %s", filepath.c_str());
+				attrib = attrib_t{};
+				isLoaded = false;
+			}
+		}
+
+		if (!isLoaded)
+		{
+			std::vector<shape_t> shapes;
+			std::vector<material_t> materials;
+			std::string warn, error;
+
+			if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &error, filepath.c_str()))
+			{
+				ASSERT(false, "Failed to load model: %s", filepath.c_str());
+			}
+
+			objIndices.clear();
+			for (const shape_t& shape : shapes)
+			{
+				objIndices.insert(objIndices.end(), shape.mesh.indices.begin(), shape.mesh.indices.end());
+			}
 		}
 
 		vertices.clear();
 		indices.clear();
 
-		// [Vertex: Index]
-		std::unordered_map<Vertex, U32> uniqueVertices{};
+		USize cornerCount = objIndices.size();
+
+		auto getCorner = [&attrib, &objIndices](U32 corner) {
+			const index_t& index = objIndices[corner];
+			Vertex vertex{};
 
-		for (const shape_t& shape : shapes)
+			if (index.vertex_index >= 0)
+			{
+				vertex.position = {
+					attrib.vertices[3 * index.vertex_index + 0],
+					attrib.vertices[3 * index.vertex_index + 1],
+					attrib.vertices[3 * index.vertex_index + 2]
+				};
+
+				vertex.color = {
+					attrib.colors[3 * index.vertex_index + 0],
+					attrib.colors[3 * index.vertex_index + 1],
+					attrib.colors[3 * index.vertex_index + 2]
+				};
+			}
+
+			if (index.normal_index >= 0)
+			{
+				vertex.normal = {
+					attrib.normals[3 * index.normal_index + 0],
+					attrib.normals[3 * index.normal_index + 1],
+					attrib.normals[3 * index.normal_index + 2]
+				};
+			}
+
+			if (index.texcoord_index >= 0)
+			{
+				vertex.uv = {
+					attrib.texcoords[2 * index.texcoord_index + 0],
+					attrib.texcoords[2 * index.texcoord_index + 1]
+				};
+			}
+
+			return vertex;
+		};
+
+		bool isSorting = weldMode == WeldMode::Sort ||
+			(weldMode == WeldMode::Auto && cornerCount >= LveVertexWelder::SORT_MIN_CORNER_COUNT);
+
+		if (isSorting)
+		{
+			// Corners are rebuilt from the attributes whenever they are needed instead of being stored.
+			LveVertexWelder::WeldSorted(cornerCount, getCorner, vertices, indices);
+		}
+		else
 		{
-			for (const index_t& index : shape.mesh.indices)
+			// Each corner is welded as it is built.
+			indices.reserve(cornerCount);
+			LveVertexWelder welder(cornerCount);
+
+			for (USize i = 0; i < cornerCount; i++)
 			{
-				Vertex vertex{};
-
-				if (index.vertex_index >= 0)
-				{
-					vertex.position = {
-						attrib.vertices[3 * index.vertex_index + 0],
-						attrib.vertices[3 * index.vertex_index + 1],
-						attrib.vertices[3 * index.vertex_index + 2]
-					};
-
-					vertex.color = {
-						attrib.colors[3 * index.vertex_index + 0],
-						attrib.colors[3 * index.vertex_index + 1],
-						attrib.colors[3 * index.vertex_index + 2]
-					};
-				}
-
-				if (index.normal_index >= 0)
-				{
-					vertex.normal = {
-						attrib.normals[3 * index.normal_index + 0],
-						attrib.normals[3 * index.normal_index + 1],
-						attrib.normals[3 * index.normal_index + 2]
-					};
-				}
-
-				if (index.texcoord_index >= 0)
-				{
-					vertex.uv = {
-						attrib.texcoords[2 * index.texcoord_index + 0],
-						attrib.texcoords[2 * index.texcoord_index + 1]
-					};
-				}
-
-				// Encounter new vertex. Only add to vertices when it is not yet added.
-				if (uniqueVertices.count(vertex) == 0)
-				{
-					U32 vertexIndex = static_cast<U32>(vertices.size());
-					uniqueVertices[vertex] = vertexIndex;
-					vertices.push_back(vertex);
-				}
-
-				indices.push_back(uniqueVertices[vertex]);
+				indices.push_back(welder.Weld(getCorner(static_cast<U32>(i)), vertices));
 			}
 		}
+
+		ComputeBounds();
+	}
+
+	void LveModel::Builder::ComputeBounds()
+	{
+		if (vertices.empty())
+		{
+			boundsMin = boundsMax = Vector3{ 0.0f };
+			boundingSphere = Vector4{ 0.0f };
+			return;
+		}
+
+		boundsMin = boundsMax = vertices[0].position;
+
+		for (const Vertex& vertex : vertices)
+		{
+			boundsMin = MathOp::Min(boundsMin, vertex.position);
+			boundsMax = MathOp::Max(boundsMax, vertex.position);
+		}
+
+		// Tighter than half the diagonal of the bounds for most meshes, e.g. round ones.
+		Vector3 center = (boundsMin + boundsMax) * 0.5f;
+		F32 radiusSquared = 0.0f;
+
+		for (const Vertex& vertex : vertices)
+		{
+			Vector3 offset = vertex.position - center;
+			radiusSquared = MathOp::Max(radiusSquared, MathOp::Dot(offset, offset));
+		}
+
+		boundingSphere = Vector4(center, std::sqrt(radiusSquared));
+	}
+
+	void LveModel::Builder::Optimize(bool optimizeOverdraw)
+	{
+		if (indices.empty())
+		{
+			return;
+		}
+
+		U32 vertexCount = static_cast<U32>(vertices.size());
+		F32 acmrBefore = LveMeshOptimizer::ComputeAcmr(indices, vertexCount);
+
+		LveMeshOptimizer::OptimizeVertexCache(indices, vertexCount);
+		if (optimizeOverdraw)
+		{
+			LveMeshOptimizer::OptimizeOverdraw(indices, vertices);
+		}
+		LveMeshOptimizer::OptimizeVertexFetch(vertices, indices);
+
+		F32 acmrAfter = LveMeshOptimizer::ComputeAcmr(indices, static_cast<U32>(vertices.size()));
+		PRINT("ACMR: %.3f -> %.3f", acmrBefore, acmrAfter);
 	}
 
 } // namespace lve
@@ -8,11 +8,15 @@
 
 #include "lve_device.h"
 #include "lve_buffer.h"
+#include "lve_upload_manager.h"
+#include "lve_geometry_pool.h"
 
 #include <vector>
 
 namespace lve
 {
+	class LveMeshCache;
+
 	class LveModel
 	{
 	public:
@@ -32,39 +36,122 @@ namespace lve
 			}
 		};
 
+		// Vertex layouts a model can be uploaded with. Each layout needs its own pipeline.
+		enum class VertexFormat
+		{
+			Standard,
+			Compact,
+		};
+
+		// Quantized vertex, 20 bytes instead of 44. Positions are snorm16 relative to the model bounds and must be
+		// transformed by GetDequantizeMatrix. Normals are octahedral-encoded snorm16, colors are unorm8 and uvs are halfs.
+		struct CompactVertex
+		{
+			I16 position[4]; // w is padding
+			I16 normal[2];
+			U8 color[4]; // a is padding
+			U16 uv[2];
+
+			static std::vector<VkVertexInputBindingDescription> GetBindingDescriptions();
+			static std::vector<VkVertexInputAttributeDescription> GetAttributeDescriptions();
+		};
+
 		struct Builder
 		{
+			enum class WeldMode
+			{
+				// Sort for meshes of LveVertexWelder::SORT_MIN_CORNER_COUNT corners or more, otherwise Hash.
+				Auto,
+				// Flat open-addressing table, one probe sequence per vertex.
+				Hash,
+				// Sorts all corners instead. Needs half the memory of the table, which helps with huge meshes.
+				Sort,
+			};
+
 			std::vector<Vertex> vertices{};
 			std::vector<U32> indices{};
 
+			// Axis-aligned bounds of the vertex positions in model space.
+			Vector3 boundsMin{ 0.0f };
+			Vector3 boundsMax{ 0.0f };
+			// Sphere around the vertex positions as (center, radius), centered on the bounds.
+			Vector4 boundingSphere{ 0.0f };
+
+			// How LoadModel merges identical vertices. All modes produce the same result.
+			WeldMode weldMode = WeldMode::Auto;
+
 			void LoadModel(const std::string& filepath);
+			void ComputeBounds();
+			// Reorders triangles for the vertex cache and optionally for overdraw, then vertices for fetch locality.
+			void Optimize(bool optimizeOverdraw = true);
 		};
 
-		LveModel(LveDevice& device, const Builder& builder);
+		LveModel(LveDevice& device, const Builder& builder, VertexFormat vertexFormat = VertexFormat::Standard);
+		LveModel(LveDevice& device, const LveMeshCache& meshCache, VertexFormat vertexFormat = VertexFormat::Standard);
 		~LveModel();
 
 		LveModel(const LveModel&) = delete;
 		LveModel& operator=(const LveModel&) = delete;
 
+		// Binds the pool buffers the model lives in. Models sharing buffers can skip this, see IsSharingBuffers.
 		void Bind(VkCommandBuffer commandBuffer);
-		void Draw(VkCommandBuffer commandBuffer);
+		void Draw(VkCommandBuffer commandBuffer, U32 instanceCount = 1, U32 firstInstance = 0);
 
 		static UniqueRef<LveModel> CreateCubeModel(LveDevice& device, Vector3 offset);
-		static UniqueRef<LveModel> CreateModelFromFile(LveDevice& device, const std::string& filepath);
+		// Loads the binary mesh cache of the file if it is up to date. Otherwise parses the file and writes the cache.
+		static UniqueRef<LveModel> CreateModelFromFile(LveDevice& device, const std::string& filepath,
+			VertexFormat vertexFormat = VertexFormat::Standard);
+
+		// Maps quantized positions back to model space. Identity for the standard format.
+		Matrix4 GetDequantizeMatrix() const;
+
+		// Getters
+		Vector3 GetBoundsMin() const { return m_boundsMin; }
+		Vector3 GetBoundsMax() const { return m_boundsMax; }
+		// Sphere around the vertex positions as (center, radius) in model space.
+		Vector4 GetBoundingSphere() const { return m_boundingSphere; }
+		VertexFormat GetVertexFormat() const { return m_vertexFormat; }
+		VkIndexType GetIndexType() const { return m_indexType; }
+		VkBuffer GetVertexBuffer() const { return m_vertexRange.buffer; }
+		VkBuffer GetIndexBuffer() const { return m_indexRange.buffer; }
+		// Offset of the first vertex and index in the pool buffers.
+		U32 GetVertexOffset() const { return m_vertexRange.offset; }
+		U32 GetFirstIndex() const { return m_indexRange.offset; }
+		U32 GetVertexCount() const { return m_vertexCount; }
+		U32 GetIndexCount() const { return m_indexCount; }
+		bool HasIndexBuffer() const { return m_hasIndexBuffer; }
+
+		// Whether a Bind of the other model also binds everything this model needs.
+		bool IsSharingBuffers(const LveModel& other) const
+		{
+			return GetVertexBuffer() == other.GetVertexBuffer() && GetIndexBuffer() == other.GetIndexBuffer() &&
+				   m_indexType == other.m_indexType;
+		}
 
 	private:
-		void CreateVertexBuffers(const std::vector<Vertex>& vertices);
-		void CreateIndexBuffers(const std::vector<U32>& indices);
+		void CreateVertexBuffers(const Vertex* vertices, U32 vertexCount);
+		void CreateIndexBuffers(const U32* indices, U32 indexCount);
 
 	private:
 		LveDevice& m_device;
 
-		UniqueRef<LveBuffer> m_vertexBuffer;
+		VertexFormat m_vertexFormat;
+		// Vertices and indices are sub-allocated from the device's geometry pool.
+		LveGeometryRange m_vertexRange{};
 		U32 m_vertexCount;
 
 		bool m_hasIndexBuffer = false;
-		UniqueRef<LveBuffer> m_indexBuffer;
+		LveGeometryRange m_indexRange{};
 		U32 m_indexCount;
+		// 16-bit indices are used when all vertices can be addressed by them.
+		VkIndexType m_indexType = VK_INDEX_TYPE_UINT32;
+
+		Vector3 m_boundsMin;
+		Vector3 m_boundsMax;
+		Vector4 m_boundingSphere;
+
+		// Buffers are uploaded asynchronously. The ticket is waited on before destroying them.
+		LveUploadManager::Ticket m_uploadTicket = 0;
 	};
 
 } // namespace lve
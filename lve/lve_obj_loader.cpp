@@ -0,0 +1,605 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/10/24.
+//
+
+#include "lve_obj_loader.h"
+
+#include "core/job_system.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+namespace lve
+{
+	/////////////////////////////////////////////////////////////////////////////////
+	// Local parsing functions (same number parsing as tinyobjloader)
+	/////////////////////////////////////////////////////////////////////////////////
+
+	static inline bool IsSpace(char c)
+	{
+		return c == ' ' || c == '\t';
+	}
+
+	static inline bool IsDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	static inline bool IsTokenEnd(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+	}
+
+	static inline void SkipSpaces(const char*& token, const char* end)
+	{
+		while (token < end && IsSpace(*token))
+		{
+			token++;
+		}
+	}
+
+	static inline const char* FindTokenEnd(const char* token, const char* end)
+	{
+		while (token < end && !IsTokenEnd(*token))
+		{
+			token++;
+		}
+		return token;
+	}
+
+	// Port of tinyobj's tryParseDouble. Accumulates in double with the same operations, so the resulting float is
+	// bit identical to what tinyobj produces.
+	static bool TryParseDouble(const char* s, const char* sEnd, double* result)
+	{
+		if (s >= sEnd)
+		{
+			return false;
+		}
+
+		double mantissa = 0.0;
+		int exponent = 0;
+		char sign = '+';
+		char exponentSign = '+';
+		const char* curr = s;
+		int read = 0;
+		bool endNotReached = false;
+		bool leadingDecimalDots = false;
+
+		// Sign
+		if (*curr == '+' || *curr == '-')
+		{
+			sign = *curr;
+			curr++;
+			if (curr != sEnd && *curr == '.')
+			{
+				leadingDecimalDots = true;
+			}
+		}
+		else if (IsDigit(*curr))
+		{
+		}
+		else if (*curr == '.')
+		{
+			leadingDecimalDots = true;
+		}
+		else
+		{
+			return false;
+		}
+
+		// Integer part
+		endNotReached = curr != sEnd;
+		if (!leadingDecimalDots)
+		{
+			while (endNotReached && IsDigit(*curr))
+			{
+				mantissa *= 10;
+				mantissa += static_cast<int>(*curr - 0x30);
+				curr++;
+				read++;
+				endNotReached = curr != sEnd;
+			}
+
+			if (read == 0)
+			{
+				return false;
+			}
+		}
+
+		if (!endNotReached)
+		{
+			*result = (sign == '+' ? 1 : -1) * mantissa;
+			return true;
+		}
+
+		// Decimal part
+		if (*curr == '.')
+		{
+			curr++;
+			read = 1;
+			endNotReached = curr != sEnd;
+			while (endNotReached && IsDigit(*curr))
+			{
+				static const double powLut[] = { 1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001 };
+				const int lutEntries = sizeof powLut / sizeof powLut[0];
+
+				mantissa += static_cast<int>(*curr - 0x30) * (read < lutEntries ? powLut[read] : std::pow(10.0, -read));
+				read++;
+				curr++;
+				endNotReached = curr != sEnd;
+			}
+		}
+		else if (*curr != 'e' && *curr != 'E')
+		{
+			*result = (sign == '+' ? 1 : -1) * mantissa;
+			return true;
+		}
+
+		// Exponent part
+		if (endNotReached && (*curr == 'e' || *curr == 'E'))
+		{
+			curr++;
+			endNotReached = curr != sEnd;
+			if (endNotReached && (*curr == '+' || *curr == '-'))
+			{
+				exponentSign = *curr;
+				curr++;
+			}
+			else if (endNotReached && IsDigit(*curr))
+			{
+			}
+			else
+			{
+				return false;
+			}
+
+			read = 0;
+			endNotReached = curr != sEnd;
+			while (endNotReached && IsDigit(*curr))
+			{
+				if (exponent > (2147483647 / 10))
+				{
+					return false;
+				}
+				exponent *= 10;
+				exponent += static_cast<int>(*curr - 0x30);
+				curr++;
+				read++;
+				endNotReached = curr != sEnd;
+			}
+
+			exponent *= (exponentSign == '+' ? 1 : -1);
+			if (read == 0)
+			{
+				return false;
+			}
+		}
+
+		*result = (sign == '+' ? 1 : -1) * (exponent ? std::ldexp(mantissa * std::pow(5.0, exponent), exponent) : mantissa);
+		return true;
+	}
+
+	// Same as tinyobj's parseReal. Returns false if there is no number, in which case value is left untouched.
+	static inline bool ParseReal(const char*& token, const char* end, tinyobj::real_t& value)
+	{
+		SkipSpaces(token, end);
+		const char* tokenEnd = FindTokenEnd(token, end);
+
+		double result;
+		bool parsed = TryParseDouble(token, tokenEnd, &result);
+		if (parsed)
+		{
+			value = static_cast<tinyobj::real_t>(result);
+		}
+
+		token = tokenEnd;
+		return parsed;
+	}
+
+	// Same as atoi, which tinyobj uses for face indices.
+	static inline int ParseInt(const char*& token, const char* end)
+	{
+		int sign = 1;
+		int value = 0;
+
+		if (token < end && (*token == '+' || *token == '-'))
+		{
+			sign = (*token == '-') ? -1 : 1;
+			token++;
+		}
+
+		while (token < end && IsDigit(*token))
+		{
+			value = value * 10 + (*token - '0');
+			token++;
+		}
+
+		return sign * value;
+	}
+
+	static inline void SkipToSeparator(const char*& token, const char* end)
+	{
+		while (token < end && *token != '/' && !IsTokenEnd(*token))
+		{
+			token++;
+		}
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	// Chunk parsing
+	/////////////////////////////////////////////////////////////////////////////////
+
+	// Bits marking an index that is relative to the attribute count of the chunk instead of absolute.
+	static constexpr U8 RELATIVE_VERTEX_BIT = BIT(0);
+	static constexpr U8 RELATIVE_TEXCOORD_BIT = BIT(1);
+	static constexpr U8 RELATIVE_NORMAL_BIT = BIT(2);
+
+	struct ObjChunk
+	{
+		std::vector<tinyobj::real_t> vertices;
+		std::vector<tinyobj::real_t> colors;
+		std::vector<tinyobj::real_t> normals;
+		std::vector<tinyobj::real_t> texcoords;
+
+		std::vector<tinyobj::index_t> indices;
+		std::vector<U8> relativeFlags;
+		bool hasRelativeIndices = false;
+
+		bool isSupported = true;
+	};
+
+	// Resolves an OBJ index (1-based, or negative relative to the current count) to a 0-based index.
+	// Negative indices are resolved against the chunk's local count and fixed up after merging.
+	static inline bool FixIndex(int index, USize localCount, int& result, U8& relativeFlags, U8 relativeBit)
+	{
+		if (index > 0)
+		{
+			result = index - 1;
+			return true;
+		}
+
+		if (index < 0)
+		{
+			result = static_cast<int>(localCount) + index;
+			relativeFlags |= relativeBit;
+			return true;
+		}
+
+		// Index 0 is invalid in OBJ.
+		return false;
+	}
+
+	static void ParseChunk(const char* begin, const char* end, ObjChunk& chunk)
+	{
+		const char* line = begin;
+
+		while (line < end && chunk.isSupported)
+		{
+			const char* lineEnd = std::find(line, end, '\n');
+			const char* token = line;
+			line = lineEnd + 1;
+
+			SkipSpaces(token, lineEnd);
+
+			if (token == lineEnd || *token == '#' || *token == '\r')
+			{
+				continue;
+			}
+
+			USize remaining = lineEnd - token;
+
+			// Vertex (x y z [r g b])
+			if (token[0] == 'v' && remaining > 1 && IsSpace(token[1]))
+			{
+				token += 2;
+
+				// Like tinyobj, a missing coordinate is 0 and colors are white unless all three are present.
+				tinyobj::real_t position[3] = { 0.0f, 0.0f, 0.0f };
+				for (tinyobj::real_t& value : position)
+				{
+					ParseReal(token, lineEnd, value);
+				}
+
+				tinyobj::real_t color[3] = { 0.0f, 0.0f, 0.0f };
+				bool hasColor = ParseReal(token, lineEnd, color[0]) && ParseReal(token, lineEnd, color[1]) &&
+								ParseReal(token, lineEnd, color[2]);
+				if (!hasColor)
+				{
+					color[0] = color[1] = color[2] = 1.0f;
+				}
+
+				chunk.vertices.insert(chunk.vertices.end(), position, position + 3);
+				chunk.colors.insert(chunk.colors.end(), color, color + 3);
+				continue;
+			}
+
+			// Normal (x y z)
+			if (token[0] == 'v' && remaining > 2 && token[1] == 'n' && IsSpace(token[2]))
+			{
+				token += 3;
+
+				tinyobj::real_t values[3] = { 0.0f, 0.0f, 0.0f };
+				for (tinyobj::real_t& value : values)
+				{
+					ParseReal(token, lineEnd, value);
+				}
+
+				chunk.normals.insert(chunk.normals.end(), values, values + 3);
+				continue;
+			}
+
+			// Texcoord (u v [w])
+			if (token[0] == 'v' && remaining > 2 && token[1] == 't' && IsSpace(token[2]))
+			{
+				token += 3;
+
+				tinyobj::real_t values[2] = { 0.0f, 0.0f };
+				for (tinyobj::real_t& value : values)
+				{
+					ParseReal(token, lineEnd, value);
+				}
+
+				chunk.texcoords.insert(chunk.texcoords.end(), values, values + 2);
+				continue;
+			}
+
+			// Face (v, v/t, v//n or v/t/n)
+			if (token[0] == 'f' && remaining > 1 && IsSpace(token[1]))
+			{
+				token += 2;
+				SkipSpaces(token, lineEnd);
+
+				int faceVertexCount = 0;
+
+				while (token < lineEnd && *token != '\r')
+				{
+					tinyobj::index_t index{ -1, -1, -1 };
+					U8 relativeFlags = 0;
+
+					bool isValid = FixIndex(ParseInt(token, lineEnd), chunk.vertices.size() / 3, index.vertex_index, relativeFlags,
+						RELATIVE_VERTEX_BIT);
+					SkipToSeparator(token, lineEnd);
+
+					if (token < lineEnd && *token == '/')
+					{
+						token++;
+
+						if (token < lineEnd && *token == '/')
+						{
+							// v//n
+							token++;
+							isValid = isValid && FixIndex(ParseInt(token, lineEnd), chunk.normals.size() / 3, index.normal_index,
+													 relativeFlags, RELATIVE_NORMAL_BIT);
+							SkipToSeparator(token, lineEnd);
+						}
+						else
+						{
+							// v/t or v/t/n
+							isValid = isValid && FixIndex(ParseInt(token, lineEnd), chunk.texcoords.size() / 2, index.texcoord_index,
+													 relativeFlags, RELATIVE_TEXCOORD_BIT);
+							SkipToSeparator(token, lineEnd);
+
+							if (token < lineEnd && *token == '/')
+							{
+								token++;
+								isValid = isValid && FixIndex(ParseInt(token, lineEnd), chunk.normals.size() / 3, index.normal_index,
+														 relativeFlags, RELATIVE_NORMAL_BIT);
+								SkipToSeparator(token, lineEnd);
+							}
+						}
+					}
+
+					if (!isValid)
+					{
+						chunk.isSupported = false;
+						break;
+					}
+
+					chunk.indices.push_back(index);
+					chunk.relativeFlags.push_back(relativeFlags);
+					chunk.hasRelativeIndices = chunk.hasRelativeIndices || relativeFlags != 0;
+
+					faceVertexCount++;
+					SkipSpaces(token, lineEnd);
+				}
+
+				// Polygons would need tinyobj's triangulation to produce identical output.
+				if (faceVertexCount != 3)
+				{
+					chunk.isSupported = false;
+				}
+				continue;
+			}
+
+			// Groups, objects, materials, smoothing groups, lines and points do not affect the triangle list.
+		}
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	// LveObjLoader
+	/////////////////////////////////////////////////////////////////////////////////
+
+	bool LveObjLoader::Load(const std::string& filepath, tinyobj::attrib_t& attrib, std::vector<tinyobj::index_t>& indices,
+		U32 chunkCount)
+	{
+		std::ifstream file(filepath, std::ios::ate | std::ios::binary);
+		if (!file.is_open())
+		{
+			return false;
+		}
+
+		USize fileSize = static_cast<USize>(file.tellg());
+		std::vector<char> buffer(fileSize);
+
+		file.seekg(0);
+		file.read(buffer.data(), fileSize);
+		file.close();
+
+		if (chunkCount == 0)
+		{
+			chunkCount = JobSystem::Get().GetThreadCount();
+		}
+
+		// Split into line-aligned chunks.
+		const char* data = buffer.data();
+		const char* dataEnd = data + fileSize;
+
+		std::vector<std::pair<const char*, const char*>> ranges;
+		const char* chunkBegin = data;
+		for (U32 i = 0; i < chunkCount && chunkBegin < dataEnd; i++)
+		{
+			const char* chunkEnd = (i == chunkCount - 1) ? dataEnd : std::min(dataEnd, data + fileSize * (i + 1) / chunkCount);
+			chunkEnd = std::find(chunkEnd, dataEnd, '\n');
+			chunkEnd = (chunkEnd < dataEnd) ? chunkEnd + 1 : dataEnd;
+
+			if (chunkEnd > chunkBegin)
+			{
+				ranges.emplace_back(chunkBegin, chunkEnd);
+			}
+			chunkBegin = chunkEnd;
+		}
+
+		// The calling thread parses chunks too while it waits.
+		std::vector<ObjChunk> chunks(ranges.size());
+		JobSystem::Get().ParallelFor(static_cast<U32>(ranges.size()), 1, [&](U32 begin, U32 end) {
+			for (U32 i = begin; i < end; i++)
+			{
+				ParseChunk(ranges[i].first, ranges[i].second, chunks[i]);
+			}
+		});
+
+		// Merge in file order.
+		USize vertexSize = 0, normalSize = 0, texcoordSize = 0, indexCount = 0;
+		for (const ObjChunk& chunk : chunks)
+		{
+			if (!chunk.isSupported)
+			{
+				return false;
+			}
+
+			vertexSize += chunk.vertices.size();
+			normalSize += chunk.normals.size();
+			texcoordSize += chunk.texcoords.size();
+			indexCount += chunk.indices.size();
+		}
+
+		attrib = tinyobj::attrib_t{};
+		attrib.vertices.reserve(vertexSize);
+		attrib.colors.reserve(vertexSize);
+		attrib.normals.reserve(normalSize);
+		attrib.texcoords.reserve(texcoordSize);
+
+		indices.clear();
+		indices.reserve(indexCount);
+
+		for (ObjChunk& chunk : chunks)
+		{
+			int vertexBase = static_cast<int>(attrib.vertices.size() / 3);
+			int normalBase = static_cast<int>(attrib.normals.size() / 3);
+			int texcoordBase = static_cast<int>(attrib.texcoords.size() / 2);
+
+			attrib.vertices.insert(attrib.vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+			attrib.colors.insert(attrib.colors.end(), chunk.colors.begin(), chunk.colors.end());
+			attrib.normals.insert(attrib.normals.end(), chunk.normals.begin(), chunk.normals.end());
+			attrib.texcoords.insert(attrib.texcoords.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+
+			if (chunk.hasRelativeIndices)
+			{
+				for (USize i = 0; i < chunk.indices.size(); i++)
+				{
+					U8 flags = chunk.relativeFlags[i];
+					tinyobj::index_t& index = chunk.indices[i];
+
+					index.vertex_index += (flags & RELATIVE_VERTEX_BIT) ? vertexBase : 0;
+					index.normal_index += (flags & RELATIVE_NORMAL_BIT) ? normalBase : 0;
+					index.texcoord_index += (flags & RELATIVE_TEXCOORD_BIT) ? texcoordBase : 0;
+
+					// A relative index larger than the count of everything before it is out of range. Check it here,
+					// because a result of -1 would otherwise read as a missing normal or texcoord.
+					if (((flags & RELATIVE_VERTEX_BIT) && index.vertex_index < 0) || ((flags & RELATIVE_NORMAL_BIT) && index.normal_index < 0) ||
+						((flags & RELATIVE_TEXCOORD_BIT) && index.texcoord_index < 0))
+					{
+						return false;
+					}
+				}
+			}
+
+			indices.insert(indices.end(), chunk.indices.begin(), chunk.indices.end());
+
+			// Release chunk memory early, large models can be several hundred megabytes.
+			chunk = ObjChunk{};
+		}
+
+		// Reject out of range indices, so that the caller never reads out of bounds. Resolved indices are never negative
+		// here, except -1 for a missing normal or texcoord.
+		int vertexCount = static_cast<int>(attrib.vertices.size() / 3);
+		int normalCount = static_cast<int>(attrib.normals.size() / 3);
+		int texcoordCount = static_cast<int>(attrib.texcoords.size() / 2);
+
+		for (const tinyobj::index_t& index : indices)
+		{
+			if (index.vertex_index < 0 || index.vertex_index >= vertexCount || index.normal_index >= normalCount ||
+				index.texcoord_index >= texcoordCount)
+			{
+				return false;
+			}
+		}
+
+		PRINT("Parsed %s in %zu chunks (%zu indices)", filepath.c_str(), ranges.size(), indices.size());
+		return true;
+	}
+
+	bool LveObjLoader::MatchesTinyObj(const std::string& filepath, const tinyobj::attrib_t& attrib,
+		const std::vector<tinyobj::index_t>& indices)
+	{
+		tinyobj::attrib_t expectedAttrib;
+		std::vector<tinyobj::shape_t> shapes;
+		std::vector<tinyobj::material_t> materials;
+		std::string warn, error;
+
+		if (!tinyobj::LoadObj(&expectedAttrib, &shapes, &materials, &warn, &error, filepath.c_str()))
+		{
+			PRINT("tinyobj failed to load %s", filepath.c_str());
+			return false;
+		}
+
+		if (attrib.vertices != expectedAttrib.vertices || attrib.colors != expectedAttrib.colors ||
+			attrib.normals != expectedAttrib.normals || attrib.texcoords != expectedAttrib.texcoords)
+		{
+			PRINT("Attributes of %s differ from tinyobj", filepath.c_str());
+			return false;
+		}
+
+		USize cornerIndex = 0;
+		for (const tinyobj::shape_t& shape : shapes)
+		{
+			for (const tinyobj::index_t& expected : shape.mesh.indices)
+			{
+				if (cornerIndex >= indices.size())
+				{
+					PRINT("%s has fewer indices than tinyobj", filepath.c_str());
+					return false;
+				}
+
+				const tinyobj::index_t& index = indices[cornerIndex];
+				if (index.vertex_index != expected.vertex_index || index.normal_index != expected.normal_index ||
+					index.texcoord_index != expected.texcoord_index)
+				{
+					PRINT("Index %zu of %s differs from tinyobj", cornerIndex, filepath.c_str());
+					return false;
+				}
+				cornerIndex++;
+			}
+		}
+
+		if (cornerIndex != indices.size())
+		{
+			PRINT("%s has more indices than tinyobj", filepath.c_str());
+			return false;
+		}
+
+		return true;
+	}
+
+} // namespace lve
@@ -0,0 +1,44 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/10/24.
+//
+
+#pragma once
+
+#include "core/core.h"
+
+#include <tiny_obj_loader.h>
+
+#include <string>
+#include <vector>
+
+namespace lve
+{
+	// Multithreaded OBJ parser for large triangle meshes.
+	//
+	// The file is split into line-aligned chunks that are parsed in parallel on the job system. Chunks are merged in file order and
+	// relative (negative) indices are resolved with the attribute counts of the preceding chunks, so the result is
+	// deterministic. Numbers are parsed exactly like tinyobjloader, so the output matches tinyobj::LoadObj with
+	// triangulation and default vertex colors, with the face indices of all shapes concatenated in file order.
+	class LveObjLoader
+	{
+	public:
+		// Files smaller than this are not worth splitting.
+		static constexpr USize PARALLEL_MIN_FILE_SIZE = 1024 * 1024;
+
+		// Also loads large files with tinyobj and uses its output if the two differ. This parses every large file twice,
+		// so it is off by default. The obj-loader-parity target checks the bundled models instead.
+		static constexpr bool VALIDATE_WITH_TINYOBJ = false;
+
+		// Returns false if the file could not be read, or if it uses something the loader does not handle
+		// (e.g. faces that are not triangles). The caller should fall back to tinyobj in that case.
+		// chunkCount = 0 uses one chunk per job system thread.
+		static bool Load(const std::string& filepath, tinyobj::attrib_t& attrib, std::vector<tinyobj::index_t>& indices,
+			U32 chunkCount = 0);
+
+		// Loads the file with tinyobj::LoadObj and returns whether it produced the same attributes and indices.
+		// Prints the first difference.
+		static bool MatchesTinyObj(const std::string& filepath, const tinyobj::attrib_t& attrib,
+			const std::vector<tinyobj::index_t>& indices);
+	};
+
+} // namespace lve
@@ -18,6 +18,12 @@ namespace lve
 		CreateGraphicsPipeline(vertFilepath, fragFilepath, configInfo);
 	}
 
+	LvePipeline::LvePipeline(LveDevice& device, const std::string& compFilepath, VkPipelineLayout pipelineLayout)
+		: m_device(device), m_bindPoint(VK_PIPELINE_BIND_POINT_COMPUTE)
+	{
+		CreateComputePipeline(compFilepath, pipelineLayout);
+	}
+
 	LvePipeline::~LvePipeline()
 	{
 		if (m_fragShaderModule != VK_NULL_HANDLE)
@@ -30,7 +36,10 @@ namespace lve
 			vkDestroyShaderModule(m_device.GetDevice(), m_vertShaderModule, nullptr);
 		}
 
-		vkDestroyPipeline(m_device.GetDevice(), m_graphicsPipeline, nullptr);
+		// Command buffers of frames in flight may still use the pipeline.
+		m_device.DeferDestruction([device = m_device.GetDevice(), pipeline = m_pipeline]() {
+			vkDestroyPipeline(device, pipeline, nullptr);
+		});
 	}
 
 	void LvePipeline::CreateGraphicsPipeline(const std::string& vertFilepath, const std::string& fragFilepath,
@@ -96,7 +105,7 @@ namespace lve
 		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
 		pipelineInfo.basePipelineIndex = -1;			  // Optional
 
-		VkResult result = vkCreateGraphicsPipelines(m_device.GetDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_graphicsPipeline);
+		VkResult result = vkCreateGraphicsPipelines(m_device.GetDevice(), m_device.GetPipelineCache(), 1, &pipelineInfo, nullptr, &m_pipeline);
 		ASSERT_EQ(result, VK_SUCCESS, "Failed to create graphics pipeline!");
 
 		// Cleanup shader modules after pipeline creation.
@@ -106,9 +115,52 @@ namespace lve
 		m_vertShaderModule = VK_NULL_HANDLE;
 	}
 
+	void LvePipeline::CreateComputePipeline(const std::string& compFilepath, VkPipelineLayout pipelineLayout)
+	{
+		ASSERT(pipelineLayout, "Could not create compute pipeline: No pipeline layout provided!");
+
+		std::vector<char> computeShaderCode = ReadFile(compFilepath);
+		VkShaderModule computeShaderModule;
+		CreateShaderModule(computeShaderCode, &computeShaderModule);
+
+		VkComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = computeShaderModule;
+		pipelineInfo.stage.pName = "main"; // entry point
+		pipelineInfo.layout = pipelineLayout;
+
+		VkResult result = vkCreateComputePipelines(m_device.GetDevice(), m_device.GetPipelineCache(), 1, &pipelineInfo, nullptr, &m_pipeline);
+		ASSERT_EQ(result, VK_SUCCESS, "Failed to create compute pipeline!");
+
+		vkDestroyShaderModule(m_device.GetDevice(), computeShaderModule, nullptr);
+	}
+
+	LvePipelineFuture::LvePipelineFuture(BuildFunc build)
+	{
+		JobSystem::Get().Submit([this, build = std::move(build)]() { m_pipeline = build(); }, &m_counter);
+	}
+
+	LvePipelineFuture::~LvePipelineFuture()
+	{
+		JobSystem::Get().Wait(m_counter);
+	}
+
+	LvePipeline& LvePipelineFuture::Get()
+	{
+		if (!m_counter.IsDone())
+		{
+			// Run other jobs, e.g. other pipeline builds, instead of blocking.
+			JobSystem::Get().Wait(m_counter);
+		}
+
+		return *m_pipeline;
+	}
+
 	void LvePipeline::Bind(VkCommandBuffer commandBuffer)
 	{
-		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+		vkCmdBindPipeline(commandBuffer, m_bindPoint, m_pipeline);
 	}
 
 	void LvePipeline::DefaultPipelineConfigInfo(PipelineConfigInfo& configInfo)
@@ -7,7 +7,10 @@
 #include "core/core.h"
 #include "lve_device.h"
 
+#include "core/job_system.h"
+
 #include <vector>
+#include <functional>
 
 namespace lve
 {
@@ -39,6 +42,8 @@ namespace lve
 	public:
 		LvePipeline(LveDevice& device, const std::string& vertFilepath, const std::string& fragFilepath,
 			const PipelineConfigInfo& configInfo);
+		// Compute pipeline
+		LvePipeline(LveDevice& device, const std::string& compFilepath, VkPipelineLayout pipelineLayout);
 		~LvePipeline();
 
 		LvePipeline(const LvePipeline&) = delete;
@@ -51,6 +56,7 @@ namespace lve
 	private:
 		void CreateGraphicsPipeline(const std::string& vertFilepath, const std::string& fragFilepath,
 			const PipelineConfigInfo& configInfo);
+		void CreateComputePipeline(const std::string& compFilepath, VkPipelineLayout pipelineLayout);
 
 		void CreateShaderModule(const std::vector<char>& code, VkShaderModule* pShaderModule);
 
@@ -58,9 +64,35 @@ namespace lve
 
 	private:
 		LveDevice& m_device;
-		VkPipeline m_graphicsPipeline;
-		VkShaderModule m_vertShaderModule;
-		VkShaderModule m_fragShaderModule;
+		VkPipeline m_pipeline;
+		VkPipelineBindPoint m_bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		VkShaderModule m_vertShaderModule = VK_NULL_HANDLE;
+		VkShaderModule m_fragShaderModule = VK_NULL_HANDLE;
+	};
+
+	// A pipeline that is built on the job system. Reading SPIR-V, creating shader modules and compiling all happen in
+	// the build function on a worker, so pipelines created one after another are built at the same time.
+	// Get waits for the build if it has not finished yet, so systems only block when they first use the pipeline.
+	class LvePipelineFuture
+	{
+	public:
+		using BuildFunc = std::function<UniqueRef<LvePipeline>()>;
+
+		// The build function runs on another thread. Anything it references must stay alive until the build finishes.
+		explicit LvePipelineFuture(BuildFunc build);
+		// Waits for the build, so it never writes to a destroyed future.
+		~LvePipelineFuture();
+
+		LvePipelineFuture(const LvePipelineFuture&) = delete;
+		LvePipelineFuture& operator=(const LvePipelineFuture&) = delete;
+
+		bool IsReady() const { return m_counter.IsDone(); }
+		// Safe to call from several threads.
+		LvePipeline& Get();
+
+	private:
+		UniqueRef<LvePipeline> m_pipeline;
+		JobCounter m_counter;
 	};
 
 } // namespace lve
@@ -0,0 +1,362 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/18/24.
+//
+
+#pragma once
+
+#include "core/core.h"
+
+#include <mutex>
+#include <shared_mutex>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace lve
+{
+	// Generational handle. The index addresses a slot that is reused once the entity is destroyed, and the generation
+	// tells the old and the new occupant of a slot apart, so stale handles are detected instead of aliasing.
+	struct LveEntity
+	{
+		U32 index = ~0u;
+		U32 generation = 0;
+
+		bool operator==(const LveEntity& other) const { return index == other.index && generation == other.generation; }
+		bool operator!=(const LveEntity& other) const { return !(*this == other); }
+	};
+
+	inline constexpr LveEntity INVALID_ENTITY{};
+
+	/////////////////////////////////////////////////////////////////////////////////
+	// LveComponentPool
+	/////////////////////////////////////////////////////////////////////////////////
+
+	class LveComponentPoolBase
+	{
+	public:
+		virtual ~LveComponentPoolBase() = default;
+
+		// Does nothing if the entity does not have the component.
+		virtual void Remove(LveEntity entity) = 0;
+
+		// Changes whenever components are added, removed or reordered. Pointers to components and dense indices stay
+		// valid as long as the version does not change.
+		U32 GetVersion() const { return m_version; }
+
+	protected:
+		U32 m_version = 0;
+	};
+
+	// Sparse set of one component type. Components are packed in a dense array, so iterating over them streams
+	// through memory. A sparse array maps entity indices to dense indices. Removing swaps the last component into the
+	// gap. Since entity indices are reused, the sparse array only grows to the peak number of live entities.
+	template <typename T>
+	class LveComponentPool : public LveComponentPoolBase
+	{
+	public:
+		static constexpr U32 INVALID_INDEX = ~0u;
+
+		USize Size() const { return m_components.size(); }
+		T* Data() { return m_components.data(); }
+		const T* Data() const { return m_components.data(); }
+		LveEntity GetEntity(USize index) const { return m_entities[index]; }
+		const std::vector<LveEntity>& GetEntities() const { return m_entities; }
+
+		// The full handle is compared, so a stale handle does not find the component of the slot's new occupant.
+		bool Has(LveEntity entity) const
+		{
+			return entity.index < m_sparse.size() && m_sparse[entity.index] != INVALID_INDEX &&
+				   m_entities[m_sparse[entity.index]] == entity;
+		}
+
+		U32 GetIndex(LveEntity entity) const { return Has(entity) ? m_sparse[entity.index] : INVALID_INDEX; }
+
+		T& Get(LveEntity entity)
+		{
+			ASSERT(Has(entity), "Entity does not have the component!");
+			return m_components[m_sparse[entity.index]];
+		}
+
+		T* TryGet(LveEntity entity) { return Has(entity) ? &m_components[m_sparse[entity.index]] : nullptr; }
+
+		template <typename... Args>
+		T& Add(LveEntity entity, Args&&... args)
+		{
+			ASSERT(!Has(entity), "Entity already has the component!");
+
+			if (entity.index >= m_sparse.size())
+			{
+				m_sparse.resize(static_cast<USize>(entity.index) + 1, INVALID_INDEX);
+			}
+
+			// Has compares the full handle, so a stale handle gets here even if the slot's new occupant has the component.
+			// Writing the slot would then take the component away from the new occupant.
+			ASSERT(m_sparse[entity.index] == INVALID_INDEX, "Entity slot is used by another entity, the handle is stale!");
+
+			m_sparse[entity.index] = static_cast<U32>(m_components.size());
+			m_entities.push_back(entity);
+			m_components.push_back(T{ std::forward<Args>(args)... });
+			++m_version;
+
+			return m_components.back();
+		}
+
+		void Remove(LveEntity entity) override
+		{
+			if (!Has(entity))
+			{
+				return;
+			}
+
+			U32 index = m_sparse[entity.index];
+			U32 lastIndex = static_cast<U32>(m_components.size()) - 1;
+
+			if (index != lastIndex)
+			{
+				m_components[index] = std::move(m_components[lastIndex]);
+				m_entities[index] = m_entities[lastIndex];
+				m_sparse[m_entities[index].index] = index;
+			}
+
+			m_components.pop_back();
+			m_entities.pop_back();
+			m_sparse[entity.index] = INVALID_INDEX;
+			++m_version;
+		}
+
+		// Moves the component of entities[i] to dense index i. entities must contain every entity in the pool once.
+		void Reorder(const std::vector<LveEntity>& entities)
+		{
+			ASSERT(entities.size() == m_entities.size(), "Reorder needs every entity of the pool!");
+
+			std::vector<T> components;
+			components.reserve(m_components.size());
+
+			for (LveEntity entity : entities)
+			{
+				components.push_back(std::move(m_components[m_sparse[entity.index]]));
+			}
+
+			for (U32 i = 0; i < static_cast<U32>(entities.size()); ++i)
+			{
+				m_sparse[entities[i].index] = i;
+			}
+
+			m_components = std::move(components);
+			m_entities = entities;
+			++m_version;
+		}
+
+	private:
+		std::vector<U32> m_sparse;
+		std::vector<LveEntity> m_entities;
+		std::vector<T> m_components;
+	};
+
+	/////////////////////////////////////////////////////////////////////////////////
+	// LveView
+	/////////////////////////////////////////////////////////////////////////////////
+
+	// Entities that have all of the given components. Iteration walks the dense array of the first component and
+	// looks the others up, so the first component should be the rarest one.
+	template <typename T, typename... Others>
+	class LveView
+	{
+	public:
+		LveView(LveComponentPool<T>& pool, LveComponentPool<Others>&... others)
+			: m_pool(pool), m_others(&others...)
+		{
+		}
+
+		// Calls func(entity, T&, Others&...) for each entity.
+		template <typename Func>
+		void Each(Func&& func)
+		{
+			T* components = m_pool.Data();
+
+			for (USize i = 0; i < m_pool.Size(); ++i)
+			{
+				LveEntity entity = m_pool.GetEntity(i);
+
+				std::apply(
+					[&](auto*... others) {
+						if ((others->Has(entity) && ...))
+						{
+							func(entity, components[i], others->Get(entity)...);
+						}
+					},
+					m_others);
+			}
+		}
+
+	private:
+		LveComponentPool<T>& m_pool;
+		std::tuple<LveComponentPool<Others>*...> m_others;
+	};
+
+	/////////////////////////////////////////////////////////////////////////////////
+	// LveRegistry
+	/////////////////////////////////////////////////////////////////////////////////
+
+	namespace Detail
+	{
+		inline U32 NextComponentTypeId()
+		{
+			static U32 nextId = 0;
+			return nextId++;
+		}
+
+		template <typename T>
+		U32 GetComponentTypeId()
+		{
+			static const U32 typeId = NextComponentTypeId();
+			return typeId;
+		}
+	} // namespace Detail
+
+	// Owns entities and their components. Each component type lives in its own pool, which is created on first use.
+	//
+	// Entity slots are recycled through a free list, so creating and destroying entities is O(1) and memory stays
+	// bounded by the peak number of live entities. Creating entities and checking handles is thread-safe. Component
+	// access and DestroyEntity are not, and must not run concurrently with each other.
+	class LveRegistry
+	{
+	public:
+		LveRegistry() = default;
+
+		LveRegistry(const LveRegistry&) = delete;
+		LveRegistry& operator=(const LveRegistry&) = delete;
+
+		LveEntity CreateEntity()
+		{
+			std::unique_lock lock(m_entityMutex);
+			return AllocateEntity();
+		}
+
+		// Creates count entities under a single lock.
+		void CreateEntities(U32 count, LveEntity* outEntities)
+		{
+			std::unique_lock lock(m_entityMutex);
+			for (U32 i = 0; i < count; ++i)
+			{
+				outEntities[i] = AllocateEntity();
+			}
+		}
+
+		// Removes all components of the entity and releases its slot. Does nothing for stale handles.
+		void DestroyEntity(LveEntity entity)
+		{
+			if (!IsValid(entity))
+			{
+				return;
+			}
+
+			for (UniqueRef<LveComponentPoolBase>& pool : m_pools)
+			{
+				if (pool)
+				{
+					pool->Remove(entity);
+				}
+			}
+
+			std::unique_lock lock(m_entityMutex);
+			++m_generations[entity.index];
+			m_freeIndices.push_back(entity.index);
+		}
+
+		// False once the entity has been destroyed, even if its slot was reused.
+		bool IsValid(LveEntity entity) const
+		{
+			std::shared_lock lock(m_entityMutex);
+			return entity.index < m_generations.size() && m_generations[entity.index] == entity.generation;
+		}
+
+		U32 GetEntityCount() const
+		{
+			std::shared_lock lock(m_entityMutex);
+			return static_cast<U32>(m_generations.size() - m_freeIndices.size());
+		}
+
+		// AddComponent and GetComponent need a live entity. RemoveComponent, HasComponent and TryGetComponent accept stale
+		// handles and treat them as entities without components, since pools compare the full handle.
+		template <typename T, typename... Args>
+		T& AddComponent(LveEntity entity, Args&&... args)
+		{
+			ASSERT(IsValid(entity), "Cannot add a component to a destroyed entity!");
+			return GetPool<T>().Add(entity, std::forward<Args>(args)...);
+		}
+
+		template <typename T>
+		void RemoveComponent(LveEntity entity)
+		{
+			GetPool<T>().Remove(entity);
+		}
+
+		template <typename T>
+		bool HasComponent(LveEntity entity)
+		{
+			return GetPool<T>().Has(entity);
+		}
+
+		template <typename T>
+		T& GetComponent(LveEntity entity)
+		{
+			ASSERT(IsValid(entity), "Cannot get a component of a destroyed entity!");
+			return GetPool<T>().Get(entity);
+		}
+
+		template <typename T>
+		T* TryGetComponent(LveEntity entity)
+		{
+			return GetPool<T>().TryGet(entity);
+		}
+
+		template <typename T>
+		LveComponentPool<T>& GetPool()
+		{
+			U32 typeId = Detail::GetComponentTypeId<T>();
+
+			if (typeId >= m_pools.size())
+			{
+				m_pools.resize(static_cast<USize>(typeId) + 1);
+			}
+
+			if (!m_pools[typeId])
+			{
+				m_pools[typeId] = MakeUniqueRef<LveComponentPool<T>>();
+			}
+
+			return static_cast<LveComponentPool<T>&>(*m_pools[typeId]);
+		}
+
+		template <typename T, typename... Others>
+		LveView<T, Others...> View()
+		{
+			return LveView<T, Others...>(GetPool<T>(), GetPool<Others>()...);
+		}
+
+	private:
+		// Caller holds m_entityMutex.
+		LveEntity AllocateEntity()
+		{
+			if (!m_freeIndices.empty())
+			{
+				U32 index = m_freeIndices.back();
+				m_freeIndices.pop_back();
+				return { index, m_generations[index] };
+			}
+
+			m_generations.push_back(0);
+			return { static_cast<U32>(m_generations.size()) - 1, 0 };
+		}
+
+	private:
+		// Current generation of every slot. Live entities carry the generation of their slot.
+		std::vector<U32> m_generations;
+		std::vector<U32> m_freeIndices;
+		mutable std::shared_mutex m_entityMutex;
+
+		std::vector<UniqueRef<LveComponentPoolBase>> m_pools;
+	};
+
+} // namespace lve
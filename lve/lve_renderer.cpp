@@ -4,20 +4,27 @@
 
 #include "lve_renderer.h"
 
+#include "lve_upload_manager.h"
+
+#include "core/job_system.h"
+
 namespace lve
 {
-	LveRenderer::LveRenderer(LveWindow& window, LveDevice& device)
-		: m_window(window), m_device(device)
+	LveRenderer::LveRenderer(LveWindow& window, LveDevice& device, const LveSwapchainConfig& swapchainConfig)
+		: m_window(window), m_device(device), m_swapchainConfig(swapchainConfig)
 	{
 		RecreateSwapchain();
 
 		// For now, the command buffers are created once and will be reused in frames.
-		CreateCommandBuffers();
+		CreateCommandPools();
+
+		StartLatencyThread();
 	}
 
 	LveRenderer::~LveRenderer()
 	{
-		FreeCommandBuffers();
+		StopLatencyThread();
+		DestroyCommandPools();
 	}
 
 	/////////////////////////////////////////////////////////////////////////////////
@@ -34,8 +41,21 @@ namespace lve
 		// 3. Present that image to the screen for presentation, returning it to the swapchain.
 		// The function calls will return before the operations are actually finished and the order of execution is also undefined.
 
+		// Display times of earlier frames, if the device reports them.
+		CollectPresentTimings();
+
 		VkResult acquireResult = m_swapchain->AcquireNextImage(&m_currentImageIndex);
 
+		// Acquiring waited for the fence of this frame slot, last used one frames-in-flight count ago. That frame and
+		// all earlier ones are done, so resources they used can be destroyed.
+		U32 framesInFlight = GetFramesInFlight();
+		U64 completedFrameCount = m_frameNumber >= framesInFlight ? m_frameNumber - framesInFlight + 1 : 0;
+		m_device.CollectDeletions(completedFrameCount);
+		m_device.SetCurrentFrameNumber(m_frameNumber);
+
+		// Reclaim staging memory of finished uploads.
+		m_device.GetUploadManager().Update();
+
 		if (acquireResult == VK_ERROR_OUT_OF_DATE_KHR)
 		{
 			RecreateSwapchain();
@@ -48,6 +68,14 @@ namespace lve
 		}
 
 		m_isFrameStarted = true;
+		m_frameBeginTime = LatencyClock::now();
+
+		// Acquiring waited for the frame's fence, so the GPU is done with its command buffers.
+		for (RecorderPool& recorderPool : m_recorderPools[m_currentFrameIndex])
+		{
+			vkResetCommandPool(m_device.GetDevice(), recorderPool.commandPool, 0);
+			recorderPool.usedSecondaryCount = 0;
+		}
 
 		VkCommandBuffer commandBuffer = GetCurrentCommandBuffer(); // based on m_currentFrameIndex
 
@@ -70,8 +98,32 @@ namespace lve
 		VkResult endResult = vkEndCommandBuffer(commandBuffer);
 		ASSERT_EQ(endResult, VK_SUCCESS, "Failed to end command buffer!");
 
+		// Submit pending uploads first, so the frame sees them on the same queue.
+		m_device.GetUploadManager().Submit();
+
+		LatencyClock::time_point inputTime = m_isInputSampled ? m_inputTime : m_frameBeginTime;
+		LatencyClock::time_point submitTime = LatencyClock::now();
+		m_isInputSampled = false;
+
+		// Present IDs must not be zero. Their submit times are kept for CollectPresentTimings.
+		U32 presentId = static_cast<U32>(m_frameNumber % UINT32_MAX) + 1;
+		m_presentRecords[presentId % PRESENT_HISTORY_SIZE] = { presentId, submitTime };
+
 		// Submit command buffer.
-		VkResult submitResult = m_swapchain->SubmitCommandBuffers(&commandBuffer, &m_currentImageIndex);
+		VkResult submitResult = m_swapchain->SubmitCommandBuffers(&commandBuffer, &m_currentImageIndex, presentId);
+
+		TrackGpuCompletion(m_currentFrameIndex, submitTime);
+
+		{
+			std::lock_guard<std::mutex> lock(m_latencyMutex);
+
+			F32 inputToSubmit = std::chrono::duration<F32, std::milli>(submitTime - inputTime).count();
+			F32 weight = m_latencyStats.submitCount == 0 ? 1.0f : LATENCY_AVERAGE_WEIGHT;
+
+			m_latencyStats.inputToSubmit = inputToSubmit;
+			m_latencyStats.averageInputToSubmit += (inputToSubmit - m_latencyStats.averageInputToSubmit) * weight;
+			m_latencyStats.submitCount++;
+		}
 
 		if (submitResult == VK_ERROR_OUT_OF_DATE_KHR || submitResult == VK_SUBOPTIMAL_KHR || m_window.WasWindowResized())
 		{
@@ -85,10 +137,122 @@ namespace lve
 
 		// Currently renderer and swapchain manages separate frame indices, but they are always identical.
 		m_isFrameStarted = false;
-		m_currentFrameIndex = (m_currentFrameIndex + 1) % LveSwapchain::MAX_FRAMES_IN_FLIGHT;
+		m_currentFrameIndex = (m_currentFrameIndex + 1) % GetFramesInFlight();
+		m_device.SetCurrentFrameNumber(++m_frameNumber);
 	}
 
-	void LveRenderer::BeginSwapchainRenderPass(VkCommandBuffer commandBuffer)
+	void LveRenderer::MarkInputSampled()
+	{
+		m_inputTime = LatencyClock::now();
+		m_isInputSampled = true;
+	}
+
+	LveRenderer::LatencyStats LveRenderer::GetLatencyStats() const
+	{
+		std::lock_guard<std::mutex> lock(m_latencyMutex);
+		return m_latencyStats;
+	}
+
+	void LveRenderer::TrackGpuCompletion(U32 fenceIndex, LatencyClock::time_point submitTime)
+	{
+		{
+			// The latency thread has not seen the previous frame of this slot finish yet. Skip this frame rather than wait.
+			std::lock_guard<std::mutex> lock(m_latencyMutex);
+			if (m_isLatencyFenceBusy[fenceIndex])
+			{
+				return;
+			}
+			m_isLatencyFenceBusy[fenceIndex] = true;
+		}
+
+		// Not busy, so the latency thread is not waiting on the fence.
+		VkFence fence = m_latencyFences[fenceIndex];
+		vkResetFences(m_device.GetDevice(), 1, &fence);
+
+		{
+			// A submission without command buffers signals its fence once all earlier submissions on the queue are done.
+			std::lock_guard<std::mutex> queueLock(m_device.GetQueueMutex());
+			VkResult result = vkQueueSubmit(m_device.GetGraphicsQueue(), 0, nullptr, fence);
+			ASSERT_EQ(result, VK_SUCCESS, "Failed to submit latency fence!");
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_latencyMutex);
+			m_pendingGpuTimings.push_back({ fenceIndex, submitTime });
+		}
+		m_latencyCondition.notify_one();
+	}
+
+	void LveRenderer::LatencyThreadLoop()
+	{
+		while (true)
+		{
+			PendingGpuTiming pending{};
+			{
+				std::unique_lock<std::mutex> lock(m_latencyMutex);
+				m_latencyCondition.wait(lock, [this]() { return !m_pendingGpuTimings.empty() || m_isLatencyThreadStopping; });
+
+				// Pending fences are drained before stopping. They always signal, since they only wait for submitted work.
+				if (m_pendingGpuTimings.empty())
+				{
+					return;
+				}
+
+				pending = m_pendingGpuTimings.front();
+				m_pendingGpuTimings.pop_front();
+			}
+
+			VkFence fence = m_latencyFences[pending.fenceIndex];
+			vkWaitForFences(m_device.GetDevice(), 1, &fence, VK_TRUE, UINT64_MAX);
+			F32 submitToGpuComplete = std::chrono::duration<F32, std::milli>(LatencyClock::now() - pending.submitTime).count();
+
+			std::lock_guard<std::mutex> lock(m_latencyMutex);
+
+			F32 weight = m_latencyStats.gpuCompleteCount == 0 ? 1.0f : LATENCY_AVERAGE_WEIGHT;
+			m_latencyStats.submitToGpuComplete = submitToGpuComplete;
+			m_latencyStats.averageSubmitToGpuComplete += (submitToGpuComplete - m_latencyStats.averageSubmitToGpuComplete) * weight;
+			m_latencyStats.gpuCompleteCount++;
+
+			m_isLatencyFenceBusy[pending.fenceIndex] = false;
+		}
+	}
+
+	void LveRenderer::CollectPresentTimings()
+	{
+		if (!m_device.IsDisplayTimingEnabled())
+		{
+			return;
+		}
+
+		m_presentTimings.clear();
+		m_swapchain->GetPastPresentationTimings(m_presentTimings);
+
+		std::lock_guard<std::mutex> lock(m_latencyMutex);
+
+		for (const VkPastPresentationTimingGOOGLE& timing : m_presentTimings)
+		{
+			// The record was overwritten by a newer present.
+			const PresentRecord& record = m_presentRecords[timing.presentID % PRESENT_HISTORY_SIZE];
+			if (record.presentId != timing.presentID)
+			{
+				continue;
+			}
+
+			// actualPresentTime is in nanoseconds of the presentation engine's clock. On the platforms that implement the
+			// extension, that is the system's monotonic clock (CLOCK_MONOTONIC, or mach absolute time on Apple), which
+			// is also what steady_clock reads.
+			LatencyClock::time_point presentTime{ std::chrono::duration_cast<LatencyClock::duration>(
+				std::chrono::nanoseconds(timing.actualPresentTime)) };
+			F32 submitToPresent = std::chrono::duration<F32, std::milli>(presentTime - record.submitTime).count();
+
+			F32 weight = m_latencyStats.presentCount == 0 ? 1.0f : LATENCY_AVERAGE_WEIGHT;
+			m_latencyStats.submitToPresent = submitToPresent;
+			m_latencyStats.averageSubmitToPresent += (submitToPresent - m_latencyStats.averageSubmitToPresent) * weight;
+			m_latencyStats.presentCount++;
+		}
+	}
+
+	void LveRenderer::BeginSwapchainRenderPass(VkCommandBuffer commandBuffer, VkSubpassContents contents)
 	{
 		ASSERT(m_isFrameStarted, "Could not begin render pass while frame is not in progress!");
 		ASSERT(commandBuffer == GetCurrentCommandBuffer(), "Could not begin render pass on command buffer from a different frame!");
@@ -97,7 +261,7 @@ namespace lve
 		VkRenderPassBeginInfo renderPassBeginInfo{};
 		renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 		renderPassBeginInfo.renderPass = m_swapchain->GetRenderPass();
-		renderPassBeginInfo.framebuffer = m_swapchain->GetFramebuffer(m_currentImageIndex);
+		renderPassBeginInfo.framebuffer = m_swapchain->GetFramebuffer(m_currentImageIndex, m_currentFrameIndex);
 
 		renderPassBeginInfo.renderArea.offset = { 0, 0 };
 		renderPassBeginInfo.renderArea.extent = m_swapchain->GetSwapchainExtent();
@@ -109,8 +273,75 @@ namespace lve
 		renderPassBeginInfo.clearValueCount = static_cast<U32>(clearValues.size());
 		renderPassBeginInfo.pClearValues = clearValues.data();
 
-		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, contents);
+		m_subpassContents = contents;
+
+		// Secondary command buffers do not inherit dynamic state and set it themselves.
+		if (contents == VK_SUBPASS_CONTENTS_INLINE)
+		{
+			SetViewportAndScissor(commandBuffer);
+		}
+	}
 
+	void LveRenderer::EndSwapchainRenderPass(VkCommandBuffer commandBuffer)
+	{
+		ASSERT(m_isFrameStarted, "Could not end render pass while frame is not in progress!");
+		ASSERT(commandBuffer == GetCurrentCommandBuffer(), "Could not end render pass on command buffer from a different frame!");
+
+		vkCmdEndRenderPass(commandBuffer);
+		m_subpassContents = VK_SUBPASS_CONTENTS_INLINE;
+	}
+
+	VkCommandBuffer LveRenderer::BeginSecondaryCommandBuffer(U32 recorderIndex)
+	{
+		ASSERT(m_isFrameStarted, "Could not begin secondary command buffer while frame is not in progress!");
+		ASSERT(recorderIndex < m_recorderCount, "Recorder index is out of range!");
+
+		RecorderPool& recorderPool = m_recorderPools[m_currentFrameIndex][recorderIndex];
+
+		if (recorderPool.usedSecondaryCount == recorderPool.secondaryCommandBuffers.size())
+		{
+			VkCommandBufferAllocateInfo bufferInfo{};
+			bufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			bufferInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			bufferInfo.commandPool = recorderPool.commandPool;
+			bufferInfo.commandBufferCount = 1;
+
+			VkCommandBuffer newCommandBuffer;
+			VkResult result = vkAllocateCommandBuffers(m_device.GetDevice(), &bufferInfo, &newCommandBuffer);
+			ASSERT_EQ(result, VK_SUCCESS, "Failed to create secondary command buffer!");
+			recorderPool.secondaryCommandBuffers.push_back(newCommandBuffer);
+		}
+
+		VkCommandBuffer commandBuffer = recorderPool.secondaryCommandBuffers[recorderPool.usedSecondaryCount++];
+
+		VkCommandBufferInheritanceInfo inheritanceInfo{};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = m_swapchain->GetRenderPass();
+		inheritanceInfo.subpass = 0;
+		inheritanceInfo.framebuffer = m_swapchain->GetFramebuffer(m_currentImageIndex, m_currentFrameIndex);
+
+		VkCommandBufferBeginInfo bufferBeginInfo{};
+		bufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		bufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		bufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		VkResult beginResult = vkBeginCommandBuffer(commandBuffer, &bufferBeginInfo);
+		ASSERT_EQ(beginResult, VK_SUCCESS, "Failed to begin recording secondary command buffer!");
+
+		SetViewportAndScissor(commandBuffer);
+
+		return commandBuffer;
+	}
+
+	void LveRenderer::EndSecondaryCommandBuffer(VkCommandBuffer commandBuffer)
+	{
+		VkResult endResult = vkEndCommandBuffer(commandBuffer);
+		ASSERT_EQ(endResult, VK_SUCCESS, "Failed to end secondary command buffer!");
+	}
+
+	void LveRenderer::SetViewportAndScissor(VkCommandBuffer commandBuffer)
+	{
 		// Dynamic viewport and scissor
 		VkViewport viewport{};
 		viewport.x = 0.0f;
@@ -127,39 +358,95 @@ namespace lve
 		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 	}
 
-	void LveRenderer::EndSwapchainRenderPass(VkCommandBuffer commandBuffer)
-	{
-		ASSERT(m_isFrameStarted, "Could not end render pass while frame is not in progress!");
-		ASSERT(commandBuffer == GetCurrentCommandBuffer(), "Could not end render pass on command buffer from a different frame!");
-
-		vkCmdEndRenderPass(commandBuffer);
-	}
-
 	/////////////////////////////////////////////////////////////////////////////////
 	// Functions to create Vulkan resources.
 	/////////////////////////////////////////////////////////////////////////////////
 
-	void LveRenderer::CreateCommandBuffers()
+	void LveRenderer::CreateCommandPools()
 	{
-		m_commandBuffers.resize(LveSwapchain::MAX_FRAMES_IN_FLIGHT); // 2
+		// One recorder per job system thread.
+		m_recorderCount = JobSystem::Get().GetThreadCount();
+
+		QueueFamilyIndices queueFamilyIndices = m_device.FindPhysicalQueueFamilies();
+
+		VkCommandPoolCreateInfo poolCreateInfo{};
+		poolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolCreateInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+		// Pools are reset as a whole, and command buffers are re-recorded every frame.
+		poolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
 
-		VkCommandBufferAllocateInfo bufferInfo{};
-		bufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		bufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		bufferInfo.commandPool = m_device.GetCommandPool();
-		bufferInfo.commandBufferCount = static_cast<U32>(m_commandBuffers.size());
+		m_recorderPools.resize(GetFramesInFlight());
+		for (std::vector<RecorderPool>& frameRecorderPools : m_recorderPools)
+		{
+			frameRecorderPools.resize(m_recorderCount);
+			for (RecorderPool& recorderPool : frameRecorderPools)
+			{
+				VkResult result = vkCreateCommandPool(m_device.GetDevice(), &poolCreateInfo, nullptr, &recorderPool.commandPool);
+				ASSERT_EQ(result, VK_SUCCESS, "Failed to create command pool!");
+			}
+		}
 
-		VkResult result = vkAllocateCommandBuffers(m_device.GetDevice(), &bufferInfo, m_commandBuffers.data());
-		ASSERT_EQ(result, VK_SUCCESS, "Failed to create command buffers!");
+		// One primary command buffer per frame, from the frame's first pool.
+		m_commandBuffers.resize(GetFramesInFlight());
+
+		for (U32 i = 0; i < GetFramesInFlight(); ++i)
+		{
+			VkCommandBufferAllocateInfo bufferInfo{};
+			bufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			bufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			bufferInfo.commandPool = m_recorderPools[i][0].commandPool;
+			bufferInfo.commandBufferCount = 1;
+
+			VkResult result = vkAllocateCommandBuffers(m_device.GetDevice(), &bufferInfo, &m_commandBuffers[i]);
+			ASSERT_EQ(result, VK_SUCCESS, "Failed to create command buffers!");
+		}
 	}
 
-	void LveRenderer::FreeCommandBuffers()
+	void LveRenderer::DestroyCommandPools()
 	{
-		vkFreeCommandBuffers(m_device.GetDevice(), m_device.GetCommandPool(), static_cast<U32>(m_commandBuffers.size()),
-			m_commandBuffers.data());
+		// Destroying a pool frees its command buffers.
+		for (std::vector<RecorderPool>& frameRecorderPools : m_recorderPools)
+		{
+			for (RecorderPool& recorderPool : frameRecorderPools)
+			{
+				vkDestroyCommandPool(m_device.GetDevice(), recorderPool.commandPool, nullptr);
+			}
+		}
+
+		m_recorderPools.clear();
 		m_commandBuffers.clear();
 	}
 
+	void LveRenderer::StartLatencyThread()
+	{
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+		for (U32 i = 0; i < GetFramesInFlight(); ++i)
+		{
+			VkResult result = vkCreateFence(m_device.GetDevice(), &fenceInfo, nullptr, &m_latencyFences[i]);
+			ASSERT_EQ(result, VK_SUCCESS, "Failed to create latency fence!");
+		}
+
+		m_latencyStats.hasPresentTiming = m_device.IsDisplayTimingEnabled();
+		m_latencyThread = std::thread(&LveRenderer::LatencyThreadLoop, this);
+	}
+
+	void LveRenderer::StopLatencyThread()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_latencyMutex);
+			m_isLatencyThreadStopping = true;
+		}
+		m_latencyCondition.notify_one();
+		m_latencyThread.join();
+
+		for (U32 i = 0; i < GetFramesInFlight(); ++i)
+		{
+			vkDestroyFence(m_device.GetDevice(), m_latencyFences[i], nullptr);
+		}
+	}
+
 	void LveRenderer::RecreateSwapchain()
 	{
 		VkExtent2D extent = m_window.GetExtent();
@@ -171,26 +458,34 @@ namespace lve
 			glfwWaitEvents();
 		}
 
-		// Need to wait for the current swapchain not being used.
-		vkDeviceWaitIdle(m_device.GetDevice());
-
 		if (m_swapchain == nullptr)
 		{
 			// Happens in initialization.
-			m_swapchain = MakeUniqueRef<LveSwapchain>(m_device, extent);
+			m_swapchain = MakeUniqueRef<LveSwapchain>(m_device, extent, m_swapchainConfig);
 		}
 		else
 		{
-			// Happens in swapchain recreation.
+			// Happens in swapchain recreation. Frames in flight keep running, since the new swapchain is created with
+			// the old one as oldSwapchain and takes over its frame fences. Images, framebuffers and depth buffers of
+			// the old swapchain may still be used by those frames, so its destruction is deferred.
 			Ref<LveSwapchain> oldSwapchain = std::move(m_swapchain);
-			m_swapchain = MakeUniqueRef<LveSwapchain>(m_device, extent, oldSwapchain);
+			m_swapchain = MakeUniqueRef<LveSwapchain>(m_device, extent, m_swapchainConfig, oldSwapchain);
 
-			// Since we are not recreating the pipeline, we need to check if the swapchain render pass
-			// is still compatible with the color or depth format defined in the pipeline render pass.
+			// Pipelines stay compatible with the new render pass as long as the formats are the same. Otherwise,
+			// render systems have to rebuild them, see WasRenderPassChanged.
 			if (!oldSwapchain->CompareSwapchainFormats(*m_swapchain.get()))
 			{
-				ASSERT(false, "Failed to recreate swapchain. The swapchain image or depth format has changed!");
+				m_renderPassChanged = true;
 			}
+
+			// Frame fences only cover queue submissions, not the presents queued on the old swapchain after them, so the
+			// old swapchain must outlive its last frame. Once its frames are done, it is queued again behind the frame
+			// being recorded at that point. That frame acquires from and presents to the new swapchain, and it is
+			// submitted after the last present on the old one, so no present on the old swapchain is pending when its
+			// fence signals. VK_EXT_swapchain_maintenance1 present fences would allow destroying it exactly when done.
+			m_device.DeferDestruction([&device = m_device, oldSwapchain = std::move(oldSwapchain)]() mutable {
+				device.DeferDestruction([oldSwapchain = std::move(oldSwapchain)]() mutable { oldSwapchain.reset(); });
+			});
 		}
 	}
 
@@ -11,6 +11,12 @@
 #include "lve_swapchain.h"
 #include "lve_model.h"
 
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <memory>
 
@@ -20,7 +26,7 @@ namespace lve
 	class LveRenderer
 	{
 	public:
-		LveRenderer(LveWindow& window, LveDevice& device);
+		LveRenderer(LveWindow& window, LveDevice& device, const LveSwapchainConfig& swapchainConfig = {});
 		~LveRenderer();
 
 		LveRenderer(const LveRenderer&) = delete;
@@ -29,8 +35,16 @@ namespace lve
 		// Public getter.
 		VkRenderPass GetSwapchainRenderPass() const { return m_swapchain->GetRenderPass(); }
 		F32 GetAspectRatio() const { return m_swapchain->GetExtentAspectRatio(); }
+		// Frame indices are in [0, GetFramesInFlight()). Fixed for the lifetime of the renderer.
+		U32 GetFramesInFlight() const { return m_swapchain->GetFramesInFlight(); }
+		VkPresentModeKHR GetPresentMode() const { return m_swapchain->GetPresentMode(); }
 		bool IsFrameInProgress() const { return m_isFrameStarted; }
 
+		// Set when the swapchain was recreated with a different image or depth format. Pipelines created with the
+		// previous render pass are not compatible anymore and have to be rebuilt with GetSwapchainRenderPass.
+		bool WasRenderPassChanged() const { return m_renderPassChanged; }
+		void ResetRenderPassChangedFlag() { m_renderPassChanged = false; }
+
 		VkCommandBuffer GetCurrentCommandBuffer() const
 		{
 			ASSERT(IsFrameInProgress(), "Could not get command buffer when frame is not in progress!");
@@ -43,28 +57,155 @@ namespace lve
 			return m_currentFrameIndex;
 		}
 
+		// Latency in milliseconds. Averages are exponential moving averages.
+		struct LatencyStats
+		{
+			// From MarkInputSampled to queue submission of the frame.
+			F32 inputToSubmit = 0.0f;
+			// From queue submission until the GPU finished the frame. Timed by a thread that waits on a fence signaled
+			// right after the frame, so it is off by the wake-up time of that thread. Presentation is not included.
+			F32 submitToGpuComplete = 0.0f;
+			// From queue submission until the image was displayed, as reported by VK_GOOGLE_display_timing.
+			// Only measured if hasPresentTiming is set.
+			F32 submitToPresent = 0.0f;
+
+			F32 averageInputToSubmit = 0.0f;
+			F32 averageSubmitToGpuComplete = 0.0f;
+			F32 averageSubmitToPresent = 0.0f;
+
+			// Number of samples of each measurement so far.
+			U64 submitCount = 0;
+			U64 gpuCompleteCount = 0;
+			U64 presentCount = 0;
+
+			bool hasPresentTiming = false;
+		};
+
+		// Call right after polling input. Frames without it measure from BeginFrame.
+		void MarkInputSampled();
+		// A copy, since the latency thread updates the stats.
+		LatencyStats GetLatencyStats() const;
+
 		// Functions to render.
 		VkCommandBuffer BeginFrame();
 		void EndFrame();
-		void BeginSwapchainRenderPass(VkCommandBuffer commandBuffer);
+		// With VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS, everything in the render pass must be recorded into
+		// secondary command buffers and executed with vkCmdExecuteCommands.
+		void BeginSwapchainRenderPass(VkCommandBuffer commandBuffer, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
 		void EndSwapchainRenderPass(VkCommandBuffer commandBuffer);
 
+		// Contents of the swapchain render pass that is being recorded.
+		VkSubpassContents GetSubpassContents() const { return m_subpassContents; }
+
+		// Secondary command buffers for recording the swapchain render pass on several threads. Every recorder has its
+		// own command pool per frame in flight, so different recorders can record at the same time, but one recorder
+		// must not be used by two threads at once. Recorder 0 also holds the primary command buffer.
+		U32 GetRecorderCount() const { return m_recorderCount; }
+		// Begins a secondary command buffer that continues the swapchain render pass, with viewport and scissor set.
+		VkCommandBuffer BeginSecondaryCommandBuffer(U32 recorderIndex);
+		void EndSecondaryCommandBuffer(VkCommandBuffer commandBuffer);
+
+		// Calls record(commandBuffer) for commands inside the swapchain render pass. They go straight into the primary
+		// command buffer for inline contents, or into a secondary command buffer that the primary then executes.
+		template <typename RecordFunc>
+		void RecordInRenderPass(VkCommandBuffer primaryCommandBuffer, U32 recorderIndex, RecordFunc&& record)
+		{
+			if (m_subpassContents == VK_SUBPASS_CONTENTS_INLINE)
+			{
+				record(primaryCommandBuffer);
+				return;
+			}
+
+			VkCommandBuffer commandBuffer = BeginSecondaryCommandBuffer(recorderIndex);
+			record(commandBuffer);
+			EndSecondaryCommandBuffer(commandBuffer);
+			vkCmdExecuteCommands(primaryCommandBuffer, 1, &commandBuffer);
+		}
+
 	private:
 		// Functions to create Vulkan resources.
-		void CreateCommandBuffers();
-		void FreeCommandBuffers();
+		void CreateCommandPools();
+		void DestroyCommandPools();
 		void RecreateSwapchain();
 
+		void SetViewportAndScissor(VkCommandBuffer commandBuffer);
+
+		// Latency measurement
+		using LatencyClock = std::chrono::steady_clock;
+
+		void StartLatencyThread();
+		void StopLatencyThread();
+		void LatencyThreadLoop();
+		// Called right after the frame of fenceIndex was submitted.
+		void TrackGpuCompletion(U32 fenceIndex, LatencyClock::time_point submitTime);
+		// Reads the display times of finished presents. Only with VK_GOOGLE_display_timing.
+		void CollectPresentTimings();
+
 	private:
 		LveWindow& m_window;
 		LveDevice& m_device;
 
+		LveSwapchainConfig m_swapchainConfig;
 		UniqueRef<LveSwapchain> m_swapchain;
 		std::vector<VkCommandBuffer> m_commandBuffers;
 
+		// Reset as a whole at the start of a frame. Secondary command buffers are kept and reused.
+		struct RecorderPool
+		{
+			VkCommandPool commandPool = VK_NULL_HANDLE;
+			std::vector<VkCommandBuffer> secondaryCommandBuffers;
+			U32 usedSecondaryCount = 0;
+		};
+
+		// Indexed by [frameIndex][recorderIndex].
+		std::vector<std::vector<RecorderPool>> m_recorderPools;
+		U32 m_recorderCount = 1;
+
 		U32 m_currentImageIndex = 0;
 		U32 m_currentFrameIndex = 0;
+		// Number of frames submitted so far. Tags resources queued for deletion, see LveDevice::DeferDestruction.
+		U64 m_frameNumber = 0;
 		bool m_isFrameStarted = false;
+		bool m_renderPassChanged = false;
+		VkSubpassContents m_subpassContents = VK_SUBPASS_CONTENTS_INLINE;
+
+		// Latency measurement
+		static constexpr F32 LATENCY_AVERAGE_WEIGHT = 0.05f;
+		// Submit times of the most recent presents, indexed by present ID modulo the size.
+		static constexpr U32 PRESENT_HISTORY_SIZE = 64;
+
+		// A frame whose latency fence the latency thread waits for.
+		struct PendingGpuTiming
+		{
+			U32 fenceIndex = 0;
+			LatencyClock::time_point submitTime;
+		};
+
+		struct PresentRecord
+		{
+			U32 presentId = 0;
+			LatencyClock::time_point submitTime;
+		};
+
+		// One per frame slot, signaled by an empty submission after the frame. The swapchain's frame fences cannot be
+		// waited on from another thread, since the swapchain resets them when the slot is reused.
+		std::array<VkFence, LveSwapchain::MAX_FRAMES_IN_FLIGHT> m_latencyFences{};
+		// Set while the latency thread has not seen the fence signaled. Such a slot is not measured again until then.
+		std::array<bool, LveSwapchain::MAX_FRAMES_IN_FLIGHT> m_isLatencyFenceBusy{};
+		std::deque<PendingGpuTiming> m_pendingGpuTimings;
+		std::thread m_latencyThread;
+		std::condition_variable m_latencyCondition;
+		bool m_isLatencyThreadStopping = false;
+		// Guards everything the latency thread touches, including m_latencyStats.
+		mutable std::mutex m_latencyMutex;
+
+		std::array<PresentRecord, PRESENT_HISTORY_SIZE> m_presentRecords{};
+		std::vector<VkPastPresentationTimingGOOGLE> m_presentTimings;
+
+		LatencyClock::time_point m_inputTime;
+		LatencyClock::time_point m_frameBeginTime;
+		bool m_isInputSampled = false;
+		LatencyStats m_latencyStats{};
 	};
 
 } // namespace lve
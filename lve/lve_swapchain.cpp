@@ -6,18 +6,26 @@
 
 namespace lve
 {
-	LveSwapchain::LveSwapchain(LveDevice& device, VkExtent2D windowExtent)
-		: m_device(device), m_windowExtent(windowExtent)
+	LveSwapchain::LveSwapchain(LveDevice& device, VkExtent2D windowExtent, const LveSwapchainConfig& config)
+		: m_device(device),
+		  m_windowExtent(windowExtent),
+		  m_config(config),
+		  m_framesInFlight(std::clamp(config.framesInFlight, 1u, MAX_FRAMES_IN_FLIGHT))
 	{
 		Init();
 	}
 
-	LveSwapchain::LveSwapchain(LveDevice& device, VkExtent2D windowExtent, std::shared_ptr<LveSwapchain> previous)
-		: m_device(device), m_windowExtent(windowExtent), m_oldSwapchain(previous)
+	LveSwapchain::LveSwapchain(LveDevice& device, VkExtent2D windowExtent, const LveSwapchainConfig& config,
+		std::shared_ptr<LveSwapchain> previous)
+		: m_device(device),
+		  m_windowExtent(windowExtent),
+		  m_config(config),
+		  m_framesInFlight(previous->m_framesInFlight),
+		  m_oldSwapchain(previous)
 	{
 		Init();
 
-		// Clean up old swapchain since it's no longer needed.
+		// Only needed for creation. The renderer keeps the old swapchain alive until its frames are done.
 		m_oldSwapchain = nullptr;
 	}
 
@@ -47,9 +55,10 @@ namespace lve
 
 		for (USize i = 0; i < m_depthImages.size(); i++)
 		{
-			vkDestroyImageView(m_device.GetDevice(), m_depthImageViews[i], nullptr);
-			vkDestroyImage(m_device.GetDevice(), m_depthImages[i], nullptr);
-			vkFreeMemory(m_device.GetDevice(), m_depthImageMemorys[i], nullptr);
+			m_device.DeferDestruction([device = m_device.GetDevice(), imageView = m_depthImageViews[i]]() {
+				vkDestroyImageView(device, imageView, nullptr);
+			});
+			m_device.DestroyImage(m_depthImages[i], m_depthImageAllocations[i]);
 		}
 
 		for (VkFramebuffer& framebuffer : m_swapchainFramebuffers)
@@ -59,7 +68,8 @@ namespace lve
 
 		vkDestroyRenderPass(m_device.GetDevice(), m_renderPass, nullptr);
 
-		for (USize i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		// Empty if a newer swapchain took them over.
+		for (USize i = 0; i < m_inFlightFences.size(); i++)
 		{
 			vkDestroySemaphore(m_device.GetDevice(), m_renderFinishedSemaphores[i], nullptr);
 			vkDestroySemaphore(m_device.GetDevice(), m_imageAvailableSemaphores[i], nullptr);
@@ -82,7 +92,7 @@ namespace lve
 			m_imageAvailableSemaphores[m_currentFrame], VK_NULL_HANDLE, imageIndex);
 	}
 
-	VkResult LveSwapchain::SubmitCommandBuffers(const VkCommandBuffer* buffers, U32* imageIndex)
+	VkResult LveSwapchain::SubmitCommandBuffers(const VkCommandBuffer* buffers, U32* imageIndex, U32 presentId)
 	{
 		ASSERT(imageIndex, "Image index pointer is nullptr.");
 
@@ -115,6 +125,9 @@ namespace lve
 		// Only reset the fence if we are actually submitting work to avoid deadlock.
 		vkResetFences(m_device.GetDevice(), 1, &m_inFlightFences[m_currentFrame]);
 
+		// Uploads may be submitted from other threads, so hold the queue lock for both the submit and the present.
+		std::lock_guard<std::mutex> queueLock(m_device.GetQueueMutex());
+
 		// When the command buffer execution is done, it signals that the command buffer can be reused.
 		VkResult submitResult = vkQueueSubmit(m_device.GetGraphicsQueue(), 1, &submitInfo, m_inFlightFences[m_currentFrame]);
 		ASSERT_EQ(submitResult, VK_SUCCESS, "Failed to submit command buffer to graphics queue!");
@@ -131,14 +144,51 @@ namespace lve
 		presentInfo.pSwapchains = swapchains;
 		presentInfo.pImageIndices = imageIndex;
 
+		// Ask for the display time of this present. No desired time, so presentation is not delayed.
+		VkPresentTimeGOOGLE presentTime{};
+		presentTime.presentID = presentId;
+		presentTime.desiredPresentTime = 0;
+
+		VkPresentTimesInfoGOOGLE presentTimesInfo{};
+		presentTimesInfo.sType = VK_STRUCTURE_TYPE_PRESENT_TIMES_INFO_GOOGLE;
+		presentTimesInfo.swapchainCount = 1;
+		presentTimesInfo.pTimes = &presentTime;
+
+		if (presentId != 0 && m_device.IsDisplayTimingEnabled())
+		{
+			presentInfo.pNext = &presentTimesInfo;
+		}
+
 		VkResult presentResult = vkQueuePresentKHR(m_device.GetPresentQueue(), &presentInfo);
 
 		// Advance the current frame index.
-		m_currentFrame = (m_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+		m_currentFrame = (m_currentFrame + 1) % m_framesInFlight;
 
 		return presentResult;
 	}
 
+	const char* LveSwapchain::GetPresentModeName(VkPresentModeKHR presentMode)
+	{
+		if (presentMode == VK_PRESENT_MODE_IMMEDIATE_KHR)
+		{
+			return "Immediate";
+		}
+		else if (presentMode == VK_PRESENT_MODE_MAILBOX_KHR)
+		{
+			return "Mailbox";
+		}
+		else if (presentMode == VK_PRESENT_MODE_FIFO_RELAXED_KHR)
+		{
+			return "FIFO relaxed";
+		}
+		else if (presentMode == VK_PRESENT_MODE_FIFO_KHR)
+		{
+			return "FIFO (V-Sync)";
+		}
+
+		return "Unknown";
+	}
+
 	VkFormat LveSwapchain::FindDepthFormat()
 	{
 		return m_device.FindSupportedFormat({ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
@@ -158,14 +208,7 @@ namespace lve
 		VkPresentModeKHR presentMode = ChooseSwapPresentMode(swapchainSupport.presentModes);
 		VkExtent2D extent2D = ChooseSwapExtent(swapchainSupport.capabilities);
 
-		// It is recommended to request at least one more image than the minimum.
-		U32 imageCount = swapchainSupport.capabilities.minImageCount + 1;
-
-		if (swapchainSupport.capabilities.maxImageCount > 0)
-		{
-			imageCount = std::min(imageCount, swapchainSupport.capabilities.maxImageCount);
-		}
-
+		U32 imageCount = ChooseImageCount(swapchainSupport.capabilities);
 		PRINT("Image count: %u", imageCount);
 
 		VkSwapchainCreateInfoKHR swapchainInfo{};
@@ -204,6 +247,7 @@ namespace lve
 		swapchainInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 
 		swapchainInfo.presentMode = presentMode;
+		m_presentMode = presentMode;
 		swapchainInfo.clipped = VK_TRUE;
 		swapchainInfo.oldSwapchain = m_oldSwapchain == nullptr ? VK_NULL_HANDLE : m_oldSwapchain->m_swapchain;
 
@@ -305,9 +349,26 @@ namespace lve
 
 		m_swapchainDepthFormat = FindDepthFormat();
 
-		m_depthImages.resize(GetImageCount());
-		m_depthImageMemorys.resize(GetImageCount());
-		m_depthImageViews.resize(GetImageCount());
+		// A frame slot only uses its depth buffer after waiting for the slot fence, and the new swapchain takes over
+		// those fences, so the old depth buffers can be used right away.
+		if (m_oldSwapchain != nullptr && m_oldSwapchain->m_swapchainDepthFormat == m_swapchainDepthFormat &&
+			m_oldSwapchain->m_swapchainExtent.width == m_swapchainExtent.width &&
+			m_oldSwapchain->m_swapchainExtent.height == m_swapchainExtent.height && !m_oldSwapchain->m_depthImages.empty())
+		{
+			PRINT("Reusing depth resources...");
+			m_depthImages = std::move(m_oldSwapchain->m_depthImages);
+			m_depthImageAllocations = std::move(m_oldSwapchain->m_depthImageAllocations);
+			m_depthImageViews = std::move(m_oldSwapchain->m_depthImageViews);
+
+			m_oldSwapchain->m_depthImages.clear();
+			m_oldSwapchain->m_depthImageAllocations.clear();
+			m_oldSwapchain->m_depthImageViews.clear();
+			return;
+		}
+
+		m_depthImages.resize(m_framesInFlight);
+		m_depthImageAllocations.resize(m_framesInFlight);
+		m_depthImageViews.resize(m_framesInFlight);
 
 		for (USize i = 0; i < m_depthImages.size(); i++)
 		{
@@ -322,12 +383,14 @@ namespace lve
 			imageInfo.format = m_swapchainDepthFormat;
 			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
 			imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+			// Depth is cleared on load and never stored, so tile-based GPUs can keep it in tile memory only.
+			imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
 			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 			imageInfo.flags = 0;
 
-			m_device.CreateImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_depthImages[i], m_depthImageMemorys[i]);
+			m_device.CreateImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_depthImages[i], m_depthImageAllocations[i],
+				VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
 			m_depthImageViews[i] = CreateImageView(m_depthImages[i], m_swapchainDepthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
 		}
 
@@ -339,12 +402,14 @@ namespace lve
 
 	void LveSwapchain::CreateFramebuffers()
 	{
-		m_swapchainFramebuffers.resize(m_swapchainImageViews.size());
+		// Framebuffers are cheap compared to the attachments, so there is one for each swapchain image and frame.
+		USize imageCount = m_swapchainImageViews.size();
+		m_swapchainFramebuffers.resize(imageCount * m_framesInFlight);
 		PRINT("Creating %zu framebuffers...", m_swapchainFramebuffers.size());
 
-		for (USize i = 0; i < m_swapchainImageViews.size(); i++)
+		for (USize i = 0; i < m_swapchainFramebuffers.size(); i++)
 		{
-			std::array<VkImageView, 2> imageViews = { m_swapchainImageViews[i], m_depthImageViews[i] };
+			std::array<VkImageView, 2> imageViews = { m_swapchainImageViews[i % imageCount], m_depthImageViews[i / imageCount] };
 
 			VkFramebufferCreateInfo framebufferCreateInfo{};
 			framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
@@ -362,10 +427,26 @@ namespace lve
 
 	void LveSwapchain::CreateSyncObjects()
 	{
-		m_imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		m_renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		m_inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-		m_imagesInFlight.resize(GetImageCount(), VK_NULL_HANDLE);
+		m_imagesInFlight.assign(GetImageCount(), VK_NULL_HANDLE);
+
+		if (m_oldSwapchain != nullptr)
+		{
+			// Frames in flight still signal the old frame fences and semaphores. Take them over together with the
+			// frame index instead of waiting for the frames, so the next frame waits on the right fence.
+			m_imageAvailableSemaphores = std::move(m_oldSwapchain->m_imageAvailableSemaphores);
+			m_renderFinishedSemaphores = std::move(m_oldSwapchain->m_renderFinishedSemaphores);
+			m_inFlightFences = std::move(m_oldSwapchain->m_inFlightFences);
+			m_currentFrame = m_oldSwapchain->m_currentFrame;
+
+			m_oldSwapchain->m_imageAvailableSemaphores.clear();
+			m_oldSwapchain->m_renderFinishedSemaphores.clear();
+			m_oldSwapchain->m_inFlightFences.clear();
+			return;
+		}
+
+		m_imageAvailableSemaphores.resize(m_framesInFlight);
+		m_renderFinishedSemaphores.resize(m_framesInFlight);
+		m_inFlightFences.resize(m_framesInFlight);
 
 		VkSemaphoreCreateInfo semaphoreInfo{};
 		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -374,7 +455,7 @@ namespace lve
 		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-		for (USize i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		for (USize i = 0; i < m_framesInFlight; i++)
 		{
 			VkResult result1 = vkCreateSemaphore(m_device.GetDevice(), &semaphoreInfo, nullptr, &m_imageAvailableSemaphores[i]);
 			VkResult result2 = vkCreateSemaphore(m_device.GetDevice(), &semaphoreInfo, nullptr, &m_renderFinishedSemaphores[i]);
@@ -408,30 +489,37 @@ namespace lve
 	{
 		// 1. FIFO is the default mode. If GPU finishes very fast, it would become idle if no more back-buffer is available.
 		// This will also increase the latency between the frame is being rendered and the frame is actually being shown.
-		// 2. Mailbox will make the GPU busy instead by discarding the back-buffer content and re-draw. Swapchain will pick
+		// 2. FIFO relaxed is FIFO, but presents a late image right away instead of waiting for the next vertical blank.
+		// This may tear when the application misses a vertical blank.
+		// 3. Mailbox will make the GPU busy instead by discarding the back-buffer content and re-draw. Swapchain will pick
 		// the one that is most recently being drawn, which will decrease the latency but increase power consumption.
-		// 3. Immediate mode does not do any synchronization, which will cause high CPU and GPU usage and tearing.
-		auto mailboxIt = std::find_if(availablePresentModes.begin(), availablePresentModes.end(),
-			[](VkPresentModeKHR presentMode) { return presentMode == VK_PRESENT_MODE_MAILBOX_KHR; });
+		// 4. Immediate mode does not do any synchronization, which will cause high CPU and GPU usage and tearing.
+		bool isSupported = std::find(availablePresentModes.begin(), availablePresentModes.end(), m_config.presentMode) !=
+			availablePresentModes.end();
 
-		// auto immediateIt = std::find_if(availablePresentModes.begin(), availablePresentModes.end(),
-		// 								[](VkPresentModeKHR presentMode) { return presentMode == VK_PRESENT_MODE_IMMEDIATE_KHR; });
+		VkPresentModeKHR presentMode = isSupported ? m_config.presentMode : VK_PRESENT_MODE_FIFO_KHR;
 
-		if (mailboxIt != availablePresentModes.end())
+		if (!isSupported)
 		{
-			PRINT("Present mode: Mailbox");
-			return *mailboxIt;
+			PRINT("Present mode %s is not supported. Falling back to FIFO.", GetPresentModeName(m_config.presentMode));
 		}
-		// else if (immediateIt != availablePresentModes.end())
-		// {
-		// 	PRINT("Present mode: Immediate");
-		// 	return *immediateIt;
-		// }
-		else
+
+		PRINT("Present mode: %s", GetPresentModeName(presentMode));
+		return presentMode;
+	}
+
+	U32 LveSwapchain::ChooseImageCount(const VkSurfaceCapabilitiesKHR& capabilities)
+	{
+		// It is recommended to request at least one more image than the minimum.
+		U32 imageCount = m_config.imageCount > 0 ? m_config.imageCount : capabilities.minImageCount + 1;
+		imageCount = std::max(imageCount, capabilities.minImageCount);
+
+		if (capabilities.maxImageCount > 0)
 		{
-			PRINT("Present mode: V-Sync");
-			return VK_PRESENT_MODE_FIFO_KHR;
+			imageCount = std::min(imageCount, capabilities.maxImageCount);
 		}
+
+		return imageCount;
 	}
 
 	VkExtent2D LveSwapchain::ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities)
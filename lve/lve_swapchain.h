@@ -13,15 +13,30 @@
 
 namespace lve
 {
+	// Trades throughput for latency. Set at startup, e.g. from the command line.
+	struct LveSwapchainConfig
+	{
+		// Frames the CPU may record ahead of the GPU. Clamped to [1, LveSwapchain::MAX_FRAMES_IN_FLIGHT].
+		U32 framesInFlight = 2;
+		// 0 requests one more than the surface minimum. Clamped to what the surface supports.
+		U32 imageCount = 0;
+		// FIFO, FIFO_RELAXED, MAILBOX or IMMEDIATE. Falls back to FIFO, which every surface supports.
+		VkPresentModeKHR presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+	};
+
 	// Swapchain class that manages Vulkan swapchain and images, framebuffers, render passes
 	// synchronization primitives, etc.
 	class LveSwapchain
 	{
 	public:
-		static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
-
-		LveSwapchain(LveDevice& device, VkExtent2D windowExtent);
-		LveSwapchain(LveDevice& device, VkExtent2D windowExtent, Ref<LveSwapchain> previous);
+		// Upper bound of LveSwapchainConfig::framesInFlight.
+		static constexpr U32 MAX_FRAMES_IN_FLIGHT = 4;
+
+		LveSwapchain(LveDevice& device, VkExtent2D windowExtent, const LveSwapchainConfig& config);
+		// Retires the previous swapchain. Its frame sync objects are taken over, so frames in flight keep running.
+		// The previous swapchain must stay alive until those frames are done.
+		// The frame count of the previous swapchain is kept, since its frames in flight are taken over.
+		LveSwapchain(LveDevice& device, VkExtent2D windowExtent, const LveSwapchainConfig& config, Ref<LveSwapchain> previous);
 		~LveSwapchain();
 
 		LveSwapchain(const LveSwapchain&) = delete;
@@ -29,11 +44,17 @@ namespace lve
 
 		// Functions to get Vulkan resources
 		VkRenderPass GetRenderPass() { return m_renderPass; }
-		VkFramebuffer GetFramebuffer(int index) { return m_swapchainFramebuffers[index]; }
+		// Every swapchain image has one framebuffer per frame in flight, since depth buffers belong to frames.
+		VkFramebuffer GetFramebuffer(U32 imageIndex, U32 frameIndex)
+		{
+			return m_swapchainFramebuffers[frameIndex * GetImageCount() + imageIndex];
+		}
 		VkImageView GetImageView(int index) { return m_swapchainImageViews[index]; }
 
 		// Functions to get swapchain info
 		USize GetImageCount() { return m_swapchainImages.size(); }
+		U32 GetFramesInFlight() const { return m_framesInFlight; }
+		VkPresentModeKHR GetPresentMode() const { return m_presentMode; }
 		VkFormat GetSwapchainImageFormat() { return m_swapchainImageFormat; }
 		VkExtent2D GetSwapchainExtent() { return m_swapchainExtent; }
 		U32 GetWidth() { return m_swapchainExtent.width; }
@@ -42,9 +63,17 @@ namespace lve
 
 		// Public functions
 		VkResult AcquireNextImage(U32* imageIndex);
-		VkResult SubmitCommandBuffers(const VkCommandBuffer* buffers, U32* imageIndex);
+		// A non-zero presentId tags the present for GetPastPresentationTimings, if display timing is enabled.
+		VkResult SubmitCommandBuffers(const VkCommandBuffer* buffers, U32* imageIndex, U32 presentId = 0);
+		// Appends the display times of tagged presents that completed since the last call.
+		void GetPastPresentationTimings(std::vector<VkPastPresentationTimingGOOGLE>& timings)
+		{
+			m_device.GetPastPresentationTimings(m_swapchain, timings);
+		}
 		VkFormat FindDepthFormat();
 
+		static const char* GetPresentModeName(VkPresentModeKHR presentMode);
+
 		bool CompareSwapchainFormats(const LveSwapchain& otherSwapchain) const
 		{
 			return m_swapchainImageFormat == otherSwapchain.m_swapchainImageFormat && m_swapchainDepthFormat == otherSwapchain.m_swapchainDepthFormat;
@@ -64,12 +93,16 @@ namespace lve
 		VkSurfaceFormatKHR ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
 		VkPresentModeKHR ChooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes);
 		VkExtent2D ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
+		U32 ChooseImageCount(const VkSurfaceCapabilitiesKHR& capabilities);
 
 		VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
 
 	private:
 		LveDevice& m_device;
 		VkExtent2D m_windowExtent;
+		LveSwapchainConfig m_config;
+		U32 m_framesInFlight;
+		VkPresentModeKHR m_presentMode;
 		VkSwapchainKHR m_swapchain;
 		Ref<LveSwapchain> m_oldSwapchain;
 
@@ -83,15 +116,17 @@ namespace lve
 		std::vector<VkImage> m_swapchainImages;
 		std::vector<VkImageView> m_swapchainImageViews;
 
+		// One depth buffer per frame in flight rather than per swapchain image, since only that many frames render at
+		// the same time. Passed on to the next swapchain if its extent and format are the same.
 		std::vector<VkImage> m_depthImages;
-		std::vector<VkDeviceMemory> m_depthImageMemorys;
+		std::vector<LveAllocation> m_depthImageAllocations;
 		std::vector<VkImageView> m_depthImageViews;
 
 		// Sync
 		std::vector<VkSemaphore> m_imageAvailableSemaphores;
 		std::vector<VkSemaphore> m_renderFinishedSemaphores;
-		std::vector<VkFence> m_inFlightFences; // size = 2
-		std::vector<VkFence> m_imagesInFlight; // size = 3
+		std::vector<VkFence> m_inFlightFences; // size = frames in flight
+		std::vector<VkFence> m_imagesInFlight; // size = image count
 
 		USize m_currentFrame = 0;
 	};
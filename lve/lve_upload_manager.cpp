@@ -0,0 +1,315 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/5/24.
+//
+
+#include "lve_upload_manager.h"
+
+#include "lve_device.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace lve
+{
+	static constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+	LveUploadManager::LveUploadManager(LveDevice& device, VkDeviceSize stagingSize)
+		: m_device(device)
+	{
+		CreateCommandPool();
+		CreateStagingBuffer(stagingSize);
+	}
+
+	LveUploadManager::~LveUploadManager()
+	{
+		WaitIdle();
+
+		// Batches are either free or pending, and WaitIdle retired all pending ones.
+		for (Batch& batch : m_freeBatches)
+		{
+			vkDestroyFence(m_device.GetDevice(), batch.fence, nullptr);
+		}
+
+		if (m_isRecording)
+		{
+			vkDestroyFence(m_device.GetDevice(), m_recordingBatch.fence, nullptr);
+		}
+
+		vkDestroyCommandPool(m_device.GetDevice(), m_commandPool, nullptr);
+
+		vkDestroyBuffer(m_device.GetDevice(), m_stagingBuffer, nullptr);
+		m_device.FreeAllocation(m_stagingAllocation);
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	// Public functions
+	/////////////////////////////////////////////////////////////////////////////////
+
+	LveUploadManager::Ticket LveUploadManager::UploadToBuffer(VkBuffer dstBuffer, const void* data, VkDeviceSize size,
+		VkDeviceSize dstOffset)
+	{
+		// Nothing to copy. Return a ticket that is already complete, so waiting on it never blocks.
+		if (size == 0)
+		{
+			return 0;
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		// Large uploads are split into chunks, so they never need more than a part of the ring buffer.
+		VkDeviceSize maxChunkSize = m_stagingCapacity / 4;
+		VkDeviceSize copiedSize = 0;
+
+		while (copiedSize < size)
+		{
+			VkDeviceSize chunkSize = std::min(size - copiedSize, maxChunkSize);
+			VkDeviceSize stagingOffset = AllocateStaging(chunkSize);
+
+			memcpy(static_cast<char*>(m_stagingAllocation.mappedData) + stagingOffset, static_cast<const char*>(data) + copiedSize,
+				chunkSize);
+
+			Batch& batch = GetRecordingBatch();
+
+			VkBufferCopy copyRegion{};
+			copyRegion.srcOffset = stagingOffset;
+			copyRegion.dstOffset = dstOffset + copiedSize;
+			copyRegion.size = chunkSize;
+			vkCmdCopyBuffer(batch.commandBuffer, m_stagingBuffer, dstBuffer, 1, &copyRegion);
+
+			batch.hasCommands = true;
+			copiedSize += chunkSize;
+		}
+
+		// The last chunk is in the newest batch, which completes after all previous ones.
+		return GetRecordingBatch().ticket;
+	}
+
+	void LveUploadManager::Submit()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (m_isRecording && m_recordingBatch.hasCommands)
+		{
+			SubmitRecordingBatch();
+		}
+	}
+
+	void LveUploadManager::Update()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		RetireBatches(false);
+	}
+
+	bool LveUploadManager::IsComplete(Ticket ticket)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		RetireBatches(false);
+		return ticket <= m_completedTicket;
+	}
+
+	void LveUploadManager::Wait(Ticket ticket)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		// The ticket may still be recording, so it has to be submitted before waiting for it.
+		if (m_isRecording && m_recordingBatch.ticket <= ticket && m_recordingBatch.hasCommands)
+		{
+			SubmitRecordingBatch();
+		}
+
+		while (m_completedTicket < ticket && !m_pendingBatches.empty())
+		{
+			RetireBatches(true);
+		}
+	}
+
+	void LveUploadManager::WaitIdle()
+	{
+		Submit();
+		Wait(m_nextTicket);
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	// Functions to create Vulkan resources
+	/////////////////////////////////////////////////////////////////////////////////
+
+	void LveUploadManager::CreateCommandPool()
+	{
+		// A separate pool so that uploads could be recorded while the renderer records its command buffers.
+		VkCommandPoolCreateInfo poolCreateInfo{};
+		poolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		poolCreateInfo.queueFamilyIndex = m_device.FindPhysicalQueueFamilies().graphicsFamily.value();
+
+		VkResult result = vkCreateCommandPool(m_device.GetDevice(), &poolCreateInfo, nullptr, &m_commandPool);
+		ASSERT_EQ(result, VK_SUCCESS, "Failed to create upload command pool!");
+	}
+
+	void LveUploadManager::CreateStagingBuffer(VkDeviceSize stagingSize)
+	{
+		m_stagingCapacity = stagingSize;
+
+		m_device.CreateBuffer(
+			m_stagingCapacity,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			m_stagingBuffer,
+			m_stagingAllocation);
+
+		ASSERT(m_stagingAllocation.mappedData, "Staging buffer memory is not mapped!");
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	// Private helper functions
+	/////////////////////////////////////////////////////////////////////////////////
+
+	LveUploadManager::Batch& LveUploadManager::GetRecordingBatch()
+	{
+		if (m_isRecording)
+		{
+			return m_recordingBatch;
+		}
+
+		if (!m_freeBatches.empty())
+		{
+			m_recordingBatch = m_freeBatches.back();
+			m_freeBatches.pop_back();
+
+			vkResetCommandBuffer(m_recordingBatch.commandBuffer, 0);
+			vkResetFences(m_device.GetDevice(), 1, &m_recordingBatch.fence);
+		}
+		else
+		{
+			m_recordingBatch = Batch{};
+
+			VkCommandBufferAllocateInfo allocateInfo{};
+			allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocateInfo.commandPool = m_commandPool;
+			allocateInfo.commandBufferCount = 1;
+
+			VkResult allocateResult = vkAllocateCommandBuffers(m_device.GetDevice(), &allocateInfo, &m_recordingBatch.commandBuffer);
+			ASSERT_EQ(allocateResult, VK_SUCCESS, "Failed to allocate upload command buffer!");
+
+			VkFenceCreateInfo fenceInfo{};
+			fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+			VkResult fenceResult = vkCreateFence(m_device.GetDevice(), &fenceInfo, nullptr, &m_recordingBatch.fence);
+			ASSERT_EQ(fenceResult, VK_SUCCESS, "Failed to create upload fence!");
+		}
+
+		m_recordingBatch.ticket = m_nextTicket++;
+		m_recordingBatch.stagingSize = 0;
+		m_recordingBatch.hasCommands = false;
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		VkResult beginResult = vkBeginCommandBuffer(m_recordingBatch.commandBuffer, &beginInfo);
+		ASSERT_EQ(beginResult, VK_SUCCESS, "Failed to begin upload command buffer!");
+
+		m_isRecording = true;
+		return m_recordingBatch;
+	}
+
+	VkDeviceSize LveUploadManager::AllocateStaging(VkDeviceSize size)
+	{
+		ASSERT(size <= m_stagingCapacity, "Upload chunk is larger than the staging buffer!");
+
+		while (true)
+		{
+			VkDeviceSize offset = (m_stagingHead + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+
+			// Skip the tail of the ring when the range does not fit before the end.
+			if (offset + size > m_stagingCapacity)
+			{
+				offset = 0;
+			}
+
+			VkDeviceSize consumedSize = (offset >= m_stagingHead) ? offset + size - m_stagingHead : m_stagingCapacity - m_stagingHead + size;
+
+			if (m_stagingUsedSize + consumedSize <= m_stagingCapacity)
+			{
+				GetRecordingBatch().stagingSize += consumedSize;
+				m_stagingUsedSize += consumedSize;
+				m_stagingHead = offset + size;
+				return offset;
+			}
+
+			// Out of staging memory. Flush what has been recorded and wait for the oldest batch to free its range.
+			if (m_isRecording && m_recordingBatch.hasCommands)
+			{
+				SubmitRecordingBatch();
+			}
+
+			ASSERT(!m_pendingBatches.empty(), "Failed to allocate staging memory!");
+			RetireBatches(true);
+		}
+	}
+
+	void LveUploadManager::SubmitRecordingBatch()
+	{
+		Batch& batch = m_recordingBatch;
+
+		// Make the copies visible to vertex input of every later submission on the same queue.
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+
+		vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0,
+			nullptr, 0, nullptr);
+
+		VkResult endResult = vkEndCommandBuffer(batch.commandBuffer);
+		ASSERT_EQ(endResult, VK_SUCCESS, "Failed to end upload command buffer!");
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &batch.commandBuffer;
+
+		{
+			// The renderer submits to the same queue, possibly from another thread.
+			std::lock_guard<std::mutex> queueLock(m_device.GetQueueMutex());
+			VkResult submitResult = vkQueueSubmit(m_device.GetGraphicsQueue(), 1, &submitInfo, batch.fence);
+			ASSERT_EQ(submitResult, VK_SUCCESS, "Failed to submit upload command buffer!");
+		}
+
+		m_pendingBatches.push_back(batch);
+		m_isRecording = false;
+	}
+
+	void LveUploadManager::RetireBatches(bool waitForOldest)
+	{
+		if (waitForOldest && !m_pendingBatches.empty())
+		{
+			VkFence fence = m_pendingBatches.front().fence;
+			vkWaitForFences(m_device.GetDevice(), 1, &fence, VK_TRUE, UINT64_MAX);
+		}
+
+		// Fences on the same queue are signaled in submission order, so stop at the first unfinished batch.
+		while (!m_pendingBatches.empty())
+		{
+			Batch& batch = m_pendingBatches.front();
+
+			if (vkGetFenceStatus(m_device.GetDevice(), batch.fence) != VK_SUCCESS)
+			{
+				break;
+			}
+
+			m_stagingUsedSize -= batch.stagingSize;
+			m_completedTicket = batch.ticket;
+
+			m_freeBatches.push_back(batch);
+			m_pendingBatches.pop_front();
+		}
+
+		// Nothing is in flight, so the ring can start over from the beginning.
+		if (m_stagingUsedSize == 0 && !m_isRecording)
+		{
+			m_stagingHead = 0;
+		}
+	}
+
+} // namespace lve
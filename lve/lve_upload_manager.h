@@ -0,0 +1,97 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/5/24.
+//
+
+#pragma once
+
+#include "core/core.h"
+
+#include "lve_memory_allocator.h"
+
+#include <vulkan/vulkan.h>
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace lve
+{
+	class LveDevice;
+
+	// Uploads data to device local buffers without stalling the queue.
+	//
+	// Data is copied into a persistently mapped staging ring buffer and the copy commands are recorded into a batch.
+	// A batch is submitted as one command buffer when Submit() is called (the renderer does it before each frame)
+	// or when the ring buffer runs out of space. Each batch has a fence, and the staging memory of a batch is reused
+	// once its fence is signaled.
+	//
+	// Every upload returns a ticket. Uploads are visible to vertex input of any later submission on the graphics queue,
+	// so the ticket only needs to be checked before the destination buffer is destroyed or reused.
+	class LveUploadManager
+	{
+	public:
+		using Ticket = U64;
+
+		LveUploadManager(LveDevice& device, VkDeviceSize stagingSize = 32ull * 1024 * 1024);
+		~LveUploadManager();
+
+		LveUploadManager(const LveUploadManager&) = delete;
+		LveUploadManager& operator=(const LveUploadManager&) = delete;
+
+		// Queue a copy of size bytes of data to dstBuffer. Data is copied into the staging buffer before returning.
+		// A zero-size upload records nothing and returns a ticket that is already complete.
+		Ticket UploadToBuffer(VkBuffer dstBuffer, const void* data, VkDeviceSize size, VkDeviceSize dstOffset = 0);
+
+		// Submit the recorded copies, if any.
+		void Submit();
+		// Release staging memory of the batches that have finished. Cheap, it only polls fences.
+		void Update();
+
+		bool IsComplete(Ticket ticket);
+		void Wait(Ticket ticket);
+		void WaitIdle();
+
+	private:
+		struct Batch
+		{
+			VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+			VkFence fence = VK_NULL_HANDLE;
+			Ticket ticket = 0;
+			// Bytes of the ring buffer consumed by this batch, including padding.
+			VkDeviceSize stagingSize = 0;
+			bool hasCommands = false;
+		};
+
+		void CreateCommandPool();
+		void CreateStagingBuffer(VkDeviceSize stagingSize);
+
+		// Functions below expect m_mutex to be locked.
+		Batch& GetRecordingBatch();
+		VkDeviceSize AllocateStaging(VkDeviceSize size);
+		void SubmitRecordingBatch();
+		void RetireBatches(bool waitForOldest);
+
+	private:
+		LveDevice& m_device;
+
+		VkCommandPool m_commandPool = VK_NULL_HANDLE;
+
+		VkBuffer m_stagingBuffer = VK_NULL_HANDLE;
+		LveAllocation m_stagingAllocation{};
+		VkDeviceSize m_stagingCapacity = 0;
+		VkDeviceSize m_stagingHead = 0;
+		VkDeviceSize m_stagingUsedSize = 0;
+
+		// The batch being recorded is always the newest one. Batches are retired in submission order.
+		bool m_isRecording = false;
+		Batch m_recordingBatch{};
+		std::deque<Batch> m_pendingBatches;
+		std::vector<Batch> m_freeBatches;
+
+		Ticket m_nextTicket = 1;
+		Ticket m_completedTicket = 0;
+
+		std::mutex m_mutex;
+	};
+
+} // namespace lve
@@ -0,0 +1,172 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/11/24.
+//
+
+#include "lve_vertex_welder.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace lve
+{
+	static constexpr USize VERTEX_WORD_COUNT = sizeof(LveModel::Vertex) / sizeof(U32);
+	static_assert(sizeof(LveModel::Vertex) % sizeof(U32) == 0, "Vertex must consist of 32-bit words!");
+
+	// Reads the vertex as 32-bit words and maps -0.0 to +0.0, so both compare and hash equal.
+	static inline void GetVertexKey(const LveModel::Vertex& vertex, U32 key[VERTEX_WORD_COUNT])
+	{
+		memcpy(key, &vertex, sizeof(LveModel::Vertex));
+
+		for (USize i = 0; i < VERTEX_WORD_COUNT; i++)
+		{
+			key[i] = (key[i] == 0x80000000u) ? 0u : key[i];
+		}
+	}
+
+	static inline U64 HashVertexKey(const U32 key[VERTEX_WORD_COUNT])
+	{
+		U64 hash = 0xcbf29ce484222325ull;
+		for (USize i = 0; i < VERTEX_WORD_COUNT; i++)
+		{
+			hash = (hash ^ key[i]) * 0x100000001b3ull;
+		}
+
+		// Mix the upper bits down, since the table uses the lower bits.
+		hash ^= hash >> 32;
+		hash *= 0x9e3779b97f4a7c15ull;
+		return hash ^ (hash >> 29);
+	}
+
+	LveVertexWelder::LveVertexWelder(USize maxVertexCount)
+	{
+		// Keep the load factor at or below 0.5.
+		USize capacity = 16;
+		while (capacity < maxVertexCount * 2)
+		{
+			capacity <<= 1;
+		}
+
+		m_slots.assign(capacity, Slot{});
+		m_mask = capacity - 1;
+	}
+
+	U32 LveVertexWelder::Weld(const LveModel::Vertex& vertex, std::vector<LveModel::Vertex>& vertices)
+	{
+		U32 key[VERTEX_WORD_COUNT];
+		GetVertexKey(vertex, key);
+
+		U64 hash = HashVertexKey(key);
+		// The lower bits pick the slot, so store the upper ones to tell apart vertices that collide in the table.
+		U32 storedHash = static_cast<U32>(hash >> 32);
+		USize slot = static_cast<USize>(hash) & m_mask;
+
+		// Linear probing until either the vertex or an empty slot is found.
+		while (m_slots[slot].vertexIndex != EMPTY_SLOT)
+		{
+			if (m_slots[slot].hash == storedHash)
+			{
+				U32 otherKey[VERTEX_WORD_COUNT];
+				GetVertexKey(vertices[m_slots[slot].vertexIndex], otherKey);
+
+				if (memcmp(key, otherKey, sizeof(key)) == 0)
+				{
+					return m_slots[slot].vertexIndex;
+				}
+			}
+
+			slot = (slot + 1) & m_mask;
+		}
+
+		ASSERT(vertices.size() * 2 <= m_slots.size(), "Vertex welder is over capacity!");
+
+		U32 vertexIndex = static_cast<U32>(vertices.size());
+		m_slots[slot] = Slot{ vertexIndex, storedHash };
+		vertices.push_back(vertex);
+		return vertexIndex;
+	}
+
+	void LveVertexWelder::WeldSorted(USize cornerCount, const std::function<LveModel::Vertex(U32)>& getCorner,
+		std::vector<LveModel::Vertex>& vertices, std::vector<U32>& indices)
+	{
+		ASSERT(cornerCount <= EMPTY_SLOT, "Too many corners to weld!");
+
+		// (hash << 32 | corner) sorts corners with equal hashes next to each other, in corner order.
+		std::vector<U64> entries(cornerCount);
+		for (USize i = 0; i < cornerCount; i++)
+		{
+			U32 key[VERTEX_WORD_COUNT];
+			GetVertexKey(getCorner(static_cast<U32>(i)), key);
+			entries[i] = (HashVertexKey(key) & 0xffffffff00000000ull) | i;
+		}
+
+		std::sort(entries.begin(), entries.end());
+
+		// First pass: indices[i] is the first corner with the same vertex as corner i. Within a run of equal hashes the
+		// corners are ascending, so comparing against the distinct vertices seen so far in the run finds it. Runs
+		// hold one vertex apart from hash collisions.
+		indices.resize(cornerCount);
+
+		std::vector<U32> runFirstCorners{};
+		std::vector<LveModel::Vertex> runVertices{};
+
+		for (USize runBegin = 0; runBegin < cornerCount;)
+		{
+			U64 runHash = entries[runBegin] >> 32;
+			runFirstCorners.clear();
+			runVertices.clear();
+
+			USize i = runBegin;
+			for (; i < cornerCount && (entries[i] >> 32) == runHash; i++)
+			{
+				U32 corner = static_cast<U32>(entries[i]);
+
+				U32 key[VERTEX_WORD_COUNT];
+				GetVertexKey(getCorner(corner), key);
+
+				U32 firstCorner = corner;
+				for (USize j = 0; j < runVertices.size(); j++)
+				{
+					U32 otherKey[VERTEX_WORD_COUNT];
+					GetVertexKey(runVertices[j], otherKey);
+
+					if (memcmp(key, otherKey, sizeof(key)) == 0)
+					{
+						firstCorner = runFirstCorners[j];
+						break;
+					}
+				}
+
+				if (firstCorner == corner)
+				{
+					runFirstCorners.push_back(corner);
+					runVertices.push_back(getCorner(corner));
+				}
+
+				indices[corner] = firstCorner;
+			}
+
+			runBegin = i;
+		}
+
+		entries.clear();
+		entries.shrink_to_fit();
+
+		// Second pass in corner order. A corner that is its own first occurrence becomes a new vertex. Any other
+		// corner points to an earlier one, whose entry already holds its vertex index.
+		vertices.clear();
+
+		for (USize i = 0; i < cornerCount; i++)
+		{
+			if (indices[i] == i)
+			{
+				indices[i] = static_cast<U32>(vertices.size());
+				vertices.push_back(getCorner(static_cast<U32>(i)));
+			}
+			else
+			{
+				indices[i] = indices[indices[i]];
+			}
+		}
+	}
+
+} // namespace lve
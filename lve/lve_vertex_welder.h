@@ -0,0 +1,51 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/11/24.
+//
+
+#pragma once
+
+#include "core/core.h"
+
+#include "lve_model.h"
+
+#include <functional>
+#include <vector>
+
+namespace lve
+{
+	// Merges identical vertices of a mesh, either one at a time with a flat open-addressing table or all at once by
+	// sorting. Vertices are compared by their bits, except that -0.0 and +0.0 are treated as equal. The first occurrence
+	// of a vertex determines its position in the output, so both ways produce the same vertices and indices.
+	class LveVertexWelder
+	{
+	public:
+		// Above this many corners, Auto welding sorts instead of using the table (which would take 256 MB or more).
+		static constexpr USize SORT_MIN_CORNER_COUNT = 1 << 24;
+
+		// The table is sized for maxVertexCount vertices (e.g. the index count) and never grows.
+		explicit LveVertexWelder(USize maxVertexCount);
+
+		// Returns the index of the vertex in vertices, appending it if it has not been seen yet.
+		U32 Weld(const LveModel::Vertex& vertex, std::vector<LveModel::Vertex>& vertices);
+
+		// Welds all corners at once without a table. getCorner(i) returns the vertex of corner i and is called about
+		// three times per corner, so corners never have to be stored. Besides the output this needs 8 bytes per corner,
+		// half of what the table needs at its lowest load factor.
+		static void WeldSorted(USize cornerCount, const std::function<LveModel::Vertex(U32)>& getCorner,
+			std::vector<LveModel::Vertex>& vertices, std::vector<U32>& indices);
+
+	private:
+		static constexpr U32 EMPTY_SLOT = ~0u;
+
+		// The hash is kept next to the index, so probing only reads and compares a stored vertex when the hashes match.
+		struct Slot
+		{
+			U32 vertexIndex = EMPTY_SLOT;
+			U32 hash = 0;
+		};
+
+		std::vector<Slot> m_slots;
+		USize m_mask;
+	};
+
+} // namespace lve
@@ -4,9 +4,152 @@
 
 #include "first_app.h"
 
-int main()
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+
+static void PrintUsage(const char* program)
+{
+	PRINT("Usage: %s [options]", program);
+	PRINT("  --frames-in-flight <1-%u>", lve::LveSwapchain::MAX_FRAMES_IN_FLIGHT);
+	PRINT("  --image-count <count>    0 picks one more than the surface minimum");
+	PRINT("  --present-mode <fifo | fifo_relaxed | mailbox | immediate>");
+	PRINT("  --render-mode <cpu | gpu>");
+	PRINT("  --print-latency");
+}
+
+// Accepts only a decimal number in [min, max], without sign or trailing characters.
+static bool ParseU32(const char* text, U32 min, U32 max, U32& result)
+{
+	const char* end = text + std::strlen(text);
+
+	U32 value = 0;
+	std::from_chars_result parseResult = std::from_chars(text, end, value);
+
+	if (parseResult.ec != std::errc() || parseResult.ptr != end || value < min || value > max)
+	{
+		return false;
+	}
+
+	result = value;
+	return true;
+}
+
+static bool ParsePresentMode(const char* text, VkPresentModeKHR& result)
+{
+	if (std::strcmp(text, "fifo") == 0)
+	{
+		result = VK_PRESENT_MODE_FIFO_KHR;
+	}
+	else if (std::strcmp(text, "fifo_relaxed") == 0)
+	{
+		result = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+	}
+	else if (std::strcmp(text, "mailbox") == 0)
+	{
+		result = VK_PRESENT_MODE_MAILBOX_KHR;
+	}
+	else if (std::strcmp(text, "immediate") == 0)
+	{
+		result = VK_PRESENT_MODE_IMMEDIATE_KHR;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+static bool ParseRenderMode(const char* text, lve::SimpleRenderSystem::RenderMode& result)
 {
-	lve::FirstApp app{};
+	if (std::strcmp(text, "cpu") == 0)
+	{
+		result = lve::SimpleRenderSystem::RenderMode::CpuDriven;
+	}
+	else if (std::strcmp(text, "gpu") == 0)
+	{
+		result = lve::SimpleRenderSystem::RenderMode::GpuDriven;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+// Returns false and prints what is wrong if an option is unknown or its value is missing or invalid.
+static bool ParseArguments(int argc, char** argv, lve::FirstApp::Config& config)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* argument = argv[i];
+
+		if (std::strcmp(argument, "--print-latency") == 0)
+		{
+			config.printLatency = true;
+			continue;
+		}
+
+		bool isFramesInFlight = std::strcmp(argument, "--frames-in-flight") == 0;
+		bool isImageCount = std::strcmp(argument, "--image-count") == 0;
+		bool isPresentMode = std::strcmp(argument, "--present-mode") == 0;
+		bool isRenderMode = std::strcmp(argument, "--render-mode") == 0;
+
+		if (!isFramesInFlight && !isImageCount && !isPresentMode && !isRenderMode)
+		{
+			PRINT("Unknown option: %s", argument);
+			return false;
+		}
+
+		if (i + 1 >= argc)
+		{
+			PRINT("Missing value for %s", argument);
+			return false;
+		}
+
+		const char* value = argv[++i];
+		bool isValid = false;
+
+		if (isFramesInFlight)
+		{
+			isValid = ParseU32(value, 1, lve::LveSwapchain::MAX_FRAMES_IN_FLIGHT, config.swapchain.framesInFlight);
+		}
+		else if (isImageCount)
+		{
+			isValid = ParseU32(value, 0, UINT32_MAX, config.swapchain.imageCount);
+		}
+		else if (isPresentMode)
+		{
+			isValid = ParsePresentMode(value, config.swapchain.presentMode);
+		}
+		else
+		{
+			isValid = ParseRenderMode(value, config.renderMode);
+		}
+
+		if (!isValid)
+		{
+			PRINT("Invalid value for %s: %s", argument, value);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	lve::FirstApp::Config config{};
+
+	if (!ParseArguments(argc, argv, config))
+	{
+		PrintUsage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	lve::FirstApp app{ config };
 
 	app.Run();
 
@@ -1,5 +1,9 @@
+set -e
+
 /usr/local/bin/glslc simple_shader.vert -o simple_shader.vert.spv
+/usr/local/bin/glslc simple_shader_compact.vert -o simple_shader_compact.vert.spv
 /usr/local/bin/glslc simple_shader.frag -o simple_shader.frag.spv
 /usr/local/bin/glslc point_light.vert -o point_light.vert.spv
 /usr/local/bin/glslc point_light.frag -o point_light.frag.spv
+/usr/local/bin/glslc cull.comp -o cull.comp.spv
 echo "Done compiling shaders. ✅"
@@ -5,6 +5,10 @@ layout (location = 1) in vec3 color;
 layout (location = 2) in vec3 normal;
 layout (location = 3) in vec3 uv;
 
+// Per-instance data (a mat4 takes four locations)
+layout (location = 4) in mat4 instanceModelMatrix;
+layout (location = 8) in mat4 instanceNormalMatrix;
+
 layout (location = 0) out vec3 fragColor;
 layout (location = 1) out vec3 fragPositionWS;
 layout (location = 2) out vec3 fragNormalWS;
@@ -18,18 +22,12 @@ layout (set = 0, binding = 0) uniform GlobalUbo
 	vec4 lightColor;
 } ubo;
 
-layout (push_constant) uniform Push
-{
-	mat4 modelMatrix;
-	mat4 normalMatrix;
-} push;
-
 void main()
 {
-	vec4 positionWS = push.modelMatrix * vec4(position, 1.0);
+	vec4 positionWS = instanceModelMatrix * vec4(position, 1.0);
 	gl_Position = ubo.projectionMatrix * ubo.viewMatrix * positionWS;
 
-	fragNormalWS = normalize(mat3(push.normalMatrix) * normal);
+	fragNormalWS = normalize(mat3(instanceNormalMatrix) * normal);
 	fragPositionWS = positionWS.xyz;
 	fragColor = color;
 }
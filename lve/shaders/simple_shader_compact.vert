@@ -0,0 +1,45 @@
+#version 450
+
+// Compact vertex layout (see LveModel::CompactVertex). Normalized and half formats arrive as floats.
+layout (location = 0) in vec3 position; // relative to model bounds, dequantized by the model matrix
+layout (location = 1) in vec3 color;
+layout (location = 2) in vec2 octNormal;
+layout (location = 3) in vec2 uv;
+
+// Per-instance data (a mat4 takes four locations)
+layout (location = 4) in mat4 instanceModelMatrix;
+layout (location = 8) in mat4 instanceNormalMatrix;
+
+layout (location = 0) out vec3 fragColor;
+layout (location = 1) out vec3 fragPositionWS;
+layout (location = 2) out vec3 fragNormalWS;
+
+layout (set = 0, binding = 0) uniform GlobalUbo
+{
+	mat4 projectionMatrix;
+	mat4 viewMatrix;
+	vec4 ambientLightColor;
+	vec3 lightPosition;
+	vec4 lightColor;
+} ubo;
+
+vec3 DecodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+void main()
+{
+	vec3 normal = DecodeOctahedral(octNormal);
+
+	vec4 positionWS = instanceModelMatrix * vec4(position, 1.0);
+	gl_Position = ubo.projectionMatrix * ubo.viewMatrix * positionWS;
+
+	fragNormalWS = normalize(mat3(instanceNormalMatrix) * normal);
+	fragPositionWS = positionWS.xyz;
+	fragColor = color;
+}
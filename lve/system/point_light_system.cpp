@@ -15,6 +15,8 @@ namespace lve
 
 	PointLightSystem::~PointLightSystem()
 	{
+		// The pipeline may still be building with the layout.
+		m_pipeline.reset();
 		vkDestroyPipelineLayout(m_device.GetDevice(), m_pipelineLayout, nullptr);
 	}
 
@@ -45,35 +47,45 @@ namespace lve
 	{
 		ASSERT(m_pipelineLayout, "Could not create pipeline before pipeline layout!");
 
-		PipelineConfigInfo pipelineConfig{};
-		LvePipeline::DefaultPipelineConfigInfo(pipelineConfig);
+		m_pipeline = MakeUniqueRef<LvePipelineFuture>([&device = m_device, pipelineLayout = m_pipelineLayout, renderPass]() {
+			PipelineConfigInfo pipelineConfig{};
+			LvePipeline::DefaultPipelineConfigInfo(pipelineConfig);
 
-		pipelineConfig.attributeDescriptions.clear();
-		pipelineConfig.bindingDescriptions.clear();
+			pipelineConfig.attributeDescriptions.clear();
+			pipelineConfig.bindingDescriptions.clear();
 
-		pipelineConfig.renderPass = renderPass;
-		pipelineConfig.pipelineLayout = m_pipelineLayout;
-		m_pipeline =
-			MakeUniqueRef<LvePipeline>(m_device, "shaders/point_light.vert.spv", "shaders/point_light.frag.spv", pipelineConfig);
+			pipelineConfig.renderPass = renderPass;
+			pipelineConfig.pipelineLayout = pipelineLayout;
+			return MakeUniqueRef<LvePipeline>(device, "shaders/point_light.vert.spv", "shaders/point_light.frag.spv", pipelineConfig);
+		});
+	}
+
+	void PointLightSystem::RecreatePipeline(VkRenderPass renderPass)
+	{
+		// Destroying a pipeline is deferred until frames in flight are done with it.
+		m_pipeline.reset();
+		CreatePipeline(renderPass);
 	}
 
 	void PointLightSystem::Render(FrameInfo& frameInfo)
 	{
-		// Bind graphics pipeline.
-		m_pipeline->Bind(frameInfo.commandBuffer);
-
-		// Bind descriptor set.
-		vkCmdBindDescriptorSets(
-			frameInfo.commandBuffer,
-			VK_PIPELINE_BIND_POINT_GRAPHICS,
-			m_pipelineLayout,
-			0,
-			1,
-			&frameInfo.globalDescriptorSet,
-			0,
-			nullptr);
-
-		vkCmdDraw(frameInfo.commandBuffer, 6, 1, 0, 0);
+		frameInfo.renderer.RecordInRenderPass(frameInfo.commandBuffer, 0, [&](VkCommandBuffer commandBuffer) {
+			// Bind graphics pipeline.
+			m_pipeline->Get().Bind(commandBuffer);
+
+			// Bind descriptor set.
+			vkCmdBindDescriptorSets(
+				commandBuffer,
+				VK_PIPELINE_BIND_POINT_GRAPHICS,
+				m_pipelineLayout,
+				0,
+				1,
+				&frameInfo.globalDescriptorSet,
+				1,
+				&frameInfo.globalUboOffset);
+
+			vkCmdDraw(commandBuffer, 6, 1, 0, 0);
+		});
 	}
 
 } // namespace lve
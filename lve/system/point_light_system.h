@@ -9,7 +9,6 @@
 #include "lve/lve_camera.h"
 #include "lve/lve_device.h"
 #include "lve/lve_pipeline.h"
-#include "lve/lve_game_object.h"
 #include "lve/lve_frame_info.h"
 
 #include <vector>
@@ -28,6 +27,9 @@ namespace lve
 
 		void Render(FrameInfo& frameInfo);
 
+		// Rebuild the pipeline for a render pass that is not compatible with the previous one.
+		void RecreatePipeline(VkRenderPass renderPass);
+
 	private:
 		void CreatePipelineLayout(VkDescriptorSetLayout globalDescriptorSetLayout);
 		void CreatePipeline(VkRenderPass renderPass);
@@ -35,7 +37,7 @@ namespace lve
 	private:
 		LveDevice& m_device;
 
-		UniqueRef<LvePipeline> m_pipeline;
+		UniqueRef<LvePipelineFuture> m_pipeline;
 		VkPipelineLayout m_pipelineLayout;
 	};
 
@@ -6,7 +6,8 @@
 
 #include "core/core.h"
 
-#include "lve/lve_game_object.h"
+#include "lve/lve_components.h"
+#include "lve/lve_registry.h"
 
 #include <memory>
 #include <random>
@@ -27,8 +28,8 @@ namespace lve {
 			m_elapsedTime = m_flickerRate;
 		}
 
-		// Randomly select a color for each game object every m_flickerRate seconds.
-		void Update(std::vector<LveGameObject>& gameObjects)
+		// Randomly select a color for each entity with a color component every m_flickerRate seconds.
+		void Update(LveRegistry& registry)
 		{
 			F32 deltaTime = 0;
 
@@ -40,11 +41,10 @@ namespace lve {
 
 				std::uniform_int_distribution<int> randInt{ 0, static_cast<int>(m_colors.size()) - 1 };
 
-				for (auto& object : gameObjects)
-				{
+				registry.View<ColorComponent>().Each([&](LveEntity, ColorComponent& colorComponent) {
 					int randValue = randInt(m_rng);
-					object.color = m_colors[randValue];
-				}
+					colorComponent.color = m_colors[randValue];
+				});
 			}
 		}
 
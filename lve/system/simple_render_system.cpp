@@ -4,92 +4,853 @@
 
 #include "simple_render_system.h"
 
+#include "lve/lve_swapchain.h"
+
+#include "core/job_system.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <numeric>
+#include <unordered_map>
+
 namespace lve
 {
-	struct SimplePushConstantData
+	// Instance data uses binding 1, right after the per-vertex binding of LveModel::Vertex.
+	static constexpr U32 INSTANCE_BINDING = 1;
+	static constexpr U32 INSTANCE_FIRST_LOCATION = 4;
+	static constexpr U32 INSTANCE_MIN_CAPACITY = 64;
+	static constexpr U32 BATCH_MIN_CAPACITY = 16;
+	// Fewer draws than this per secondary command buffer are not worth a job.
+	static constexpr U32 MIN_DRAW_GROUPS_PER_RECORDER = 256;
+
+	static constexpr U32 NO_OBJECT = ~0u;
+
+	// Must match local_size_x in shaders/cull.comp.
+	static constexpr U32 CULL_WORKGROUP_SIZE = 64;
+
+	// Indirect draw command of a GPU-driven batch. Non-indexed batches use the first 16 bytes as VkDrawIndirectCommand,
+	// which has instanceCount at the same offset, so the culling shader counts instances of both the same way.
+	union DrawCommandSlot
+	{
+		VkDrawIndexedIndirectCommand indexed;
+		VkDrawIndirectCommand nonIndexed;
+	};
+
+	static_assert(offsetof(VkDrawIndexedIndirectCommand, instanceCount) == offsetof(VkDrawIndirectCommand, instanceCount));
+
+	struct CullPushConstants
 	{
-		Matrix4 modelMatrix{ 1.0f };
-		Matrix4 normalMatrix{ 1.0f };
+		Vector4 frustumPlanes[6];
+		U32 objectCount;
 	};
 
-	SimpleRenderSystem::SimpleRenderSystem(LveDevice& device, VkRenderPass renderPass, VkDescriptorSetLayout globalDescriptorSetLayout)
-		: m_device(device)
+	// Orders models so that models with the same pipeline and pool buffers are next to each other.
+	static bool CompareModels(const LveModel* a, const LveModel* b)
+	{
+		if (a->GetVertexFormat() != b->GetVertexFormat())
+		{
+			return a->GetVertexFormat() < b->GetVertexFormat();
+		}
+		if (a->GetVertexBuffer() != b->GetVertexBuffer())
+		{
+			return a->GetVertexBuffer() < b->GetVertexBuffer();
+		}
+		if (a->GetIndexBuffer() != b->GetIndexBuffer())
+		{
+			return a->GetIndexBuffer() < b->GetIndexBuffer();
+		}
+		return a < b;
+	}
+
+	// Makes sure the buffer holds at least count instances, growing it geometrically. Host-visible buffers are mapped.
+	// Returns whether a new buffer was created. The old one is destroyed once frames in flight are done with it.
+	static bool ReserveBuffer(LveDevice& device, UniqueRef<LveBuffer>& buffer, VkDeviceSize instanceSize, U32 count,
+		U32 minCapacity, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags)
+	{
+		if (buffer && buffer->GetInstanceCount() >= count)
+		{
+			return false;
+		}
+
+		U32 capacity = buffer ? buffer->GetInstanceCount() : minCapacity;
+		while (capacity < count)
+		{
+			capacity *= 2;
+		}
+
+		buffer = MakeUniqueRef<LveBuffer>(device, instanceSize, capacity, usageFlags, memoryPropertyFlags);
+
+		if (memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		{
+			buffer->Map();
+		}
+
+		return true;
+	}
+
+	std::vector<VkVertexInputBindingDescription> InstanceData::GetBindingDescriptions()
+	{
+		std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
+		bindingDescriptions[0].binding = INSTANCE_BINDING;
+		bindingDescriptions[0].stride = sizeof(InstanceData);
+		bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+		return bindingDescriptions;
+	}
+
+	std::vector<VkVertexInputAttributeDescription> InstanceData::GetAttributeDescriptions()
+	{
+		// A mat4 attribute takes 4 consecutive locations, one for each column.
+		std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
+		U32 location = INSTANCE_FIRST_LOCATION;
+
+		for (U32 column = 0; column < 4; ++column)
+		{
+			U32 offset = static_cast<U32>(offsetof(InstanceData, modelMatrix) + sizeof(Vector4) * column);
+			attributeDescriptions.push_back({ location++, INSTANCE_BINDING, VK_FORMAT_R32G32B32A32_SFLOAT, offset });
+		}
+
+		for (U32 column = 0; column < 4; ++column)
+		{
+			U32 offset = static_cast<U32>(offsetof(InstanceData, normalMatrix) + sizeof(Vector4) * column);
+			attributeDescriptions.push_back({ location++, INSTANCE_BINDING, VK_FORMAT_R32G32B32A32_SFLOAT, offset });
+		}
+
+		return attributeDescriptions;
+	}
+
+	SimpleRenderSystem::SimpleRenderSystem(LveDevice& device, VkRenderPass renderPass, VkDescriptorSetLayout globalDescriptorSetLayout,
+		RenderMode renderMode)
+		: m_device(device), m_instanceBuffers(LveSwapchain::MAX_FRAMES_IN_FLIGHT), m_renderMode(renderMode)
 	{
 		CreatePipelineLayout(globalDescriptorSetLayout);
-		CreatePipeline(renderPass);
+		CreatePipelines(renderPass);
+
+		if (m_renderMode == RenderMode::GpuDriven)
+		{
+			CreateCullPipeline();
+		}
 	}
 
 	SimpleRenderSystem::~SimpleRenderSystem()
 	{
+		// Pipelines may still be building with the layouts.
+		m_pipelines.clear();
+		m_cullPipeline.reset();
+
+		if (m_cullPipelineLayout != VK_NULL_HANDLE)
+		{
+			vkDestroyPipelineLayout(m_device.GetDevice(), m_cullPipelineLayout, nullptr);
+		}
+
 		vkDestroyPipelineLayout(m_device.GetDevice(), m_pipelineLayout, nullptr);
 	}
 
 	void SimpleRenderSystem::CreatePipelineLayout(VkDescriptorSetLayout globalDescriptorSetLayout)
 	{
-		VkPushConstantRange pushConstantRange{};
-		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-		pushConstantRange.offset = 0;
-		pushConstantRange.size = sizeof(SimplePushConstantData);
-
 		std::vector<VkDescriptorSetLayout> descriptorSetLayouts{ globalDescriptorSetLayout };
 
 		// This will be referenced throughout the program's lifetime.
+		// Per-object data comes from the instance buffer, so no push constants are needed.
 		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 
 		pipelineLayoutInfo.setLayoutCount = static_cast<U32>(descriptorSetLayouts.size());
 		pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
 
-		pipelineLayoutInfo.pushConstantRangeCount = 1;
-		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+		pipelineLayoutInfo.pushConstantRangeCount = 0;
+		pipelineLayoutInfo.pPushConstantRanges = nullptr;
 
 		VkResult result = vkCreatePipelineLayout(m_device.GetDevice(), &pipelineLayoutInfo, nullptr, &m_pipelineLayout);
 		ASSERT_EQ(result, VK_SUCCESS, "Failed to create pipeline layout!");
 	}
 
-	void SimpleRenderSystem::CreatePipeline(VkRenderPass renderPass)
+	void SimpleRenderSystem::CreatePipelines(VkRenderPass renderPass)
 	{
 		ASSERT(m_pipelineLayout, "Could not create pipeline before pipeline layout!");
 
-		PipelineConfigInfo pipelineConfig{};
-		LvePipeline::DefaultPipelineConfigInfo(pipelineConfig);
+		struct VertexFormatInfo
+		{
+			LveModel::VertexFormat vertexFormat;
+			std::vector<VkVertexInputBindingDescription> bindingDescriptions;
+			std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
+			const char* vertFilepath;
+		};
+
+		VertexFormatInfo vertexFormatInfos[] = {
+			{ LveModel::VertexFormat::Standard, LveModel::Vertex::GetBindingDescriptions(),
+				LveModel::Vertex::GetAttributeDescriptions(), "shaders/simple_shader.vert.spv" },
+			{ LveModel::VertexFormat::Compact, LveModel::CompactVertex::GetBindingDescriptions(),
+				LveModel::CompactVertex::GetAttributeDescriptions(), "shaders/simple_shader_compact.vert.spv" },
+		};
+
+		// Append the per-instance binding and attributes after the per-vertex ones.
+		std::vector<VkVertexInputBindingDescription> instanceBindings = InstanceData::GetBindingDescriptions();
+		std::vector<VkVertexInputAttributeDescription> instanceAttributes = InstanceData::GetAttributeDescriptions();
+
+		m_pipelines.resize(std::size(vertexFormatInfos));
 
-		pipelineConfig.renderPass = renderPass;
-		pipelineConfig.pipelineLayout = m_pipelineLayout;
-		m_pipeline =
-			MakeUniqueRef<LvePipeline>(m_device, "shaders/simple_shader.vert.spv", "shaders/simple_shader.frag.spv", pipelineConfig);
+		for (VertexFormatInfo& info : vertexFormatInfos)
+		{
+			// Each pipeline is built on a worker. The config is made there too, as it holds pointers into itself.
+			info.bindingDescriptions.insert(info.bindingDescriptions.end(), instanceBindings.begin(), instanceBindings.end());
+			info.attributeDescriptions.insert(info.attributeDescriptions.end(), instanceAttributes.begin(), instanceAttributes.end());
+
+			m_pipelines[static_cast<USize>(info.vertexFormat)] = MakeUniqueRef<LvePipelineFuture>(
+				[&device = m_device, pipelineLayout = m_pipelineLayout, renderPass, info]() {
+					PipelineConfigInfo pipelineConfig{};
+					LvePipeline::DefaultPipelineConfigInfo(pipelineConfig);
+
+					pipelineConfig.bindingDescriptions = info.bindingDescriptions;
+					pipelineConfig.attributeDescriptions = info.attributeDescriptions;
+
+					pipelineConfig.renderPass = renderPass;
+					pipelineConfig.pipelineLayout = pipelineLayout;
+					return MakeUniqueRef<LvePipeline>(device, info.vertFilepath, "shaders/simple_shader.frag.spv", pipelineConfig);
+				});
+		}
 	}
 
-	void SimpleRenderSystem::RenderGameObjects(FrameInfo& frameInfo)
+	void SimpleRenderSystem::RecreatePipelines(VkRenderPass renderPass)
 	{
-		// Bind graphics pipeline.
-		m_pipeline->Bind(frameInfo.commandBuffer);
+		// Destroying a pipeline is deferred until frames in flight are done with it.
+		m_pipelines.clear();
+		CreatePipelines(renderPass);
+	}
 
-		// Bind descriptor set.
+	void SimpleRenderSystem::CreateCullPipeline()
+	{
+		m_cullDescriptorSetLayout =
+			LveDescriptorSetLayout::Builder(m_device)
+				.AddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT) // objects
+				.AddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT) // draw commands
+				.AddBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT) // instances
+				.AddBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT) // batches
+				.Build();
+
+		m_cullDescriptorPool =
+			LveDescriptorPool::Builder(m_device)
+				.SetMaxSets(LveSwapchain::MAX_FRAMES_IN_FLIGHT)
+				.AddPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 * LveSwapchain::MAX_FRAMES_IN_FLIGHT)
+				.Build();
+
+		m_gpuFrames.resize(LveSwapchain::MAX_FRAMES_IN_FLIGHT);
+
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(CullPushConstants);
+
+		VkDescriptorSetLayout descriptorSetLayout = m_cullDescriptorSetLayout->GetDescriptorSetLayout();
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		VkResult result = vkCreatePipelineLayout(m_device.GetDevice(), &pipelineLayoutInfo, nullptr, &m_cullPipelineLayout);
+		ASSERT_EQ(result, VK_SUCCESS, "Failed to create pipeline layout!");
+
+		m_cullPipeline = MakeUniqueRef<LvePipelineFuture>([&device = m_device, pipelineLayout = m_cullPipelineLayout]() {
+			return MakeUniqueRef<LvePipeline>(device, "shaders/cull.comp.spv", pipelineLayout);
+		});
+	}
+
+	void SimpleRenderSystem::ReserveInstanceBuffer(U32 frameIndex, U32 instanceCount)
+	{
+		UniqueRef<LveBuffer>& instanceBuffer = m_instanceBuffers[frameIndex];
+
+		if (instanceBuffer && instanceBuffer->GetInstanceCount() >= instanceCount)
+		{
+			return;
+		}
+
+		// Grow geometrically to avoid reallocating every time a few objects are added. The old buffer of this frame
+		// index is not in use by the GPU anymore, because the renderer has waited for its fence in BeginFrame.
+		U32 capacity = instanceBuffer ? instanceBuffer->GetInstanceCount() : INSTANCE_MIN_CAPACITY;
+		while (capacity < instanceCount)
+		{
+			capacity *= 2;
+		}
+
+		instanceBuffer = MakeUniqueRef<LveBuffer>(
+			m_device,
+			sizeof(InstanceData),
+			capacity,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+		// Keep it mapped for the buffer's lifetime.
+		instanceBuffer->Map();
+	}
+
+	void SimpleRenderSystem::ReserveObjectBuffer(U32 objectCount)
+	{
+		// Frames in flight may still cull with the old buffer, so it is destroyed once they are done.
+		if (ReserveBuffer(m_device, m_objectBuffer, sizeof(GpuObjectData), objectCount, INSTANCE_MIN_CAPACITY,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT))
+		{
+			++m_objectBufferVersion;
+		}
+	}
+
+	void SimpleRenderSystem::ReserveGpuBuffers(U32 frameIndex, U32 objectCount, U32 batchCount, U32 uploadCount)
+	{
+		GpuFrameResources& frame = m_gpuFrames[frameIndex];
+
+		// Buffers of this frame index are not in use by the GPU anymore, see ReserveInstanceBuffer.
+		VkMemoryPropertyFlags hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+		// Every object may be visible, so the instance buffer has room for all of them.
+		bool isResized = ReserveBuffer(m_device, frame.instanceBuffer, sizeof(InstanceData), objectCount, INSTANCE_MIN_CAPACITY,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		isResized |= ReserveBuffer(m_device, frame.drawCommandBuffer, sizeof(DrawCommandSlot), batchCount,
+			BATCH_MIN_CAPACITY, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, hostVisible);
+
+		isResized |= ReserveBuffer(m_device, frame.batchBuffer, sizeof(GpuBatchData), batchCount, BATCH_MIN_CAPACITY,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible);
+
+		if (uploadCount > 0)
+		{
+			ReserveBuffer(m_device, frame.stagingBuffer, sizeof(GpuObjectData), uploadCount, INSTANCE_MIN_CAPACITY,
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT, hostVisible);
+		}
+
+		if (!isResized && frame.objectBufferVersion == m_objectBufferVersion)
+		{
+			return;
+		}
+
+		VkDescriptorBufferInfo objectBufferInfo = m_objectBuffer->DescriptorInfo();
+		VkDescriptorBufferInfo drawCommandBufferInfo = frame.drawCommandBuffer->DescriptorInfo();
+		VkDescriptorBufferInfo instanceBufferInfo = frame.instanceBuffer->DescriptorInfo();
+		VkDescriptorBufferInfo batchBufferInfo = frame.batchBuffer->DescriptorInfo();
+
+		LveDescriptorWriter writer(*m_cullDescriptorSetLayout, *m_cullDescriptorPool);
+		writer.WriteBuffer(0, &objectBufferInfo)
+			.WriteBuffer(1, &drawCommandBufferInfo)
+			.WriteBuffer(2, &instanceBufferInfo)
+			.WriteBuffer(3, &batchBufferInfo);
+
+		if (frame.descriptorSet == VK_NULL_HANDLE)
+		{
+			bool success = writer.Build(frame.descriptorSet);
+			ASSERT(success, "Failed to allocate culling descriptor set!");
+		}
+		else
+		{
+			writer.Overwrite(frame.descriptorSet);
+		}
+
+		frame.objectBufferVersion = m_objectBufferVersion;
+	}
+
+	void SimpleRenderSystem::RebuildBatches(LveRegistry& registry)
+	{
+		LveComponentPool<TransformComponent>& transforms = registry.GetPool<TransformComponent>();
+		LveComponentPool<ModelComponent>& models = registry.GetPool<ModelComponent>();
+
+		// Slots follow the transform pool order, so the changed transforms of a frame map to ascending slots.
+		U32 transformCount = static_cast<U32>(transforms.Size());
+		m_objectSlots.assign(transformCount, ObjectSlot{ NO_OBJECT, 0 });
+		m_objectCount = 0;
+
+		m_batchModels.clear();
+		std::vector<U32> batchObjectCounts{};
+		std::unordered_map<LveModel*, U32> batchIndices{};
+
+		for (U32 i = 0; i < transformCount; ++i)
+		{
+			ModelComponent* modelComponent = models.TryGet(transforms.GetEntity(i));
+			if (modelComponent == nullptr || modelComponent->model == nullptr)
+			{
+				continue;
+			}
+
+			LveModel* model = modelComponent->model.get();
+
+			auto [it, isInserted] = batchIndices.emplace(model, static_cast<U32>(m_batchModels.size()));
+			if (isInserted)
+			{
+				m_batchModels.push_back(model);
+				batchObjectCounts.push_back(0);
+			}
+
+			++batchObjectCounts[it->second];
+			m_objectSlots[i] = { m_objectCount++, it->second };
+		}
+
+		// Sort the batches. Each one owns a range of the instance buffer large enough for all of its objects.
+		U32 batchCount = static_cast<U32>(m_batchModels.size());
+		std::vector<U32> order(batchCount);
+		std::iota(order.begin(), order.end(), 0u);
+		std::sort(order.begin(), order.end(), [this](U32 a, U32 b) { return CompareModels(m_batchModels[a], m_batchModels[b]); });
+
+		std::vector<LveModel*> sortedModels(batchCount);
+		std::vector<U32> sortedIndices(batchCount);
+		m_batchFirstInstances.resize(batchCount);
+
+		U32 firstInstance = 0;
+		for (U32 i = 0; i < batchCount; ++i)
+		{
+			sortedModels[i] = m_batchModels[order[i]];
+			sortedIndices[order[i]] = i;
+			m_batchFirstInstances[i] = firstInstance;
+			firstInstance += batchObjectCounts[order[i]];
+		}
+
+		m_batchModels.swap(sortedModels);
+
+		for (ObjectSlot& objectSlot : m_objectSlots)
+		{
+			if (objectSlot.slot != NO_OBJECT)
+			{
+				objectSlot.batchIndex = sortedIndices[objectSlot.batchIndex];
+			}
+		}
+
+		m_modelPoolVersion = models.GetVersion();
+		m_transformPoolVersion = transforms.GetVersion();
+	}
+
+	void SimpleRenderSystem::UploadObjects(FrameInfo& frameInfo, const LveComponentPool<TransformComponent>& transforms)
+	{
+		if (m_uploadIndices.empty())
+		{
+			return;
+		}
+
+		GpuFrameResources& frame = m_gpuFrames[frameInfo.frameIndex];
+		auto* stagedObjects = static_cast<GpuObjectData*>(frame.stagingBuffer->GetMappedMemory());
+		const TransformComponent* transformData = transforms.Data();
+
+		// Upload indices are ascending and so are their slots, so neighbouring objects share a copy region.
+		m_uploadRegions.clear();
+
+		for (U32 i = 0; i < static_cast<U32>(m_uploadIndices.size()); ++i)
+		{
+			U32 index = m_uploadIndices[i];
+			const ObjectSlot& objectSlot = m_objectSlots[index];
+
+			GpuObjectData& object = stagedObjects[i];
+			object.modelMatrix = transformData[index].GetWorldMatrix();
+			object.normalMatrix = transformData[index].GetWorldNormalMatrix();
+			object.batchIndex = objectSlot.batchIndex;
+
+			VkDeviceSize srcOffset = sizeof(GpuObjectData) * i;
+			VkDeviceSize dstOffset = sizeof(GpuObjectData) * objectSlot.slot;
+
+			if (!m_uploadRegions.empty() && m_uploadRegions.back().srcOffset + m_uploadRegions.back().size == srcOffset &&
+				m_uploadRegions.back().dstOffset + m_uploadRegions.back().size == dstOffset)
+			{
+				m_uploadRegions.back().size += sizeof(GpuObjectData);
+			}
+			else
+			{
+				m_uploadRegions.push_back({ srcOffset, dstOffset, sizeof(GpuObjectData) });
+			}
+		}
+
+		// Culling of earlier frames reads the object buffer, so the copy waits for it. The culling of this frame then
+		// waits for the copy.
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(frameInfo.commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1,
+			&barrier, 0, nullptr, 0, nullptr);
+
+		vkCmdCopyBuffer(frameInfo.commandBuffer, frame.stagingBuffer->GetBuffer(), m_objectBuffer->GetBuffer(),
+			static_cast<U32>(m_uploadRegions.size()), m_uploadRegions.data());
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(frameInfo.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+			&barrier, 0, nullptr, 0, nullptr);
+	}
+
+	void SimpleRenderSystem::PrepareGameObjects(FrameInfo& frameInfo, const TransformSystem& transformSystem)
+	{
+		if (m_renderMode != RenderMode::GpuDriven)
+		{
+			return;
+		}
+
+		LveComponentPool<TransformComponent>& transforms = frameInfo.registry.GetPool<TransformComponent>();
+		LveComponentPool<ModelComponent>& models = frameInfo.registry.GetPool<ModelComponent>();
+
+		// Slots and batches only change when components are added, removed or reordered. Otherwise only objects whose
+		// world matrix changed are uploaded.
+		m_uploadIndices.clear();
+
+		if (models.GetVersion() != m_modelPoolVersion || transforms.GetVersion() != m_transformPoolVersion)
+		{
+			RebuildBatches(frameInfo.registry);
+
+			for (U32 i = 0; i < static_cast<U32>(m_objectSlots.size()); ++i)
+			{
+				if (m_objectSlots[i].slot != NO_OBJECT)
+				{
+					m_uploadIndices.push_back(i);
+				}
+			}
+		}
+		else
+		{
+			for (U32 index : transformSystem.GetChangedIndices())
+			{
+				if (m_objectSlots[index].slot != NO_OBJECT)
+				{
+					m_uploadIndices.push_back(index);
+				}
+			}
+		}
+
+		if (m_objectCount == 0)
+		{
+			return;
+		}
+
+		// The object count only changes in RebuildBatches, which uploads every object, so a new object buffer is
+		// always filled.
+		U32 batchCount = static_cast<U32>(m_batchModels.size());
+		ReserveObjectBuffer(m_objectCount);
+		ReserveGpuBuffers(frameInfo.frameIndex, m_objectCount, batchCount, static_cast<U32>(m_uploadIndices.size()));
+		GpuFrameResources& frame = m_gpuFrames[frameInfo.frameIndex];
+
+		// Draw commands and batch data are written per model. The compute shader counts visible instances in
+		// instanceCount, which starts at zero.
+		bool hasFirstInstance = m_device.GetEnabledFeatures().drawIndirectFirstInstance;
+		auto* drawCommands = static_cast<DrawCommandSlot*>(frame.drawCommandBuffer->GetMappedMemory());
+		auto* batches = static_cast<GpuBatchData*>(frame.batchBuffer->GetMappedMemory());
+
+		for (U32 i = 0; i < batchCount; ++i)
+		{
+			LveModel* model = m_batchModels[i];
+			// Without drawIndirectFirstInstance, the instance buffer is bound at the batch's offset instead.
+			U32 firstInstance = hasFirstInstance ? m_batchFirstInstances[i] : 0;
+
+			if (model->HasIndexBuffer())
+			{
+				VkDrawIndexedIndirectCommand& drawCommand = drawCommands[i].indexed;
+				drawCommand.indexCount = model->GetIndexCount();
+				drawCommand.instanceCount = 0;
+				drawCommand.firstIndex = model->GetFirstIndex();
+				drawCommand.vertexOffset = static_cast<I32>(model->GetVertexOffset());
+				drawCommand.firstInstance = firstInstance;
+			}
+			else
+			{
+				VkDrawIndirectCommand& drawCommand = drawCommands[i].nonIndexed;
+				drawCommand.vertexCount = model->GetVertexCount();
+				drawCommand.instanceCount = 0;
+				drawCommand.firstVertex = model->GetVertexOffset();
+				drawCommand.firstInstance = firstInstance;
+			}
+
+			Matrix4 dequantizeMatrix = model->GetDequantizeMatrix();
+
+			GpuBatchData& batch = batches[i];
+			batch.boundingSphere = model->GetBoundingSphere();
+			batch.dequantizeScale = Vector4(dequantizeMatrix[0][0], dequantizeMatrix[1][1], dequantizeMatrix[2][2], 0.0f);
+			batch.dequantizeOffset = dequantizeMatrix[3];
+			batch.firstInstance = m_batchFirstInstances[i];
+		}
+
+		UploadObjects(frameInfo, transforms);
+
+		// Cull
+		CullPushConstants push{};
+		frameInfo.camera.GetFrustumPlanes(push.frustumPlanes);
+		push.objectCount = m_objectCount;
+
+		m_cullPipeline->Get().Bind(frameInfo.commandBuffer);
 		vkCmdBindDescriptorSets(
 			frameInfo.commandBuffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			m_cullPipelineLayout,
+			0,
+			1,
+			&frame.descriptorSet,
+			0,
+			nullptr);
+		vkCmdPushConstants(frameInfo.commandBuffer, m_cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants), &push);
+		vkCmdDispatch(frameInfo.commandBuffer, (m_objectCount + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+
+		// Make draw commands and instances visible to the indirect draws.
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+
+		vkCmdPipelineBarrier(frameInfo.commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	void SimpleRenderSystem::RenderGameObjects(FrameInfo& frameInfo)
+	{
+		if (m_renderMode == RenderMode::GpuDriven)
+		{
+			// A handful of indirect draws, so recording on several threads would not pay off.
+			frameInfo.renderer.RecordInRenderPass(frameInfo.commandBuffer, 0, [&](VkCommandBuffer commandBuffer) {
+				RenderGpuDriven(frameInfo, commandBuffer);
+			});
+		}
+		else
+		{
+			RenderCpuDriven(frameInfo);
+		}
+	}
+
+	void SimpleRenderSystem::RenderGpuDriven(FrameInfo& frameInfo, VkCommandBuffer commandBuffer)
+	{
+		if (m_batchModels.empty())
+		{
+			return;
+		}
+
+		GpuFrameResources& frame = m_gpuFrames[frameInfo.frameIndex];
+
+		vkCmdBindDescriptorSets(
+			commandBuffer,
 			VK_PIPELINE_BIND_POINT_GRAPHICS,
 			m_pipelineLayout,
 			0,
 			1,
 			&frameInfo.globalDescriptorSet,
+			1,
+			&frameInfo.globalUboOffset);
+
+		VkBuffer instanceBuffers[] = { frame.instanceBuffer->GetBuffer() };
+		VkDeviceSize instanceOffsets[] = { 0 };
+		vkCmdBindVertexBuffers(commandBuffer, INSTANCE_BINDING, 1, instanceBuffers, instanceOffsets);
+
+		const VkPhysicalDeviceFeatures& features = m_device.GetEnabledFeatures();
+		bool canMultiDraw = features.multiDrawIndirect && features.drawIndirectFirstInstance;
+		U32 maxDrawCount = canMultiDraw ? m_device.properties.limits.maxDrawIndirectCount : 1;
+
+		VkBuffer drawCommandBuffer = frame.drawCommandBuffer->GetBuffer();
+		U32 stride = sizeof(DrawCommandSlot);
+		U32 batchCount = static_cast<U32>(m_batchModels.size());
+
+		// Batches sharing pipeline and buffers are drawn by a single multi-draw. Culled batches have no instances.
+		U32 first = 0;
+		while (first < batchCount)
+		{
+			LveModel* model = m_batchModels[first];
+
+			U32 last = first + 1;
+			while (last < batchCount && last - first < maxDrawCount &&
+				   m_batchModels[last]->GetVertexFormat() == model->GetVertexFormat() && m_batchModels[last]->IsSharingBuffers(*model) &&
+				   m_batchModels[last]->HasIndexBuffer() == model->HasIndexBuffer())
+			{
+				++last;
+			}
+
+			m_pipelines[static_cast<USize>(model->GetVertexFormat())]->Get().Bind(commandBuffer);
+			model->Bind(commandBuffer);
+
+			if (!features.drawIndirectFirstInstance)
+			{
+				// A draw of one batch. Its instances start at the beginning of the bound range.
+				VkDeviceSize offsets[] = { sizeof(InstanceData) * m_batchFirstInstances[first] };
+				vkCmdBindVertexBuffers(commandBuffer, INSTANCE_BINDING, 1, instanceBuffers, offsets);
+			}
+
+			if (model->HasIndexBuffer())
+			{
+				vkCmdDrawIndexedIndirect(commandBuffer, drawCommandBuffer, stride * first, last - first, stride);
+			}
+			else
+			{
+				vkCmdDrawIndirect(commandBuffer, drawCommandBuffer, stride * first, last - first, stride);
+			}
+
+			first = last;
+		}
+	}
+
+	void SimpleRenderSystem::RenderCpuDriven(FrameInfo& frameInfo)
+	{
+		// Collect objects and group them by vertex format, pool buffers and model. Buffers are only rebound when they
+		// change, and each model needs one draw call.
+		m_drawItems.clear();
+		m_cullingStats = {};
+
+		m_cullSpheres.Clear();
+
+		frameInfo.registry.View<ModelComponent, TransformComponent>().Each(
+			[&](LveEntity, ModelComponent& modelComponent, TransformComponent& transform) {
+				if (modelComponent.model != nullptr)
+				{
+					m_drawItems.push_back({ modelComponent.model.get(), transform.GetWorldMatrix(), transform.GetWorldNormalMatrix() });
+				}
+			});
+
+		if (m_isFrustumCullingEnabled)
+		{
+			for (const DrawItem& drawItem : m_drawItems)
+			{
+				// World matrices may include parent rotations, so the largest scale is the longest basis vector.
+				const Matrix4& modelMatrix = drawItem.modelMatrix;
+				F32 scale = MathOp::Max(MathOp::Max(MathOp::Length(Vector3(modelMatrix[0])), MathOp::Length(Vector3(modelMatrix[1]))),
+					MathOp::Length(Vector3(modelMatrix[2])));
+
+				Vector4 sphere = drawItem.model->GetBoundingSphere();
+				m_cullSpheres.Add(Vector3(modelMatrix * Vector4(Vector3(sphere), 1.0f)), sphere.w * scale);
+			}
+		}
+
+		if (m_isFrustumCullingEnabled && !m_drawItems.empty())
+		{
+			Vector4 frustumPlanes[6];
+			frameInfo.camera.GetFrustumPlanes(frustumPlanes);
+
+			// The batch sphere test rejects most objects. The box is tighter for elongated models, so survivors are
+			// tested again one by one.
+			if (m_visibleIndices.size() < m_drawItems.size())
+			{
+				m_visibleIndices.resize(m_drawItems.size());
+			}
+
+			U32 sphereVisibleCount = MathOp::CullSpheres(frustumPlanes, m_cullSpheres, m_visibleIndices.data());
+			U32 visibleCount = 0;
+
+			for (U32 i = 0; i < sphereVisibleCount; ++i)
+			{
+				const DrawItem& drawItem = m_drawItems[m_visibleIndices[i]];
+
+				Vector3 boundsMin, boundsMax;
+				MathOp::TransformAabb(drawItem.modelMatrix, drawItem.model->GetBoundsMin(), drawItem.model->GetBoundsMax(),
+					boundsMin, boundsMax);
+
+				if (MathOp::IsAabbInFrustum(frustumPlanes, boundsMin, boundsMax))
+				{
+					// Indices are ascending, so compacting in place never overwrites an item that is still needed.
+					m_drawItems[visibleCount++] = drawItem;
+				}
+			}
+
+			m_cullingStats.culledCount = static_cast<U32>(m_drawItems.size()) - visibleCount;
+			m_drawItems.resize(visibleCount);
+		}
+
+		m_cullingStats.visibleCount = static_cast<U32>(m_drawItems.size());
+
+		if (m_drawItems.empty())
+		{
+			return;
+		}
+
+		std::sort(m_drawItems.begin(), m_drawItems.end(), [](const DrawItem& a, const DrawItem& b) { return CompareModels(a.model, b.model); });
+
+		// Write instance data of all objects in model order, so instances of the same model are contiguous.
+		U32 instanceCount = static_cast<U32>(m_drawItems.size());
+		ReserveInstanceBuffer(frameInfo.frameIndex, instanceCount);
+
+		LveBuffer& instanceBuffer = *m_instanceBuffers[frameInfo.frameIndex];
+		InstanceData* instances = static_cast<InstanceData*>(instanceBuffer.GetMappedMemory());
+
+		for (U32 i = 0; i < instanceCount; ++i)
+		{
+			// Compact models store positions relative to their bounds. Normals are not affected.
+			instances[i].modelMatrix = m_drawItems[i].modelMatrix * m_drawItems[i].model->GetDequantizeMatrix();
+			instances[i].normalMatrix = m_drawItems[i].normalMatrix;
+		}
+
+		// One group of instances per model.
+		m_drawGroups.clear();
+		for (U32 first = 0; first < instanceCount;)
+		{
+			LveModel* model = m_drawItems[first].model;
+
+			U32 last = first + 1;
+			while (last < instanceCount && m_drawItems[last].model == model)
+			{
+				++last;
+			}
+
+			m_drawGroups.push_back({ model, first, last - first });
+			first = last;
+		}
+
+		if (frameInfo.renderer.GetSubpassContents() == VK_SUBPASS_CONTENTS_INLINE)
+		{
+			RecordDrawGroups(frameInfo, frameInfo.commandBuffer, 0, static_cast<U32>(m_drawGroups.size()));
+			return;
+		}
+
+		// Split the groups into contiguous ranges, each recorded into its own secondary command buffer on the job
+		// system. The primary executes them in order, so the draw order is the same as inline.
+		U32 groupCount = static_cast<U32>(m_drawGroups.size());
+		U32 recorderCount = std::min(frameInfo.renderer.GetRecorderCount(),
+			(groupCount + MIN_DRAW_GROUPS_PER_RECORDER - 1) / MIN_DRAW_GROUPS_PER_RECORDER);
+		m_secondaryCommandBuffers.resize(recorderCount);
+
+		JobSystem::Get().ParallelFor(recorderCount, 1, [&](U32 begin, U32 end) {
+			for (U32 recorderIndex = begin; recorderIndex < end; ++recorderIndex)
+			{
+				U32 firstGroup = static_cast<U32>(static_cast<U64>(groupCount) * recorderIndex / recorderCount);
+				U32 endGroup = static_cast<U32>(static_cast<U64>(groupCount) * (recorderIndex + 1) / recorderCount);
+
+				VkCommandBuffer commandBuffer = frameInfo.renderer.BeginSecondaryCommandBuffer(recorderIndex);
+				RecordDrawGroups(frameInfo, commandBuffer, firstGroup, endGroup);
+				frameInfo.renderer.EndSecondaryCommandBuffer(commandBuffer);
+
+				m_secondaryCommandBuffers[recorderIndex] = commandBuffer;
+			}
+		});
+
+		vkCmdExecuteCommands(frameInfo.commandBuffer, recorderCount, m_secondaryCommandBuffers.data());
+	}
+
+	void SimpleRenderSystem::RecordDrawGroups(FrameInfo& frameInfo, VkCommandBuffer commandBuffer, U32 firstGroup, U32 endGroup)
+	{
+		// Bind descriptor set.
+		vkCmdBindDescriptorSets(
+			commandBuffer,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			m_pipelineLayout,
 			0,
-			nullptr);
+			1,
+			&frameInfo.globalDescriptorSet,
+			1,
+			&frameInfo.globalUboOffset);
+
+		// Bind instance buffer once. Each draw selects its range with firstInstance.
+		VkBuffer buffers[] = { m_instanceBuffers[frameInfo.frameIndex]->GetBuffer() };
+		VkDeviceSize offsets[] = { 0 };
+		vkCmdBindVertexBuffers(commandBuffer, INSTANCE_BINDING, 1, buffers, offsets);
+
+		// Render objects, one instanced draw per model. The pipeline is switched when the vertex format changes.
+		// Pipelines share the layout, so the descriptor set stays bound.
+		LvePipeline* boundPipeline = nullptr;
+		LveModel* boundModel = nullptr;
 
-		// Render objects.
-		for (auto& kv : frameInfo.gameObjects)
+		for (U32 i = firstGroup; i < endGroup; ++i)
 		{
-			auto& gameObject = kv.second;
+			const DrawGroup& drawGroup = m_drawGroups[i];
+			LveModel* model = drawGroup.model;
 
-			SimplePushConstantData push{};
-			push.modelMatrix = gameObject.transform.GetTransform();
-			push.normalMatrix = gameObject.transform.GetNormalMatrix(); // glm automatically converts from mat4 to mat3
+			LvePipeline* pipeline = &m_pipelines[static_cast<USize>(model->GetVertexFormat())]->Get();
+			if (pipeline != boundPipeline)
+			{
+				pipeline->Bind(commandBuffer);
+				boundPipeline = pipeline;
+			}
 
-			vkCmdPushConstants(frameInfo.commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
-				sizeof(SimplePushConstantData), &push);
+			// Most models share the pool buffers, so this usually binds once per vertex format.
+			if (boundModel == nullptr || !model->IsSharingBuffers(*boundModel))
+			{
+				model->Bind(commandBuffer);
+				boundModel = model;
+			}
 
-			gameObject.model->Bind(frameInfo.commandBuffer);
-			gameObject.model->Draw(frameInfo.commandBuffer);
+			model->Draw(commandBuffer, drawGroup.instanceCount, drawGroup.firstInstance);
 		}
 	}
 
@@ -8,35 +8,201 @@
 
 #include "lve/lve_camera.h"
 #include "lve/lve_device.h"
+#include "lve/lve_buffer.h"
 #include "lve/lve_pipeline.h"
-#include "lve/lve_game_object.h"
+#include "lve/lve_components.h"
 #include "lve/lve_frame_info.h"
+#include "lve/lve_descriptors.h"
+#include "lve/system/transform_system.h"
 
 #include <vector>
 #include <memory>
 
 namespace lve
 {
+	// Per-instance data that is fed to the vertex shader through a vertex buffer with instance input rate.
+	struct InstanceData
+	{
+		Matrix4 modelMatrix{ 1.0f };
+		Matrix4 normalMatrix{ 1.0f };
+
+		static std::vector<VkVertexInputBindingDescription> GetBindingDescriptions();
+		static std::vector<VkVertexInputAttributeDescription> GetAttributeDescriptions();
+	};
+
+	// Per-object data read by the culling compute shader (shaders/cull.comp) in GPU-driven mode.
+	struct GpuObjectData
+	{
+		Matrix4 modelMatrix{ 1.0f }; // without dequantization
+		Matrix4 normalMatrix{ 1.0f };
+		U32 batchIndex = 0;
+		U32 padding[3]{};
+	};
+
+	// Per-model data of a GPU-driven batch, shared by all of its objects.
+	struct GpuBatchData
+	{
+		Vector4 boundingSphere{ 0.0f }; // model space
+		// Diagonal and translation of LveModel::GetDequantizeMatrix.
+		Vector4 dequantizeScale{ 1.0f };
+		Vector4 dequantizeOffset{ 0.0f };
+		U32 firstInstance = 0;
+		U32 padding[3]{};
+	};
+
+	// Renders game objects with GPU instancing. Objects sharing the same model are drawn by a single instanced draw call.
+	//
+	// In GPU-driven mode, every object has a stable slot in a persistent object buffer, and a compute shader culls
+	// objects against the view frustum. It appends the visible ones to the instance buffer and counts them in one
+	// indirect draw command per model. Slots and batches are only rebuilt when model or transform components are
+	// added, removed or reordered. Otherwise only objects whose world matrix changed are uploaded, so the CPU cost of a
+	// frame depends on the number of changed objects and models, not on the number of objects.
 	class SimpleRenderSystem
 	{
 	public:
-		SimpleRenderSystem(LveDevice& device, VkRenderPass renderPass, VkDescriptorSetLayout globalDescriptorSetLayout);
+		enum class RenderMode
+		{
+			CpuDriven,
+			GpuDriven,
+		};
+
+		SimpleRenderSystem(LveDevice& device, VkRenderPass renderPass, VkDescriptorSetLayout globalDescriptorSetLayout,
+			RenderMode renderMode = RenderMode::CpuDriven);
 		~SimpleRenderSystem();
 
 		SimpleRenderSystem(const SimpleRenderSystem&) = delete;
 		SimpleRenderSystem& operator=(const SimpleRenderSystem&) = delete;
 
+		// Records work that has to happen outside of the render pass. Call after transformSystem.Update and before
+		// BeginSwapchainRenderPass. In GPU-driven mode, this uploads changed objects and dispatches the culling shader.
+		// Replacing the model of an existing ModelComponent is not detected. Remove and add the component instead.
+		void PrepareGameObjects(FrameInfo& frameInfo, const TransformSystem& transformSystem);
 		void RenderGameObjects(FrameInfo& frameInfo);
 
+		// Rebuild the graphics pipelines for a render pass that is not compatible with the previous one.
+		void RecreatePipelines(VkRenderPass renderPass);
+
+		RenderMode GetRenderMode() const { return m_renderMode; }
+
+		// Objects tested against the camera frustum in the last CPU-driven RenderGameObjects. GPU-driven mode culls on
+		// the GPU and does not report counts.
+		struct CullingStats
+		{
+			U32 visibleCount = 0;
+			U32 culledCount = 0;
+		};
+
+		void SetFrustumCullingEnabled(bool enabled) { m_isFrustumCullingEnabled = enabled; }
+		const CullingStats& GetCullingStats() const { return m_cullingStats; }
+
 	private:
 		void CreatePipelineLayout(VkDescriptorSetLayout globalDescriptorSetLayout);
-		void CreatePipeline(VkRenderPass renderPass);
+		void CreatePipelines(VkRenderPass renderPass);
+		void CreateCullPipeline();
+
+		void RenderCpuDriven(FrameInfo& frameInfo);
+		void RenderGpuDriven(FrameInfo& frameInfo, VkCommandBuffer commandBuffer);
+		// Records the draws of m_drawGroups[firstGroup, endGroup). Safe to call from several threads at once.
+		void RecordDrawGroups(FrameInfo& frameInfo, VkCommandBuffer commandBuffer, U32 firstGroup, U32 endGroup);
+
+		// Assigns object slots and batches to the current renderable entities.
+		void RebuildBatches(LveRegistry& registry);
+		// Records copies of the objects of m_uploadIndices from the staging buffer of the frame to their slots.
+		void UploadObjects(FrameInfo& frameInfo, const LveComponentPool<TransformComponent>& transforms);
+
+		// Make sure the instance buffer of the frame can hold at least instanceCount instances.
+		void ReserveInstanceBuffer(U32 frameIndex, U32 instanceCount);
+		// Make sure the object buffer can hold objectCount objects. Its contents are lost when it grows.
+		void ReserveObjectBuffer(U32 objectCount);
+		// Make sure the GPU-driven buffers of the frame can hold the objects, batches and uploads, and update its
+		// descriptor set.
+		void ReserveGpuBuffers(U32 frameIndex, U32 objectCount, U32 batchCount, U32 uploadCount);
 
 	private:
+		// A draw item refers to a game object that will be rendered in the current frame.
+		struct DrawItem
+		{
+			LveModel* model;
+			// World matrices of the game object, without dequantization.
+			Matrix4 modelMatrix;
+			Matrix4 normalMatrix;
+		};
+
 		LveDevice& m_device;
 
-		UniqueRef<LvePipeline> m_pipeline;
+		// One pipeline per vertex format, indexed by LveModel::VertexFormat. Built in the background.
+		std::vector<UniqueRef<LvePipelineFuture>> m_pipelines;
 		VkPipelineLayout m_pipelineLayout;
+
+		// One persistently mapped instance buffer per frame in flight, so the CPU never writes to a buffer in use by the GPU.
+		std::vector<UniqueRef<LveBuffer>> m_instanceBuffers;
+
+		// Instances of one model, contiguous in the instance buffer.
+		struct DrawGroup
+		{
+			LveModel* model;
+			U32 firstInstance;
+			U32 instanceCount;
+		};
+
+		// Reused across frames to avoid reallocating every frame.
+		std::vector<DrawItem> m_drawItems;
+		std::vector<DrawGroup> m_drawGroups;
+		std::vector<VkCommandBuffer> m_secondaryCommandBuffers;
+
+		bool m_isFrustumCullingEnabled = true;
+		CullingStats m_cullingStats{};
+		// World space bounding spheres of the draw items, in the same order.
+		BoundingSphereSoA m_cullSpheres;
+		std::vector<U32> m_visibleIndices;
+
+		// GPU-driven mode
+		struct GpuFrameResources
+		{
+			UniqueRef<LveBuffer> drawCommandBuffer;
+			UniqueRef<LveBuffer> batchBuffer;
+			// Written by the compute shader. Same layout as the CPU-driven instance buffers.
+			UniqueRef<LveBuffer> instanceBuffer;
+			// Objects uploaded in this frame.
+			UniqueRef<LveBuffer> stagingBuffer;
+			VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+			// m_objectBufferVersion when the descriptor set was last written.
+			U32 objectBufferVersion = ~0u;
+		};
+
+		// Slot in the object buffer and batch of a transform. Transforms without a model have no slot.
+		struct ObjectSlot
+		{
+			U32 slot;
+			U32 batchIndex;
+		};
+
+		RenderMode m_renderMode;
+
+		UniqueRef<LvePipelineFuture> m_cullPipeline;
+		VkPipelineLayout m_cullPipelineLayout = VK_NULL_HANDLE;
+		UniqueRef<LveDescriptorSetLayout> m_cullDescriptorSetLayout;
+		UniqueRef<LveDescriptorPool> m_cullDescriptorPool;
+		std::vector<GpuFrameResources> m_gpuFrames;
+
+		// Shared by all frames in flight. Frames only write it with copies recorded in their command buffers, which
+		// the queue orders after the culling of earlier frames.
+		UniqueRef<LveBuffer> m_objectBuffer;
+		U32 m_objectBufferVersion = 0;
+		U32 m_objectCount = 0;
+
+		// Indexed like the transform pool. Valid while the pool versions below are current.
+		std::vector<ObjectSlot> m_objectSlots;
+		U32 m_modelPoolVersion = ~0u;
+		U32 m_transformPoolVersion = ~0u;
+
+		// One batch (indirect draw command) per model, sorted like the draw items in CPU-driven mode.
+		std::vector<LveModel*> m_batchModels;
+		std::vector<U32> m_batchFirstInstances;
+
+		// Reused across frames. Transform pool indices of the objects to upload and their copy regions.
+		std::vector<U32> m_uploadIndices;
+		std::vector<VkBufferCopy> m_uploadRegions;
 	};
 
 } // namespace lve
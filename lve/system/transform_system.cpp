@@ -0,0 +1,267 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/17/24.
+//
+
+#include "transform_system.h"
+
+#include <algorithm>
+
+namespace lve
+{
+	void TransformSystem::SetParent(LveRegistry& registry, LveEntity child, LveEntity parent)
+	{
+		ASSERT(child != parent, "Entity cannot be its own parent!");
+
+		LveComponentPool<HierarchyComponent>& hierarchies = registry.GetPool<HierarchyComponent>();
+
+		for (LveEntity ancestor = parent; ancestor != INVALID_ENTITY;)
+		{
+			ASSERT(ancestor != child, "Entity cannot be parented to its own descendant!");
+			HierarchyComponent* hierarchy = hierarchies.TryGet(ancestor);
+			ancestor = hierarchy ? hierarchy->parent : INVALID_ENTITY;
+		}
+
+		RemoveParent(registry, child);
+
+		// Adding components may move the others in the pool, so look both up afterwards.
+		if (!hierarchies.Has(child))
+		{
+			hierarchies.Add(child);
+		}
+		if (!hierarchies.Has(parent))
+		{
+			hierarchies.Add(parent);
+		}
+
+		HierarchyComponent& childHierarchy = hierarchies.Get(child);
+		HierarchyComponent& parentHierarchy = hierarchies.Get(parent);
+		childHierarchy.parent = parent;
+		childHierarchy.nextSibling = parentHierarchy.firstChild;
+		parentHierarchy.firstChild = child;
+
+		registry.GetComponent<TransformComponent>(child).MarkDirty();
+		m_isHierarchyChanged = true;
+	}
+
+	void TransformSystem::RemoveParent(LveRegistry& registry, LveEntity child)
+	{
+		LveComponentPool<HierarchyComponent>& hierarchies = registry.GetPool<HierarchyComponent>();
+
+		HierarchyComponent* childHierarchy = hierarchies.TryGet(child);
+		if (childHierarchy == nullptr || childHierarchy->parent == INVALID_ENTITY)
+		{
+			return;
+		}
+
+		// Unlink from the sibling list.
+		LveEntity* link = &hierarchies.Get(childHierarchy->parent).firstChild;
+		while (*link != child)
+		{
+			link = &hierarchies.Get(*link).nextSibling;
+		}
+		*link = childHierarchy->nextSibling;
+
+		childHierarchy->parent = INVALID_ENTITY;
+		childHierarchy->nextSibling = INVALID_ENTITY;
+
+		registry.GetComponent<TransformComponent>(child).MarkDirty();
+		m_isHierarchyChanged = true;
+	}
+
+	void TransformSystem::DestroyEntity(LveRegistry& registry, LveEntity entity)
+	{
+		RemoveParent(registry, entity);
+
+		LveComponentPool<HierarchyComponent>& hierarchies = registry.GetPool<HierarchyComponent>();
+
+		// Descendants are destroyed with the entity, so no sibling lists need to be updated below it.
+		std::vector<LveEntity> pendingEntities{ entity };
+		while (!pendingEntities.empty())
+		{
+			LveEntity current = pendingEntities.back();
+			pendingEntities.pop_back();
+
+			if (HierarchyComponent* hierarchy = hierarchies.TryGet(current))
+			{
+				for (LveEntity child = hierarchy->firstChild; child != INVALID_ENTITY; child = hierarchies.Get(child).nextSibling)
+				{
+					pendingEntities.push_back(child);
+				}
+			}
+
+			registry.DestroyEntity(current);
+		}
+
+		m_isHierarchyChanged = true;
+	}
+
+	void TransformSystem::Update(LveRegistry& registry)
+	{
+		LveComponentPool<TransformComponent>& transforms = registry.GetPool<TransformComponent>();
+
+		m_changedIndices.clear();
+
+		if (m_isHierarchyChanged || m_transformPoolVersion != transforms.GetVersion())
+		{
+			// Dense indices changed, so every transform is checked once. New transforms are dirty and not in the dirty
+			// list yet. A transform changes if it is dirty or its parent changed. Parents come first, so one pass is enough.
+			RebuildOrder(registry);
+			m_dirtyList.Clear();
+
+			const TransformComponent* transformData = transforms.Data();
+			U32 transformCount = static_cast<U32>(transforms.Size());
+
+			for (U32 i = 0; i < transformCount; ++i)
+			{
+				U32 parentIndex = m_parentIndices[i];
+				if (transformData[i].m_isDirty || (parentIndex != NO_PARENT && m_isWorldChanged[parentIndex]))
+				{
+					m_isWorldChanged[i] = 1;
+					m_changedIndices.push_back(i);
+				}
+			}
+		}
+		else
+		{
+			// Only dirty transforms and their descendants are visited. Frames in which nothing changed return here.
+			m_dirtyList.Take(m_dirtyEntities);
+			if (m_dirtyEntities.empty())
+			{
+				return;
+			}
+
+			CollectChangedSubtrees(registry);
+		}
+
+		if (m_changedIndices.empty())
+		{
+			return;
+		}
+
+		TransformComponent* transformData = transforms.Data();
+
+		m_changedTransforms.Clear();
+		for (U32 index : m_changedIndices)
+		{
+			m_changedTransforms.Add(transformData[index]);
+			transformData[index].m_isDirty = false;
+			m_isWorldChanged[index] = 0;
+		}
+
+		m_localMatrices.resize(m_changedIndices.size());
+		m_localNormalMatrices.resize(m_changedIndices.size());
+		m_changedTransforms.ComputeMatrices(m_localMatrices.data(), m_localNormalMatrices.data());
+
+		// (P * L)^-T = P^-T * L^-T, so normal matrices compose like model matrices.
+		for (USize i = 0; i < m_changedIndices.size(); ++i)
+		{
+			U32 index = m_changedIndices[i];
+			U32 parentIndex = m_parentIndices[index];
+			TransformComponent& transform = transformData[index];
+
+			if (parentIndex == NO_PARENT)
+			{
+				transform.m_worldMatrix = m_localMatrices[i];
+				transform.m_worldNormalMatrix = m_localNormalMatrices[i];
+			}
+			else
+			{
+				const TransformComponent& parent = transformData[parentIndex];
+				transform.m_worldMatrix = parent.m_worldMatrix * m_localMatrices[i];
+				transform.m_worldNormalMatrix = parent.m_worldNormalMatrix * m_localNormalMatrices[i];
+			}
+		}
+	}
+
+	void TransformSystem::CollectChangedSubtrees(LveRegistry& registry)
+	{
+		LveComponentPool<TransformComponent>& transforms = registry.GetPool<TransformComponent>();
+		LveComponentPool<HierarchyComponent>& hierarchies = registry.GetPool<HierarchyComponent>();
+
+		// A transform that is already marked was reached from a dirty ancestor or is dirty itself, and so was its subtree.
+		for (LveEntity dirtyEntity : m_dirtyEntities)
+		{
+			m_pendingEntities.push_back(dirtyEntity);
+
+			while (!m_pendingEntities.empty())
+			{
+				LveEntity entity = m_pendingEntities.back();
+				m_pendingEntities.pop_back();
+
+				U32 index = transforms.GetIndex(entity);
+				if (index == LveComponentPool<TransformComponent>::INVALID_INDEX || m_isWorldChanged[index])
+				{
+					continue;
+				}
+
+				m_isWorldChanged[index] = 1;
+				m_changedIndices.push_back(index);
+
+				if (HierarchyComponent* hierarchy = hierarchies.TryGet(entity))
+				{
+					for (LveEntity child = hierarchy->firstChild; child != INVALID_ENTITY; child = hierarchies.Get(child).nextSibling)
+					{
+						m_pendingEntities.push_back(child);
+					}
+				}
+			}
+		}
+
+		// Parents come before their children in the pool, so ascending order updates parents first.
+		std::sort(m_changedIndices.begin(), m_changedIndices.end());
+	}
+
+	void TransformSystem::RebuildOrder(LveRegistry& registry)
+	{
+		LveComponentPool<TransformComponent>& transforms = registry.GetPool<TransformComponent>();
+		LveComponentPool<HierarchyComponent>& hierarchies = registry.GetPool<HierarchyComponent>();
+
+		// Roots first, then children level by level. The order array doubles as the queue.
+		std::vector<LveEntity> order;
+		order.reserve(transforms.Size());
+
+		for (LveEntity entity : transforms.GetEntities())
+		{
+			HierarchyComponent* hierarchy = hierarchies.TryGet(entity);
+			if (hierarchy == nullptr || hierarchy->parent == INVALID_ENTITY)
+			{
+				order.push_back(entity);
+			}
+		}
+
+		for (USize i = 0; i < order.size(); ++i)
+		{
+			if (HierarchyComponent* hierarchy = hierarchies.TryGet(order[i]))
+			{
+				for (LveEntity child = hierarchy->firstChild; child != INVALID_ENTITY; child = hierarchies.Get(child).nextSibling)
+				{
+					order.push_back(child);
+				}
+			}
+		}
+
+		ASSERT(order.size() == transforms.Size(), "Entity hierarchy refers to entities without a transform!");
+
+		transforms.Reorder(order);
+
+		// Changes to the transforms are reported to this system from now on.
+		TransformComponent* transformData = transforms.Data();
+		for (USize i = 0; i < order.size(); ++i)
+		{
+			transformData[i].m_dirtyList = &m_dirtyList;
+			transformData[i].m_entity = order[i];
+		}
+
+		m_parentIndices.resize(order.size());
+		for (USize i = 0; i < order.size(); ++i)
+		{
+			HierarchyComponent* hierarchy = hierarchies.TryGet(order[i]);
+			m_parentIndices[i] = hierarchy && hierarchy->parent != INVALID_ENTITY ? transforms.GetIndex(hierarchy->parent) : NO_PARENT;
+		}
+
+		m_isWorldChanged.assign(order.size(), 0);
+		m_isHierarchyChanged = false;
+		m_transformPoolVersion = transforms.GetVersion();
+	}
+
+} // namespace lve
@@ -0,0 +1,70 @@
+//
+// Created by Junhao Wang (@forkercat) on 5/17/24.
+//
+
+#pragma once
+
+#include "core/core.h"
+
+#include "lve/lve_components.h"
+#include "lve/lve_registry.h"
+
+#include <vector>
+
+namespace lve
+{
+	// Updates the cached world matrices of entities and owns the parent/child hierarchy.
+	//
+	// The transform pool is sorted in breadth-first order of the hierarchy, so parents always come before their
+	// children. Transforms report changes to the dirty list of the system, and an update only visits the dirty
+	// transforms and their descendants. Frames in which no transform changed return immediately. Adding, removing or
+	// reparenting transforms rebuilds the order, after which every transform is checked once.
+	//
+	// Transforms keep a pointer to the system, so it must outlive changes to the transforms it updates.
+	class TransformSystem
+	{
+	public:
+		TransformSystem() = default;
+
+		TransformSystem(const TransformSystem&) = delete;
+		TransformSystem& operator=(const TransformSystem&) = delete;
+
+		// Both entities need a transform. The local transform of the child becomes relative to the new parent.
+		void SetParent(LveRegistry& registry, LveEntity child, LveEntity parent);
+		void RemoveParent(LveRegistry& registry, LveEntity child);
+		// Destroys the entity and all of its descendants. Use this instead of LveRegistry::DestroyEntity for entities
+		// in a hierarchy.
+		void DestroyEntity(LveRegistry& registry, LveEntity entity);
+
+		void Update(LveRegistry& registry);
+
+		// Dense indices in the transform pool of the transforms whose world matrix changed in the last Update, in
+		// ascending order. They refer to the pool order after the Update, which may have reordered the pool.
+		const std::vector<U32>& GetChangedIndices() const { return m_changedIndices; }
+
+	private:
+		void RebuildOrder(LveRegistry& registry);
+		// Adds the dense indices of m_dirtyEntities and their descendants to m_changedIndices, in ascending order.
+		void CollectChangedSubtrees(LveRegistry& registry);
+
+	private:
+		static constexpr U32 NO_PARENT = ~0u;
+
+		// Dense index of the parent transform of each transform.
+		std::vector<U32> m_parentIndices;
+		// Marks the transforms that change in the current update. All zero between updates.
+		std::vector<U8> m_isWorldChanged;
+		TransformDirtyList m_dirtyList;
+		bool m_isHierarchyChanged = true;
+		U32 m_transformPoolVersion = ~0u;
+
+		// Reused across updates.
+		std::vector<LveEntity> m_dirtyEntities;
+		std::vector<LveEntity> m_pendingEntities;
+		std::vector<U32> m_changedIndices;
+		TransformBatch m_changedTransforms;
+		std::vector<Matrix4> m_localMatrices;
+		std::vector<Matrix4> m_localNormalMatrices;
+	};
+
+} // namespace lve